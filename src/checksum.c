@@ -0,0 +1,297 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* XXH64 and CRC32C, fast enough to run on every buffer the drive
+   hands over. XXH64 keeps four independent lanes the compiler can
+   spread over the pipeline, CRC32C uses the crc32 instruction when
+   built for SSE 4.2 or ARMv8 CRC */
+
+#include <string.h>
+#include <strings.h>
+#include <pthread.h>
+
+#include "checksum.h"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+#define PRIME64_1 11400714785074694791ULL
+#define PRIME64_2 14029467366897019727ULL
+#define PRIME64_3  1609587929392839161ULL
+#define PRIME64_4  9650029242287828579ULL
+#define PRIME64_5  2870177450012600261ULL
+
+/* Reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+int
+ChecksumType (const char *name)
+{
+    if (strcasecmp(name, "xxh64") == 0) {
+        return(CHECKSUM_XXH64);
+    }
+    if (strcasecmp(name, "crc32c") == 0) {
+        return(CHECKSUM_CRC32C);
+    }
+    return(CHECKSUM_NONE);
+}
+
+const char*
+ChecksumName (int type)
+{
+    return(type == CHECKSUM_CRC32C ? "crc32c" : "xxh64");
+}
+
+/* Hex digits of a checksum in the manifest */
+int
+ChecksumDigits (int type)
+{
+    return(type == CHECKSUM_CRC32C ? 8 : 16);
+}
+
+static uint64_t
+Read64 (const unsigned char *p)
+{
+    uint64_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return(v);
+}
+
+static uint32_t
+Read32 (const unsigned char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    v = __builtin_bswap32(v);
+#endif
+    return(v);
+}
+
+static uint64_t
+Rotl64 (uint64_t v, int r)
+{
+    return((v << r) | (v >> (64 - r)));
+}
+
+static uint64_t
+XXH64Round (uint64_t acc, uint64_t input)
+{
+    acc = acc + input * PRIME64_2;
+    acc = Rotl64(acc, 31);
+    return(acc * PRIME64_1);
+}
+
+static uint64_t
+XXH64Merge (uint64_t acc, uint64_t v)
+{
+    acc = acc ^ XXH64Round(0, v);
+    return(acc * PRIME64_1 + PRIME64_4);
+}
+
+/* Whole 32 byte stripes, one lane each */
+static const unsigned char*
+XXH64Stripes (uint64_t v[4], const unsigned char *p, const unsigned char *end)
+{
+    uint64_t v1 = v[0];
+    uint64_t v2 = v[1];
+    uint64_t v3 = v[2];
+    uint64_t v4 = v[3];
+
+    while ( p + 32 <= end ) {
+        v1 = XXH64Round(v1, Read64(p));
+        v2 = XXH64Round(v2, Read64(p + 8));
+        v3 = XXH64Round(v3, Read64(p + 16));
+        v4 = XXH64Round(v4, Read64(p + 24));
+        p = p + 32;
+    }
+
+    v[0] = v1;
+    v[1] = v2;
+    v[2] = v3;
+    v[3] = v4;
+    return(p);
+}
+
+static uint64_t
+XXH64Final (const checksum_t *sum)
+{
+    const unsigned char *p   = sum->mem;
+    const unsigned char *end = sum->mem + sum->memsize;
+    uint64_t             h;
+
+    if (sum->total >= 32) {
+        h = Rotl64(sum->v[0], 1) + Rotl64(sum->v[1], 7)
+            + Rotl64(sum->v[2], 12) + Rotl64(sum->v[3], 18);
+        h = XXH64Merge(h, sum->v[0]);
+        h = XXH64Merge(h, sum->v[1]);
+        h = XXH64Merge(h, sum->v[2]);
+        h = XXH64Merge(h, sum->v[3]);
+    } else {
+        h = PRIME64_5;
+    }
+    h = h + sum->total;
+
+    while ( p + 8 <= end ) {
+        h = h ^ XXH64Round(0, Read64(p));
+        h = Rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p = p + 8;
+    }
+    if ( p + 4 <= end ) {
+        h = h ^ ((uint64_t)Read32(p) * PRIME64_1);
+        h = Rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p = p + 4;
+    }
+    while ( p < end ) {
+        h = h ^ (*p * PRIME64_5);
+        h = Rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h = h ^ (h >> 33);
+    h = h * PRIME64_2;
+    h = h ^ (h >> 29);
+    h = h * PRIME64_3;
+    return(h ^ (h >> 32));
+}
+
+static void
+XXH64Update (checksum_t *sum, const unsigned char *p, size_t length)
+{
+    const unsigned char *end = p + length;
+    size_t               fill;
+
+    sum->total = sum->total + length;
+
+    if ( sum->memsize + length < 32 ) {
+        memcpy(sum->mem + sum->memsize, p, length);
+        sum->memsize = sum->memsize + length;
+        return;
+    }
+
+    if ( sum->memsize > 0 ) {
+        fill = 32 - sum->memsize;
+        memcpy(sum->mem + sum->memsize, p, fill);
+        XXH64Stripes(sum->v, sum->mem, sum->mem + 32);
+        p = p + fill;
+        sum->memsize = 0;
+    }
+
+    p = XXH64Stripes(sum->v, p, end);
+
+    memcpy(sum->mem, p, end - p);
+    sum->memsize = end - p;
+}
+
+#if !defined(__SSE4_2__) && !defined(__ARM_FEATURE_CRC32)
+static uint32_t       crc32c_table[256];
+static pthread_once_t crc32c_once = PTHREAD_ONCE_INIT;
+
+static void
+CRC32CTable (void)
+{
+    /* Loop variables */
+    int i, j;
+
+    uint32_t crc;
+
+    for ( i = 0; i < 256; i++ ) {
+        crc = i;
+        for ( j = 0; j < 8; j++ ) {
+            crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+        }
+        crc32c_table[i] = crc;
+    }
+}
+#endif
+
+static void
+CRC32CUpdate (checksum_t *sum, const unsigned char *p, size_t length)
+{
+    const unsigned char *end = p + length;
+    uint32_t             crc = sum->crc;
+#if defined(__SSE4_2__)
+    uint64_t             crc64 = crc;
+#endif
+
+    sum->total = sum->total + length;
+
+#if defined(__SSE4_2__)
+    while ( p + 8 <= end ) {
+        crc64 = _mm_crc32_u64(crc64, Read64(p));
+        p = p + 8;
+    }
+    crc = (uint32_t)crc64;
+    while ( p < end ) {
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+#elif defined(__ARM_FEATURE_CRC32)
+    while ( p + 8 <= end ) {
+        crc = __crc32cd(crc, Read64(p));
+        p = p + 8;
+    }
+    while ( p < end ) {
+        crc = __crc32cb(crc, *p++);
+    }
+#else
+    pthread_once(&crc32c_once, CRC32CTable);
+    while ( p < end ) {
+        crc = (crc >> 8) ^ crc32c_table[(crc ^ *p++) & 0xff];
+    }
+#endif
+
+    sum->crc = crc;
+}
+
+void
+ChecksumInit (checksum_t *sum, int type)
+{
+    memset(sum, 0, sizeof(checksum_t));
+    sum->type = type;
+    sum->v[0] = PRIME64_1 + PRIME64_2;
+    sum->v[1] = PRIME64_2;
+    sum->v[2] = 0;
+    sum->v[3] = -PRIME64_1;
+    sum->crc  = 0xFFFFFFFF;
+}
+
+void
+ChecksumUpdate (checksum_t *sum, const unsigned char *data, size_t length)
+{
+    if (sum->type == CHECKSUM_CRC32C) {
+        CRC32CUpdate(sum, data, length);
+    } else {
+        XXH64Update(sum, data, length);
+    }
+}
+
+uint64_t
+ChecksumFinal (const checksum_t *sum)
+{
+    if (sum->type == CHECKSUM_CRC32C) {
+        return(sum->crc ^ 0xFFFFFFFF);
+    }
+    return(XXH64Final(sum));
+}
@@ -0,0 +1,47 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Checksums for the --checksum manifest */
+#define CHECKSUM_NONE   0
+#define CHECKSUM_XXH64  1
+#define CHECKSUM_CRC32C 2
+
+/* Running checksum, fed with any number of ChecksumUpdate calls */
+
+typedef struct {
+    int           type;
+    uint64_t      total;
+    uint64_t      v[4];
+    unsigned char mem[32];
+    int           memsize;
+    uint32_t      crc;
+} checksum_t;
+
+int ChecksumType(const char *name);
+const char *ChecksumName(int type);
+int ChecksumDigits(int type);
+void ChecksumInit(checksum_t *sum, int type);
+void ChecksumUpdate(checksum_t *sum, const unsigned char *data, size_t length);
+uint64_t ChecksumFinal(const checksum_t *sum);
+
+#endif
@@ -25,1296 +25,4137 @@ void usage()
 {
     fprintf(stderr,
             "\nUsage: dvdbackup [options]\n"
-            "\t-i device\twhere device is your dvd device\n"
+            "\t-i device\twhere device is your dvd device, give -i "
+            "more than once to back up several at a time\n"
             "\t-v X\t\twhere X is the amount of verbosity\n"
             "\t-I\t\tfor information about the DVD\n"
-            "\t-o directory\twhere directory is your backup target\n"
+            "\t-o directory\twhere directory is your backup target, with "
+            "-t or -s/-e\n\t\t\t- or a named pipe to stream the cells in "
+            "playback order\n"
             "\t-n dvd_title\tDVD title "
             "(in case it is not automatically determined)\n"
             "\t-M\t\tbackup the whole DVD\n"
             "\t-F\t\tbackup the main feature of the DVD\n"
             "\t-T X\t\tbackup title set X\n"
-            "\t-t X\t\tbackup title X\n"
+            "\t-t X\t\tbackup title X, or titles X,Y,... in one pass\n"
             "\t-s X\t\tbackup from chapter X\n"
             "\t-e X\t\tbackup to chapter X\n"
             "\t-a 0\t\tto get aspect ratio 4:3 "
             "instead of 16:9 if both are present\n"
+            "\t-r X\t\tuse X buffers between reader and writer "
+            "(default 2, 1 disables the reader thread)\n"
+            "\t-b X\t\tread X sectors of 2048 bytes at a time "
+            "(default 2048)\n"
+            "\t--adaptive\tfind the fastest read size up to -b "
+            "for every file\n"
+            "\t-u\t\twrite through io_uring instead of write() "
+            "if it is available\n"
+            "\t--direct-io\twrite VOB files with O_DIRECT, "
+            "bypassing the page cache\n"
+            "\t--resume\tcontinue an interrupted -M, -F or -T backup "
+            "from its journal\n"
+            "\t--journal-interval X\n\t\t\tcommit the journal every X "
+            "seconds (default 10)\n"
+            "\t--incremental\tonly rewrite the parts of an existing backup "
+            "that differ\n\t\t\tfrom the DVD\n"
+            "\t--checksum X\twrite a manifest with xxh64 or crc32c checksums "
+            "of every file\n\t\t\tand every MB of it\n"
+            "\t--recover\tzero fill sectors that can't be read instead "
+            "of giving up,\n\t\t\tlisting them in dvdbackup.bad\n"
+            "\t--rescue\tonly read what an earlier --recover left in its "
+            "rescue maps\n"
+            "\t--retries X\twith --recover retry failed reads at most "
+            "X times\n\t\t\tin all (default 256)\n"
+            "\t--sparse\twith -t and -s/-e write cells at their original "
+            "offsets,\n\t\t\tleaving the rest of each VOB as a hole\n"
+            "\t--image\t\twith -M write a UDF and ISO 9660 image, "
+            "title.iso,\n\t\t\tinstead of the VIDEO_TS directory\n"
+            "\t--playable\twith -M, -F or -T only read the VOB sectors "
+            "some PGC plays,\n\t\t\tleaving the rest of each VOB as a hole\n"
+            "\t--dedup\t\tshare VOB data with earlier backups under -o "
+            "through\n\t\t\tthe dvdbackup.store directory, only whole VOBs "
+            "on\n\t\t\tfilesystems without reflinks\n"
+            "\t--no-clone\tread an image or directory source like a "
+            "drive instead of\n\t\t\tcopying its unscrambled sectors "
+            "in the kernel\n"
+            "\t--mmap\t\tread an image source through a mapping "
+            "of it\n"
+            "\t-j X\t\tmirror with X workers when the source "
+            "is an image or a directory\n"
+            "\t-w X\t\tshare X writer threads between the devices "
+            "of a batch (default 2)\n"
+            "\t--stats FILE\twrite timings and latencies as JSON to FILE "
+            "at the end,\n\t\t\t- for stderr\n"
+            "\t--progress X\tprint a progress line every X seconds\n"
             "\t-h\t\tprint a brief usage message\n"
             "\t-?\t\tprint a brief usage message\n\n"
             "\t-i is mandatory\n"
             "\t-o is mandatory except if you use -I\n"
+            "\t-I and -n can't be used with more than one -i\n"
             "\t-a is option to the -F switch and "
             "has no effect on other options\n"
             "\t-s and -e should preferably be used together with -t\n\n");
     exit(EX_USAGE);
 }
 
-int
-CheckSizeArray (const int size_array[], int reference, int target)
+void
+DVDSetDirectIO (int streamout, char *targetname)
 {
-    /* If true:
-       We have a dual DVD with two feature films - now lets see if
-       they have the same amount of chapters */
-    return ((size_array[target] != 0)
-            && ((size_array[reference]/size_array[target]) == 1)
-            && ((size_array[reference] * 2 - size_array[target])
-                / (size_array[target]) == 1)
-            && ((size_array[reference] % size_array[target] * 3)
-                < size_array[reference]));
-}
-
-int
-CheckAudioSubChannels (int audio_audio_array[], int title_set_audio_array[],
-                       int subpicture_sub_array[], int title_set_sub_array[],
-                       int channels_channel_array[],
-                       int title_set_channel_array[],
-                       int reference, int candidate, int title_sets)
-{
-    int temp, i, found_audio, found_sub, found_channels;
-
-    found_audio=0;
-    temp = audio_audio_array[reference];
-    for (i=0 ; i < title_sets ; i++ ) {
-        if ( audio_audio_array[i] < temp ) {
-            break;
-        }
-        if ( candidate == title_set_audio_array[i] ) {
-            found_audio=1;
-            break;
-        }
-
-    }
-
-    found_sub=0;
-    temp = subpicture_sub_array[reference];
-    for (i=0 ; i < title_sets ; i++ ) {
-        if ( subpicture_sub_array[i] < temp ) {
-            break;
-        }
-        if ( candidate == title_set_sub_array[i] ) {
-            found_sub=1;
-            break;
-        }
+    int flags;
 
+    if ( !direct_io ) {
+        return;
     }
 
-    found_channels=0;
-    temp = channels_channel_array[reference];
-    for (i=0 ; i < title_sets ; i++ ) {
-        if ( channels_channel_array[i] < temp ) {
-            break;
-        }
-        if ( candidate == title_set_channel_array[i] ) {
-            found_channels=1;
-            break;
-        }
-
+    flags = fcntl(streamout, F_GETFL);
+    if (DIRECT_IO_FLAG == 0 || flags == -1
+        || fcntl(streamout, F_SETFL, flags | DIRECT_IO_FLAG) == -1) {
+        fprintf(stderr, "Can't use direct I/O for %s, writing it through "
+                "the page cache\n", targetname);
     }
-
-    return(found_audio + found_sub + found_channels);
 }
 
-int
-DVDWriteCells (dvd_reader_t *dvd,
-               int cell_start_sector[], int cell_end_sector[],
-               int length, int titles,
-               title_set_info_t *title_set_info,
-               titles_info_t *titles_info,
-               char *targetdir, char *title_name)
+/* Seconds on a clock that only goes forward */
+static double
+DVDClock (void)
 {
-    /* Loop variables */
-    int i, f;
+    struct timespec now;
 
-    /* Vob control */
-    int vob;
-
-    /* Temp filename,dirname */
-    char targetname[PATH_MAX];
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return(now.tv_sec + now.tv_nsec / 1e9);
+}
 
-    /* Write buffer */
+/* Everything --stats and --progress report on, shared by all threads */
+static stats_t stats;
 
-    unsigned char *buffer = NULL;
+/* Bytes copied by the calling thread, phases count theirs from it */
+static __thread long long phase_bytes = 0;
 
-    /* File Handler */
-    int streamout;
+static int
+DVDStatsOn (void)
+{
+    return(stats_file != NULL || progress_interval > 0);
+}
 
-    int size;
-    int left;
-    int leftover;
+static void
+DVDLatency (latency_stat_t *latency, double seconds)
+{
+    double microseconds = seconds * 1e6;
+    int    i = 0;
 
-    /* Buffer size in DVD sectors */
-    int buff = READ_BUF_SIZE_IN_BLOCKS;
-    int tsize;
+    while ( microseconds >= 1 && i < LATENCY_BUCKETS - 1 ) {
+        microseconds = microseconds / 2;
+        i++;
+    }
 
-    /* Offsets */
-    int soffset;
-    int offset;
+    pthread_mutex_lock(&stats.lock);
+    latency->count++;
+    latency->seconds = latency->seconds + seconds;
+    latency->bucket[i]++;
+    pthread_mutex_unlock(&stats.lock);
+}
 
-    /* DVD handler */
-    dvd_file_t *dvd_file = NULL;
+static void
+DVDPhaseStart (phase_t *phase)
+{
+    phase->started = DVDClock();
+    phase->bytes   = phase_bytes;
+}
 
-    int title_set;
-    int number_of_vob_files;
+static void
+DVDPhaseEnd (phase_t *phase, const char *name)
+{
+    /* Loop variable */
+    int i;
 
-#ifdef DEBUG
-    fprintf(stderr,"DVDWriteCells: length is %d\n", length);
-#endif
+    if ( !DVDStatsOn() ) {
+        return;
+    }
 
-    title_set = titles_info->titles[titles - 1].title_set;
-    number_of_vob_files = title_set_info->title_set[title_set].number_of_vob_files;
-#ifdef DEBUG
-    fprintf(stderr,"DVDWriteCells: title set is %d\n", title_set);
-    fprintf(stderr,"DVDWriteCells: vob files are %d\n", number_of_vob_files);
-#endif
+    pthread_mutex_lock(&stats.lock);
+    for ( i = 0; i < stats.phases; i++ ) {
+        if ( strcmp(stats.phase[i].name, name) == 0 ) {
+            break;
+        }
+    }
+    if ( i == stats.phases && i < MAX_PHASES ) {
+        stats.phase[i].name = name;
+        stats.phases++;
+    }
+    if ( i < stats.phases ) {
+        stats.phase[i].calls++;
+        stats.phase[i].bytes   = stats.phase[i].bytes + phase_bytes - phase->bytes;
+        stats.phase[i].seconds = stats.phase[i].seconds + DVDClock() - phase->started;
+    }
+    pthread_mutex_unlock(&stats.lock);
+}
 
-    /* Remove all old files silently if they exists */
+/* The same target keeps one entry through all the copies it takes */
+static file_stat_t*
+DVDFileStat (char *targetname)
+{
+    /* Loop variable */
+    int i;
 
-    for ( i = 0 ; i < 10 ; i++ ) {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",targetdir,
-                title_name, title_set, i + 1);
-#ifdef DEBUG
-        fprintf(stderr,"DVDWriteCells: file is %s\n", targetname);
-#endif
-        unlink( targetname);
+    file_stat_t  *stat = NULL;
+    file_stat_t **file;
 
+    pthread_mutex_lock(&stats.lock);
+    for ( i = 0; i < stats.files; i++ ) {
+        if ( strcmp(stats.file[i]->name, targetname) == 0 ) {
+            stat = stats.file[i];
+            break;
+        }
+    }
+    if ( stat == NULL
+         && (file = (file_stat_t **)realloc(stats.file, (stats.files + 1)
+                                            * sizeof(file_stat_t *))) != NULL ) {
+        stats.file = file;
+        if ((stat = (file_stat_t *)calloc(1, sizeof(file_stat_t))) != NULL) {
+            strcpy(stat->name, targetname);
+            stats.file[stats.files++] = stat;
+        }
     }
+    if ( stat != NULL && stat->first == 0 ) {
+        stat->first = DVDClock();
+        stat->last  = stat->first;
+    }
+    pthread_mutex_unlock(&stats.lock);
 
-    /* Loop through all sectors and find the right vob */
-    for (f = 0; f < length ; f++) {
+    return(stat);
+}
 
-        soffset=0;
-        offset=0;
+/* Count bytes that went out to a target */
+static void
+DVDStatBytes (file_stat_t *stat, long long bytes)
+{
+    phase_bytes = phase_bytes + bytes;
 
-        /* Now figure which vob we will use and write to that vob and
-           if there is a left over write to the next vob*/
+    pthread_mutex_lock(&stats.lock);
+    stats.bytes = stats.bytes + bytes;
+    if ( stat != NULL ) {
+        stat->bytes = stat->bytes + bytes;
+        stat->last  = DVDClock();
+    }
+    pthread_mutex_unlock(&stats.lock);
+}
 
-        for ( i = 0; i < number_of_vob_files ; i++ ) {
+static double
+DVDLatencyAverage (latency_stat_t *latency)
+{
+    return(latency->count > 0 ? latency->seconds / latency->count * 1000 : 0);
+}
 
-            tsize = title_set_info->title_set[title_set].size_vob[i];
+/* A progress line every --progress seconds until DVDStatsStop */
+static void *
+DVDProgress (void *arg)
+{
+    struct timespec wake;
+    long long       bytes = 0;
+    double          last;
+    double          now;
+
+    (void)arg;
+    last = DVDClock();
+
+    pthread_mutex_lock(&stats.lock);
+    while ( !stats.stopping ) {
+        clock_gettime(CLOCK_REALTIME, &wake);
+        wake.tv_sec = wake.tv_sec + progress_interval;
+        if ( pthread_cond_timedwait(&stats.stop, &stats.lock, &wake) == 0
+             || stats.stopping ) {
+            continue;
+        }
+        now = DVDClock();
+        fprintf(stderr, "Progress: %.1f MB in %.0f s, %.1f MB/s, reads %.2f ms, "
+                "writes %.2f ms on average\n",
+                stats.bytes / (1024.0 * 1024.0), now - stats.started,
+                (stats.bytes - bytes) / (1024.0 * 1024.0) / (now - last),
+                DVDLatencyAverage(&stats.read), DVDLatencyAverage(&stats.write));
+        bytes = stats.bytes;
+        last  = now;
+    }
+    pthread_mutex_unlock(&stats.lock);
 
-            if (tsize%2048 != 0) {
-                fprintf(stderr, "The Title VOB number %d of title set %d "
-                        "doesn't have a valid DVD size\n", i + 1, title_set);
-                return(1);
-            } else {
-                soffset = offset;
-                offset = offset + tsize/2048;
-            }
-#ifdef DEBUG
-            fprintf(stderr,"DVDWriteCells: soffset is %d\n", soffset);
-            fprintf(stderr,"DVDWriteCells: offset is %d\n", offset);
-#endif
-            /* Find out if this is the right vob */
-            if( soffset <= cell_start_sector[f]  && offset > cell_start_sector[f] ) {
-#ifdef DEBUG
-                fprintf(stderr,"DVDWriteCells: got it \n");
-#endif
-                leftover=0;
-                soffset = cell_start_sector[f];
-                if ( cell_end_sector[f] > offset ) {
-                    leftover = cell_end_sector[f] - offset + 1;
-                } else {
-                    size = cell_end_sector[f] - cell_start_sector[f] + 1;
-                }
-#ifdef DEBUG
-                fprintf(stderr,"DVDWriteCells: size is %d\n", size);
-#endif
-                vob = i + 1;
-                break;
-            }
+    return(NULL);
+}
 
-        }
-#ifdef DEBUG
-        fprintf(stderr,
-                "DVDWriteCells: Writing soffset is %d and leftover is %d\n",
-                soffset, leftover);
-#endif
+static void
+DVDStatsStart (void)
+{
+    pthread_mutex_init(&stats.lock, NULL);
+    pthread_cond_init(&stats.stop, NULL);
+    stats.started = DVDClock();
+    if ( progress_interval > 0
+         && pthread_create(&stats.progress, NULL, DVDProgress, NULL) != 0 ) {
+        fprintf(stderr, "Failed creating the progress thread\n");
+        progress_interval = 0;
+    }
+}
 
-        /* Create VTS_XX_X.VOB */
-        if (title_set == 0) {
-            fprintf(stderr,
-                    "Don't try to copy chapters from the VMG domain there aren't any\n");
-            return(1);
+static void
+DVDJsonString (FILE *file, const char *string)
+{
+    fputc('"', file);
+    for ( ; *string != '\0'; string++ ) {
+        if ( *string == '"' || *string == '\\' ) {
+            fprintf(file, "\\%c", *string);
+        } else if ( (unsigned char)*string < 0x20 ) {
+            fprintf(file, "\\u%04x", *string);
         } else {
-            sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",
-                    targetdir, title_name, title_set, vob);
+            fputc(*string, file);
         }
+    }
+    fputc('"', file);
+}
 
-#ifdef DEBUG
-        fprintf(stderr,"DVDWriteCells: 1\n");
-#endif
+static void
+DVDJsonLatency (FILE *file, const char *name, latency_stat_t *latency)
+{
+    /* Loop variable */
+    int i;
 
-        if ((buffer = (unsigned char *)malloc(buff * 2048 * sizeof(unsigned char))) == NULL) {
-            fprintf(stderr, "Out of memory coping %s\n", targetname);
-            return(1);
+    fprintf(file, "  \"%s\": {\"count\": %lu, \"seconds\": %.6f, \"buckets\": [",
+            name, latency->count, latency->seconds);
+    for ( i = 0; i < LATENCY_BUCKETS; i++ ) {
+        if ( i < LATENCY_BUCKETS - 1 ) {
+            fprintf(file, "%s{\"below_us\": %lu, \"count\": %lu}",
+                    i > 0 ? ", " : "", 1UL << i, latency->bucket[i]);
+        } else {
+            fprintf(file, ", {\"below_us\": null, \"count\": %lu}", latency->bucket[i]);
         }
+    }
+    fprintf(file, "]},\n");
+}
 
-#ifdef DEBUG
-        fprintf(stderr,"DVDWriteCells: 2\n");
-#endif
+/* Stop the progress lines and write the JSON report */
+static void
+DVDStatsStop (void)
+{
+    /* Loop variable */
+    int i;
 
-        if ((streamout = open(targetname, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1) {
-            fprintf(stderr, "Error creating %s\n", targetname);
-            perror("");
-            return(1);
-        }
+    FILE        *file;
+    file_stat_t *stat;
+    double       seconds;
 
-#ifdef DEBUG
-        fprintf(stderr,"DVDWriteCells: 3\n");
-#endif
+    if ( progress_interval > 0 ) {
+        pthread_mutex_lock(&stats.lock);
+        stats.stopping = 1;
+        pthread_cond_signal(&stats.stop);
+        pthread_mutex_unlock(&stats.lock);
+        pthread_join(stats.progress, NULL);
+    }
 
-        if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
-            fprintf(stderr, "Failed opending TITLE VOB\n");
-            free(buffer);
-            close(streamout);
-            return(1);
-        }
+    if ( stats_file == NULL ) {
+        return;
+    }
+    if ( strcmp(stats_file, "-") == 0 ) {
+        file = stderr;
+    } else if ((file = fopen(stats_file, "w")) == NULL) {
+        fprintf(stderr, "Can't write the report %s\n", stats_file);
+        return;
+    }
 
-        left = size;
+    fprintf(file, "{\n  \"seconds\": %.6f,\n  \"bytes\": %lld,\n",
+            DVDClock() - stats.started, stats.bytes);
+    fprintf(file, "  \"write_calls\": %lu,\n  \"uring_submissions\": %lu,\n"
+            "  \"uring_completions\": %lu,\n  \"sectors_unreadable\": %lu,\n"
+            "  \"sectors_cloned\": %lu,\n",
+            write_calls, uring_submissions, uring_completions, sectors_unreadable,
+            sectors_cloned);
+
+    fprintf(file, "  \"phases\": [");
+    for ( i = 0; i < stats.phases; i++ ) {
+        fprintf(file, "%s\n    {\"name\": \"%s\", \"calls\": %ld, \"bytes\": %lld, "
+                "\"seconds\": %.6f}", i > 0 ? "," : "", stats.phase[i].name,
+                stats.phase[i].calls, stats.phase[i].bytes, stats.phase[i].seconds);
+    }
+    fprintf(file, "\n  ],\n");
+
+    DVDJsonLatency(file, "read_latency", &stats.read);
+    DVDJsonLatency(file, "write_latency", &stats.write);
+
+    fprintf(file, "  \"files\": [");
+    for ( i = 0; i < stats.files; i++ ) {
+        stat    = stats.file[i];
+        seconds = stat->last - stat->first;
+        fprintf(file, "%s\n    {\"name\": ", i > 0 ? "," : "");
+        DVDJsonString(file, stat->name);
+        fprintf(file, ", \"bytes\": %lld, \"seconds\": %.6f, \"mb_per_s\": %.3f}",
+                stat->bytes, seconds,
+                seconds > 0 ? stat->bytes / (1024.0 * 1024.0) / seconds : 0.0);
+        free(stat);
+    }
+    fprintf(file, "\n  ]\n}\n");
+    free(stats.file);
 
-#ifdef DEBUG
-        fprintf(stderr,"DVDWriteCells: left is %d\n", left);
-#endif
+    if ( file != stderr && fclose(file) != 0 ) {
+        fprintf(stderr, "Error writing the report %s\n", stats_file);
+    }
+}
 
-        while( left > 0 ) {
+/* Every thread that copies gets its own buffers */
+static __thread copy_pool_t *copy_pool = NULL;
 
-            if (buff > left) {
-                buff = left;
-            }
-            if ( DVDReadBlocks(dvd_file,soffset,buff, buffer) != buff) {
-                fprintf(stderr, "Error reading MENU VOB\n");
-                free(buffer);
-                DVDCloseFile(dvd_file);
-                close(streamout);
-                return(1);
-            }
+/* What the target holds is read back here for --incremental */
+static __thread unsigned char *compare_buffer = NULL;
 
-            if (write(streamout,buffer, buff * 2048) != buff * 2048) {
-                fprintf(stderr, "Error writing TITLE VOB\n");
-                free(buffer);
-                close(streamout);
-                return(1);
-            }
+/* The --image every file goes to, if any */
+static __thread image_t *current_image = NULL;
 
-            soffset = soffset + buff;
-            left = left - buff;
+/* The image or directory the calling thread backs up, NULL for a drive
+   or when its sectors can't be cloned */
+static __thread const char *current_source = NULL;
 
-        }
+/* Its --mmap mapping, if it is an image */
+static __thread source_map_t *current_map = NULL;
 
-        DVDCloseFile(dvd_file);
-        free(buffer);
-        close(streamout);
+static copy_pool_t *
+DVDGetCopyPool (void)
+{
+    /* Loop variable */
+    int i;
+
+#ifdef HAVE_LIBURING
+    struct iovec *iov;
+    int           none = -1;
+#endif
 
-        if ( leftover != 0 ) {
+    if (copy_pool != NULL) {
+        return(copy_pool);
+    }
 
-            vob = vob + 1;
+    if ((copy_pool = (copy_pool_t *)calloc(1, sizeof(copy_pool_t))) == NULL) {
+        return(NULL);
+    }
+    copy_pool->depth = ring_depth;
 
-            if (title_set == 0) {
-                fprintf(stderr,
-                        "Don't try to copy chapters from the VMG domain there aren't any\n");
-                return(1);
-            } else {
-                sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",
-                        targetdir, title_name, title_set, vob);
-            }
+    if ((copy_pool->slot = (ring_slot_t *)calloc(copy_pool->depth,
+                                                 sizeof(ring_slot_t))) == NULL) {
+        free(copy_pool);
+        copy_pool = NULL;
+        return(NULL);
+    }
 
-            if ((buffer = (unsigned char *)malloc(buff * 2048
-                                                  * sizeof(unsigned char))) == NULL) {
-                fprintf(stderr, "Out of memory coping %s\n", targetname);
-                close(streamout);
-                return(1);
-            }
+    /* Aligned for O_DIRECT and io_uring buffer registration, with room
+       to shift the data so it lines up with its place in the target */
+    for ( i = 0; i < copy_pool->depth; i++ ) {
+        if (posix_memalign((void **)&copy_pool->slot[i].buffer, DIRECT_IO_ALIGN,
+                           buf_blocks * 2048 + DIRECT_IO_ALIGN) != 0) {
+            copy_pool->slot[i].buffer = NULL;
+            DVDFreeCopyPool();
+            return(NULL);
+        }
+    }
 
-            if ((streamout = open(targetname, O_WRONLY | O_CREAT | O_APPEND, 0644)) == -1) {
-                fprintf(stderr, "Error creating %s\n", targetname);
-                perror("");
-                return(1);
+#ifdef HAVE_LIBURING
+    copy_pool->uring_fd = -1;
+    if ( use_uring && copy_pool->depth > 1 ) {
+        if (io_uring_queue_init(copy_pool->depth, &copy_pool->uring, 0) < 0) {
+            if ( verbose > 0 ) {
+                fprintf(stderr, "io_uring is not available, using write()\n");
             }
-
-            if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
-                fprintf(stderr, "Failed opending TITLE VOB\n");
-                free(buffer);
-                close(streamout);
-                return(1);
+        } else if ((iov = (struct iovec *)calloc(copy_pool->depth,
+                                                 sizeof(struct iovec))) == NULL) {
+            io_uring_queue_exit(&copy_pool->uring);
+        } else {
+            for ( i = 0; i < copy_pool->depth; i++ ) {
+                iov[i].iov_base = copy_pool->slot[i].buffer;
+                iov[i].iov_len  = buf_blocks * 2048 + DIRECT_IO_ALIGN;
             }
-
-            left = leftover;
-
-            while( left > 0 ) {
-
-                if (buff > left) {
-                    buff = left;
-                }
-                if ( DVDReadBlocks(dvd_file,offset,buff, buffer) != buff) {
-                    fprintf(stderr, "Error reading MENU VOB\n");
-                    free(buffer);
-                    DVDCloseFile(dvd_file);
-                    close(streamout);
-                    return(1);
-                }
-
-                if (write(streamout,buffer, buff * 2048) != buff * 2048) {
-                    fprintf(stderr, "Error writing TITLE VOB\n");
-                    free(buffer);
-                    close(streamout);
-                    return(1);
+            if (io_uring_register_buffers(&copy_pool->uring, iov, copy_pool->depth) < 0
+                || io_uring_register_files(&copy_pool->uring, &none, 1) < 0) {
+                if ( verbose > 0 ) {
+                    fprintf(stderr, "io_uring buffer registration failed, "
+                            "using write()\n");
                 }
-
-                offset = offset + buff;
-                left = left - buff;
-
+                io_uring_queue_exit(&copy_pool->uring);
+            } else {
+                copy_pool->uring_ready = 1;
             }
-
-            DVDCloseFile(dvd_file);
-            free(buffer);
-            close(streamout);
+            free(iov);
         }
-
     }
-    return(0);
+#endif
+
+    return(copy_pool);
 }
 
 void
-FreeSortArrays (int chapter_chapter_array[], int title_set_chapter_array[],
-                int angle_angle_array[], int title_set_angle_array[],
-                int subpicture_sub_array[], int title_set_sub_array[],
-                int audio_audio_array[], int title_set_audio_array[],
-                int size_size_array[], int title_set_size_array[],
-                int channels_channel_array[], int title_set_channel_array[])
+DVDFreeCopyPool (void)
 {
-    free(chapter_chapter_array);
-    free(title_set_chapter_array);
-
-    free(angle_angle_array);
-    free(title_set_angle_array);
+    /* Loop variable */
+    int i;
 
-    free(subpicture_sub_array);
-    free(title_set_sub_array);
+    free(compare_buffer);
+    compare_buffer = NULL;
 
-    free(audio_audio_array);
-    free(title_set_audio_array);
+    if (copy_pool == NULL) {
+        return;
+    }
 
-    free(size_size_array);
-    free(title_set_size_array);
+#ifdef HAVE_LIBURING
+    if (copy_pool->uring_ready) {
+        io_uring_queue_exit(&copy_pool->uring);
+    }
+#endif
 
-    free(channels_channel_array);
-    free(title_set_channel_array);
+    for ( i = 0; i < copy_pool->depth; i++ ) {
+        free(copy_pool->slot[i].buffer);
+    }
+    free(copy_pool->slot);
+    free(copy_pool);
+    copy_pool = NULL;
 }
 
-titles_info_t*
-DVDGetInfo (dvd_reader_t *_dvd)
+/* The bad sector map is only kept if there is something in it */
+bad_map_t*
+DVDBadMapOpen (char *targetdir, char *title_name)
 {
-    /* title interation */
-    int counter, i, f;
+    bad_map_t *bad_map;
 
-    /* Our guess */
-    int candidate;
-    int multi = 0;
-    int dual  = 0;
-
-    int titles;
-    int title_sets;
+    if ((bad_map = (bad_map_t *)calloc(1, sizeof(bad_map_t))) == NULL) {
+        return(NULL);
+    }
+    sprintf(bad_map->path, "%s/%s/%s", targetdir, title_name, BAD_MAP_NAME);
 
-    /* Arrays for chapter, angle, subpicture, audio, size, aspect,
-       channels - file_set relationship */
+    if ((bad_map->file = fopen(bad_map->path, "w")) == NULL) {
+        fprintf(stderr, "Can't write the bad sector map %s\n", bad_map->path);
+        free(bad_map);
+        return(NULL);
+    }
+    fprintf(bad_map->file, "# file first_sector sectors, zero filled\n");
 
-    /* Size == number_of_titles */
-    int *chapter_chapter_array;
-    int *title_set_chapter_array;
+    pthread_mutex_init(&bad_map->lock, NULL);
+    return(bad_map);
+}
 
-    int *angle_angle_array;
-    int *title_set_angle_array;
+void
+DVDBadMapClose (bad_map_t *bad_map)
+{
+    if (bad_map == NULL) {
+        return;
+    }
+    if (fclose(bad_map->file) != 0) {
+        fprintf(stderr, "Error writing the bad sector map %s\n", bad_map->path);
+    }
+    if (bad_map->runs == 0) {
+        unlink(bad_map->path);
+    }
+    pthread_mutex_destroy(&bad_map->lock);
+    free(bad_map);
+}
 
-    /* Size == number_of_title_sets */
+static void DVDRescueBad(rescue_map_t *map, int start, int end);
 
-    int *subpicture_sub_array;
-    int *title_set_sub_array;
+/* Report a run of unreadable sectors and add it to the map, for
+   every target that gets a copy of them */
+static void
+DVDBadFlush (copy_ring_t *ring)
+{
+    /* Loop variable */
+    int e;
 
-    int *audio_audio_array;
-    int *title_set_audio_array;
+    copy_extent_t *extent;
+    char          *name;
+    int            start;
 
-    int *size_size_array;
-    int *title_set_size_array;
+    if ( ring->bad_extent < 0 ) {
+        return;
+    }
+    for ( e = ring->bad_extent; e != -1; e = ring->extent[e].next_copy ) {
+        extent = &ring->extent[e];
+        name   = strrchr(extent->targetname, '/');
+        name   = (name == NULL ? extent->targetname : name + 1);
+        start  = ring->bad_start + extent->target_offset
+                 - ring->extent[ring->bad_extent].target_offset;
+
+        fprintf(stderr, "%s: sectors %d to %d unreadable, zero filled\n",
+                name, start, start + ring->bad_end - ring->bad_start - 1);
+
+        if ( extent->rescue != NULL ) {
+            DVDRescueBad(extent->rescue, start, start + ring->bad_end - ring->bad_start);
+        }
 
-    int *channels_channel_array;
-    int *title_set_channel_array;
+        if ( ring->bad_map != NULL ) {
+            pthread_mutex_lock(&ring->bad_map->lock);
+            fprintf(ring->bad_map->file, "%s %d %d\n", name, start,
+                    ring->bad_end - ring->bad_start);
+            fflush(ring->bad_map->file);
+            ring->bad_map->runs++;
+            pthread_mutex_unlock(&ring->bad_map->lock);
+        }
+    }
+    ring->bad_extent = -1;
+}
 
-    /* Temp helpers */
-    int channels;
-    int found;
-    int chapters_1;
-    int chapters_2;
-    int found_chapter;
-    int number_of_multi;
+/* Unreadable sectors next to each other go in the map as one run.
+   They are zero filled, which keeps everything after them in place */
+static void
+DVDBadSectors (copy_ring_t *ring, int offset, int blocks, unsigned char *data)
+{
+    copy_extent_t *extent = &ring->extent[ring->next_extent];
+    int            sector = extent->target_offset + offset - extent->offset;
 
-    /*DVD handlers*/
-    ifo_handle_t  *vmg_ifo        = NULL;
-    dvd_file_t    *vts_title_file = NULL;
-    titles_info_t *titles_info    = NULL;
+    memset(data, 0, (size_t)blocks * 2048);
+    __sync_fetch_and_add(&sectors_unreadable, blocks);
 
-    /*  Open main info file */
-    vmg_ifo = ifoOpen( _dvd, 0 );
-    if( !vmg_ifo ) {
-        fprintf( stderr, "Can't open VMG info.\n" );
-        return (0);
+    if ( ring->bad_extent == ring->next_extent && ring->bad_end == sector ) {
+        ring->bad_end = ring->bad_end + blocks;
+        return;
     }
+    DVDBadFlush(ring);
+    ring->bad_extent = ring->next_extent;
+    ring->bad_start  = sector;
+    ring->bad_end    = sector + blocks;
+}
 
-    titles = vmg_ifo->tt_srpt->nr_of_srpts;
-    title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+/* Every read after the one that failed costs a retry, a failing read
+   can take a drive seconds */
+static int
+DVDTakeRetry (void)
+{
+    return(__sync_fetch_and_sub(&read_retries, 1) > 0);
+}
 
-    if ((vmg_ifo->tt_srpt == 0) || (vmg_ifo->vts_atrt == 0)) {
-        ifoClose(vmg_ifo);
-        return(0);
+/* Blocks that failed as a whole are read again in halves, down to
+   single sectors, so good areas still go at full speed and only the
+   damaged sectors are lost. Once the retries are spent whatever is
+   left of the block is lost in one run, without touching the drive */
+static void
+DVDReadRecover (copy_ring_t *ring, int offset, int blocks, unsigned char *data)
+{
+    int half;
+    int tries;
+
+    if ( blocks > 1 ) {
+        half = blocks / 2;
+        if ( !DVDTakeRetry() ) {
+            DVDBadSectors(ring, offset, blocks, data);
+            return;
+        }
+        if ( DVDReadBlocks(ring->dvd_file, offset, half, data) != half ) {
+            DVDReadRecover(ring, offset, half, data);
+        }
+        if ( !DVDTakeRetry() ) {
+            DVDBadSectors(ring, offset + half, blocks - half, data + half * 2048);
+            return;
+        }
+        if ( DVDReadBlocks(ring->dvd_file, offset + half, blocks - half,
+                           data + half * 2048) != blocks - half ) {
+            DVDReadRecover(ring, offset + half, blocks - half, data + half * 2048);
+        }
+        return;
     }
 
-    /* Todo fix malloc check */
-    titles_info = ( titles_info_t *)malloc(sizeof(titles_info_t));
-    titles_info->titles = (titles_t *)malloc((titles)* sizeof(titles_t));
+    for ( tries = 0; tries < SECTOR_RETRIES; tries++ ) {
+        if ( !DVDTakeRetry() ) {
+            break;
+        }
+        if ( DVDReadBlocks(ring->dvd_file, offset, 1, data) == 1 ) {
+            return;
+        }
+    }
 
-    titles_info->number_of_titles = titles;
+    DVDBadSectors(ring, offset, 1, data);
+}
 
-    chapter_chapter_array = malloc(titles * sizeof(int));
-    title_set_chapter_array = malloc(titles * sizeof(int));
+/* Every extent starts over with small reads, a drive may read menus
+   and films at very different speeds */
+static void
+DVDAdaptReset (copy_ring_t *ring)
+{
+    ring->read_blocks    = (ADAPT_START_BLOCKS < buf_blocks
+                            ? ADAPT_START_BLOCKS : buf_blocks);
+    ring->read_settled   = 0;
+    ring->read_rate      = 0;
+    ring->sample_reads   = 0;
+    ring->sample_blocks  = 0;
+    ring->sample_seconds = 0;
+}
 
-    /*currently not used in the guessing */
-    angle_angle_array = malloc(titles * sizeof(int));
-    title_set_angle_array = malloc(titles * sizeof(int));
+/* Grow the reads while bigger ones are faster, go back one step and
+   stay there once they aren't. A read that takes too long is halved
+   even then, so the writer isn't kept waiting */
+static void
+DVDAdaptReadSize (copy_ring_t *ring, int blocks, double seconds)
+{
+    copy_extent_t *extent = &ring->extent[ring->next_extent];
+    double         rate;
+    char          *name;
+
+    if ( seconds > ADAPT_MAX_LATENCY && ring->read_blocks > ADAPT_MIN_BLOCKS ) {
+        ring->read_blocks    = ring->read_blocks / 2;
+        ring->read_settled   = 1;
+        ring->sample_reads   = 0;
+        ring->sample_blocks  = 0;
+        ring->sample_seconds = 0;
+        if ( ring->read_blocks < ADAPT_MIN_BLOCKS ) {
+            ring->read_blocks = ADAPT_MIN_BLOCKS;
+        }
+        return;
+    }
 
-    subpicture_sub_array = malloc(title_sets * sizeof(int));
-    title_set_sub_array = malloc(title_sets * sizeof(int));
+    /* The short read at the end of an extent says nothing */
+    if ( ring->read_settled || blocks < ring->read_blocks ) {
+        return;
+    }
 
-    audio_audio_array = malloc(title_sets * sizeof(int));
-    title_set_audio_array = malloc(title_sets * sizeof(int));
+    ring->sample_reads++;
+    ring->sample_blocks  = ring->sample_blocks + blocks;
+    ring->sample_seconds = ring->sample_seconds + seconds;
+    if ( ring->sample_reads < ADAPT_SAMPLES ) {
+        return;
+    }
+    rate = ring->sample_blocks / (ring->sample_seconds > 0 ? ring->sample_seconds : 1e-9);
+    ring->sample_reads   = 0;
+    ring->sample_blocks  = 0;
+    ring->sample_seconds = 0;
+
+    if ( ring->read_rate == 0 || rate > ring->read_rate * (1 + ADAPT_GAIN) ) {
+        ring->read_rate = rate;
+        if ( ring->read_blocks * 2 <= buf_blocks ) {
+            ring->read_blocks = ring->read_blocks * 2;
+            return;
+        }
+    } else {
+        ring->read_blocks = ring->read_blocks / 2;
+    }
+    ring->read_settled = 1;
 
-    size_size_array = malloc(title_sets * sizeof(int));
-    title_set_size_array = malloc(title_sets * sizeof(int));
-
-    channels_channel_array = malloc(title_sets * sizeof(int));
-    title_set_channel_array = malloc(title_sets * sizeof(int));
-
-    /* Interate over the titles nr_of_srpts */
-
-    for (counter=0; counter < titles; counter++ )  {
-        /* For titles_info */
-        titles_info->titles[counter].title = counter + 1;
-        titles_info->titles[counter].title_set = vmg_ifo->tt_srpt->title[counter].title_set_nr;
-        titles_info->titles[counter].vts_title = vmg_ifo->tt_srpt->title[counter].vts_ttn;
-        titles_info->titles[counter].chapters = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
-        titles_info->titles[counter].angles = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
-
-        /* For main title*/
-        chapter_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
-        title_set_chapter_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
-        angle_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
-        title_set_angle_array[counter] = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+    if ( verbose > 0 ) {
+        name = strrchr(extent->targetname, '/');
+        name = (name == NULL ? extent->targetname : name + 1);
+        fprintf(stderr, "%s: reading %d sectors at a time, %.1f MB/s\n", name,
+                ring->read_blocks, ring->read_rate * 2048 / (1024 * 1024));
     }
+}
 
-    /* Interate over vmg_nr_of_title_sets */
-
-    for (counter=0; counter < title_sets ; counter++ )  {
+/* Open a VOB file of a directory source, under its VIDEO_TS or in it,
+   in upper or lower case like libdvdread takes it */
+static int
+DVDSourceOpenFile (const char *source, const char *name, int *size)
+{
+    /* Loop variables */
+    int i, j;
 
-        /* Picture*/
-        subpicture_sub_array[counter] =
-            vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
-        title_set_sub_array[counter] = counter + 1;
+    static const char *dirs[3] = { "/VIDEO_TS/", "/video_ts/", "/" };
+    char        lower[16];
+    char        path[PATH_MAX + 32];
+    struct stat fileinfo;
+    int         fd;
 
-        /* Audio */
-        audio_audio_array[counter] = vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
-        title_set_audio_array[counter] = counter + 1;
+    for ( i = 0; name[i] != '\0' && i < (int)sizeof(lower) - 1; i++ ) {
+        lower[i] = tolower((unsigned char)name[i]);
+    }
+    lower[i] = '\0';
 
-        channels=0;
-        for  (i=0; i < audio_audio_array[counter]; i++) {
-            if ( channels < vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1) {
-                channels = vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1;
+    for ( i = 0; i < 3; i++ ) {
+        for ( j = 0; j < 2; j++ ) {
+            snprintf(path, sizeof(path), "%s%s%s", source, dirs[i], j == 0 ? name : lower);
+            if ((fd = open(path, O_RDONLY)) == -1) {
+                continue;
             }
-
-        }
-        channels_channel_array[counter] = channels;
-        title_set_channel_array[counter] = counter + 1;
-
-        /* For tiles_info */
-        for (f=0; f < titles_info->number_of_titles ; f++ ) {
-            if ( titles_info->titles[f].title_set == counter + 1 ) {
-                titles_info->titles[f].aspect_ratio =
-                    vmg_ifo->vts_atrt->vts[counter].vtstt_vobs_video_attr.display_aspect_ratio;
-                titles_info->titles[f].sub_pictures =
-                    vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
-                titles_info->titles[f].audio_tracks =
-                    vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
-                titles_info->titles[f].audio_channels = channels;
+            if (fstat(fd, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)) {
+                close(fd);
+                continue;
             }
+            *size = fileinfo.st_size / DVD_VIDEO_LB_LEN;
+            return(fd);
         }
-
     }
+    return(-1);
+}
 
-    for (counter=0; counter < title_sets; counter++ ) {
-
-        vts_title_file = DVDOpenFile(_dvd, counter + 1, DVD_READ_TITLE_VOBS);
-
-        if (vts_title_file  != 0) {
-            size_size_array[counter] = DVDFileSize(vts_title_file);
-            DVDCloseFile(vts_title_file);
-        } else {
-            size_size_array[counter] = 0;
-        }
+static void
+DVDSourceClose (copy_ring_t *ring)
+{
+    /* Loop variable */
+    int i;
 
-        title_set_size_array[counter] = counter + 1;
+    for ( i = 0; i < ring->source_parts; i++ ) {
+        close(ring->source_fd[i]);
     }
+    ring->source_parts = 0;
+}
 
-    /* Sort all arrays max to min */
-
-    bsort_max_to_min(chapter_chapter_array, title_set_chapter_array, titles);
-    bsort_max_to_min(angle_angle_array, title_set_angle_array, titles);
-    bsort_max_to_min(subpicture_sub_array, title_set_sub_array, title_sets);
-    bsort_max_to_min(audio_audio_array, title_set_audio_array, title_sets);
-    bsort_max_to_min(size_size_array, title_set_size_array, title_sets);
-    bsort_max_to_min(channels_channel_array, title_set_channel_array, title_sets);
-
-    /* Check if the second biggest one actually can be a feature title
-       Here we will take do biggest/second and if that is bigger than
-       one it's not a feature title.
+/* Find the VOB files of the ring's domain in its source. An image holds
+   the title VOBs of a title set back to back, as libdvdread reads them */
+static void
+DVDSourceOpen (copy_ring_t *ring)
+{
+    /* Loop variable */
+    int i;
 
-       Now this is simply not enough since we have to check that the
-       diff between the two of them is small enough to consider the
-       second one a feature title we are doing two checks (biggest +
-       biggest - second) /second == 1 and biggest%second * 3 <
-       biggest */
+    char        name[16];
+    char        filename[MAXNAME];
+    struct stat fileinfo;
+    uint32_t    sector;
+    uint32_t    size;
+    int         first;
+    int         last;
+    int         fd;
+
+    DVDSourceClose(ring);
+    if ( ring->source == NULL || stat(ring->source, &fileinfo) != 0 ) {
+        return;
+    }
 
-    if (CheckSizeArray(size_size_array, 0, 1)) {
-        /* We have a dual DVD with two feature films - now lets see if
-           they have the same amount of chapters*/
+    if ( ring->title_set == 0 ) {
+        first = last = -1;
+    } else if ( ring->domain == DVD_READ_MENU_VOBS ) {
+        first = last = 0;
+    } else {
+        first = 1;
+        last  = 9;
+    }
 
-        chapters_1 = 0;
-        for (i=0 ; i < titles ; i++ ) {
-            if (titles_info->titles[i].title_set == title_set_size_array[0] ) {
-                if ( chapters_1 < titles_info->titles[i].chapters){
-                    chapters_1 = titles_info->titles[i].chapters;
-                }
-            }
+    for ( i = first; i <= last; i++ ) {
+        if ( i == -1 ) {
+            strcpy(name, "VIDEO_TS.VOB");
+        } else {
+            snprintf(name, sizeof(name), "VTS_%02i_%i.VOB", ring->title_set, i);
         }
 
-        chapters_2 = 0;
-        for (i=0 ; i < titles ; i++ ) {
-            if (titles_info->titles[i].title_set == title_set_size_array[1] ) {
-                if ( chapters_2 < titles_info->titles[i].chapters){
-                    chapters_2 = titles_info->titles[i].chapters;
+        if ( S_ISREG(fileinfo.st_mode) ) {
+            sprintf(filename, "/VIDEO_TS/%s", name);
+            if ((sector = UDFFindFile(ring->dvd, filename, &size)) == 0) {
+                break;
+            }
+            if ( ring->source_parts == 0 ) {
+                if ((fd = open(ring->source, O_RDONLY)) == -1) {
+                    break;
                 }
+                ring->source_fd[0]    = fd;
+                ring->source_start[0] = (off_t)sector * DVD_VIDEO_LB_LEN;
+                ring->source_size[0]  = 0;
+                ring->source_parts    = 1;
             }
-        }
-
-        if (  vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio ==
-              vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio) {
-            /* In this case it's most likely so that we have a dual
-               film but with different context.  They are with in the
-               same size range and have the same aspect ratio I would
-               guess that such a case is e.g. a DVD containing several
-               episodes of a TV series */
-            candidate = title_set_size_array[0];
-            multi = 1;
-        } else if ( chapters_1 == chapters_2  && vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio !=
-                    vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio){
-            /* In this case we have (guess only) the same context -
-               they have the same number of chapters but different
-               aspect ratio and are in the same size range*/
-            if ( vmg_ifo->vts_atrt->vts[title_set_size_array[0] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
-                candidate = title_set_size_array[0];
-            } else if ( vmg_ifo->vts_atrt->vts[title_set_size_array[1] - 1].vtstt_vobs_video_attr.display_aspect_ratio == aspect) {
-                candidate = title_set_size_array[1];
-            } else {
-                /* Okay we didn't have the prefered aspect ratio -
-                   just make the biggest one a candidate */
-                /* please send  report if this happens*/
-                fprintf(stderr, "You have encountered a very special DVD, "
-                        "please send a bug report along with all IFO files from this title\n");
-                candidate = title_set_size_array[0];
+            ring->source_size[0] = ring->source_size[0] + size / DVD_VIDEO_LB_LEN;
+        } else {
+            if ((fd = DVDSourceOpenFile(ring->source, name,
+                                        &ring->source_size[ring->source_parts])) == -1) {
+                break;
             }
-            dual = 1;
+            ring->source_fd[ring->source_parts]    = fd;
+            ring->source_start[ring->source_parts] = 0;
+            ring->source_parts++;
         }
-    } else {
-        candidate = title_set_size_array[0];
     }
+}
 
-    /* Lets start checking audio,sub pictures and channels my guess is
-       namly that a special suburb will put titles with a lot of
-       chapters just to make our backup hard */
+/* CSS scrambled packs have the PES scrambling control bits set, as
+   libdvdcss checks them */
+static int
+DVDSectorScrambled (const unsigned char *sector)
+{
+    if ( sector[14] != 0 || sector[15] != 0 || sector[16] != 1 ) {
+        return(0);
+    }
+    if ( sector[17] != 0xe0 && sector[17] != 0xbd
+         && (sector[17] < 0xc0 || sector[17] > 0xdf) ) {
+        return(0);
+    }
+    return((sector[20] & 0x30) != 0);
+}
 
-    found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-                                  subpicture_sub_array, title_set_sub_array,
-                                  channels_channel_array, title_set_channel_array,
-                                  0 , candidate, title_sets);
+/* The part of the source that holds a sector of the domain, and in
+   *start the first sector of that part. -1 if none does */
+static int
+DVDSourcePart (copy_ring_t *ring, int sector, int *start)
+{
+    /* Loop variable */
+    int i;
 
-    /* Now lets see if we can find our candidate among the top most chapters */
-    found_chapter=6;
-    for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
-        if ( candidate == title_set_chapter_array[i] ) {
-            found_chapter=i+1;
-            break;
+    *start = 0;
+    for ( i = 0; i < ring->source_parts; i++ ) {
+        if ( sector < *start + ring->source_size[i] ) {
+            return(i);
         }
+        *start = *start + ring->source_size[i];
     }
+    return(-1);
+}
 
-    /* Close the VMG ifo file we got all the info we need */
-    ifoClose(vmg_ifo);
+/* Read sectors first to first + count - 1 of the domain from the
+   source. Returns 1 if they aren't all in one part or can't be read */
+static int
+DVDSourceRead (copy_ring_t *ring, int first, int count, unsigned char *buffer)
+{
+    off_t   from;
+    size_t  length = (size_t)count * DVD_VIDEO_LB_LEN;
+    ssize_t got;
+    int     start;
+    int     part;
+
+    if ((part = DVDSourcePart(ring, first, &start)) == -1
+        || first + count > start + ring->source_size[part] ) {
+        return(1);
+    }
+    from = ring->source_start[part] + (off_t)(first - start) * DVD_VIDEO_LB_LEN;
 
-    if (((found == 3) && (found_chapter == 1) && (dual == 0) && (multi == 0))
-        || ((found == 3) && (found_chapter < 3 ) && (dual == 1))) {
+    while ( length > 0 ) {
+        got = pread(ring->source_fd[part], buffer, length, from);
+        if ( got == -1 && errno == EINTR ) {
+            continue;
+        }
+        if ( got <= 0 ) {
+            return(1);
+        }
+        buffer = buffer + got;
+        from   = from + got;
+        length = length - got;
+    }
+    return(0);
+}
 
-        FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-                        angle_angle_array, title_set_angle_array,
-                        subpicture_sub_array, title_set_sub_array,
-                        audio_audio_array, title_set_audio_array,
-                        size_size_array, title_set_size_array,
-                        channels_channel_array, title_set_channel_array);
-        titles_info->main_title_set = candidate;
-        return(titles_info);
+/* The sectors of the VOBU a NAV pack starts, from the vobu_ea of its
+   DSI. 0 if the sector isn't a NAV pack */
+static int
+DVDNavVobu (const unsigned char *sector)
+{
+    uint32_t last;
 
+    if ( sector[0] != 0x00 || sector[1] != 0x00 || sector[2] != 0x01
+         || sector[3] != 0xba ) {
+        return(0);
     }
+    if ( sector[1024] != 0x00 || sector[1025] != 0x00 || sector[1026] != 0x01
+         || sector[1027] != 0xbf || sector[1030] != 0x01 ) {
+        return(0);
+    }
+    last = ((uint32_t)sector[1039] << 24) | ((uint32_t)sector[1040] << 16)
+           | ((uint32_t)sector[1041] << 8) | sector[1042];
+    if ( last == 0 || last >= CLONE_MAX_VOBU ) {
+        return(0);
+    }
+    return(last + 1);
+}
 
-    if (multi == 1) {
-        for (i=0 ; i < title_sets ; ++i) {
-            if (!CheckSizeArray(size_size_array, 0, i + 1)) {
-                break;
-            }
+#ifdef __linux__
+/* Copy length bytes of a source file to a target in the kernel.
+   Returns 1 if they didn't all go over */
+static int
+DVDCopyRange (copy_ring_t *ring, int in, off_t from, int out, off_t to,
+              size_t length)
+{
+    ssize_t copied;
+
+    while ( length > 0 ) {
+        copied = copy_file_range(in, &from, out, &to, length, 0);
+        if ( copied == -1 && errno == EINTR ) {
+            continue;
         }
-        number_of_multi = i;
-        for (i = 0; i < number_of_multi; i++ ) {
-            if (title_set_chapter_array[0] == i + 1) {
-                candidate = title_set_chapter_array[0];
+        if ( copied <= 0 ) {
+            /* Not between these filesystems, read from now on */
+            if ( copied == 0 || errno == EXDEV || errno == EINVAL
+                 || errno == ENOSYS || errno == EOPNOTSUPP ) {
+                ring->clone = 0;
             }
+            return(1);
         }
+        length = length - copied;
+    }
+    return(0);
+}
+#endif
 
-        found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-                                      subpicture_sub_array, title_set_sub_array,
-                                      channels_channel_array, title_set_channel_array,
-                                      0 , candidate, title_sets);
-
-        if (found == 3) {
-            FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-                            angle_angle_array, title_set_angle_array,
-                            subpicture_sub_array, title_set_sub_array,
-                            audio_audio_array, title_set_audio_array,
-                            size_size_array, title_set_size_array,
-                            channels_channel_array, title_set_channel_array);
-            titles_info->main_title_set = candidate;
-            return(titles_info);
+/* Copy length bytes of a source file to a target. The whole blocks go
+   as a single reflink where the filesystem shares them, the rest with
+   copy_file_range(). Returns 1 if they didn't all go over */
+static int
+DVDCloneRange (copy_ring_t *ring, int in, off_t from, int out, off_t to,
+               size_t length)
+{
+#ifdef __linux__
+    struct file_clone_range clone;
+    size_t                  head;
+    size_t                  blocks;
+
+    head = (CLONE_BLOCK_LEN - to % CLONE_BLOCK_LEN) % CLONE_BLOCK_LEN;
+    if ( head > length ) {
+        head = length;
+    }
+    blocks = (length - head) / CLONE_BLOCK_LEN * CLONE_BLOCK_LEN;
+
+    if ( ring->reflink && blocks > 0
+         && (from + (off_t)head) % CLONE_BLOCK_LEN == 0 ) {
+        clone.src_fd      = in;
+        clone.src_offset  = from + head;
+        clone.src_length  = blocks;
+        clone.dest_offset = to + head;
+        if ( ioctl(out, FICLONERANGE, &clone) == 0 ) {
+            return(DVDCopyRange(ring, in, from, out, to, head)
+                   || DVDCopyRange(ring, in, from + head + blocks, out,
+                                   to + head + blocks, length - head - blocks));
+        }
+        /* No reflinks here, copy_file_range() may still share blocks */
+        if ( errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP
+             || errno == ENOTTY ) {
+            ring->reflink = 0;
         }
     }
+    return(DVDCopyRange(ring, in, from, out, to, length));
+#else
+    /* Only Linux copies between files in the kernel */
+    (void)in;
+    (void)from;
+    (void)out;
+    (void)to;
+    (void)length;
+    ring->clone = 0;
+    return(1);
+#endif
+}
 
-    /* We have now come to that state that we more or less have given
-       up :( giving you a good guess of the main feature film No
-       matter what we will more or less only return the biggest VOB
-       Lets see if we can find our biggest one - then we return that
-       one */
-    candidate = title_set_size_array[0];
-
-    found = CheckAudioSubChannels(audio_audio_array, title_set_audio_array,
-                                  subpicture_sub_array, title_set_sub_array,
-                                  channels_channel_array, title_set_channel_array,
-                                  0 , candidate, title_sets);
+/* Clone sectors first to end - 1 of the domain, all clear, to the
+   extent's target and note them as done. Returns 1 if some didn't go
+   over, the ring reads those */
+static int
+DVDCloneRun (copy_ring_t *ring, copy_extent_t *extent, int first, int end)
+{
+    sector_range_t *cloned;
+    off_t           from;
+    off_t           to;
+    int             start;
+    int             part;
+    int             count;
+
+    while ( first < end && ring->clone ) {
+        if ((part = DVDSourcePart(ring, first, &start)) == -1) {
+            return(1);
+        }
+        count = start + ring->source_size[part] - first;
+        if ( count > end - first ) {
+            count = end - first;
+        }
+        from = ring->source_start[part] + (off_t)(first - start) * DVD_VIDEO_LB_LEN;
+        to   = extent->image_offset
+               + ((off_t)extent->target_offset + first - extent->offset) * DVD_VIDEO_LB_LEN;
 
-    /* Now lets see if we can find our candidate among the top most chapters */
+        if ( DVDCloneRange(ring, ring->source_fd[part], from,
+                           extent->direct ? extent->buffered : extent->streamout,
+                           to, (size_t)count * DVD_VIDEO_LB_LEN) != 0 ) {
+            return(1);
+        }
+        if ((cloned = (sector_range_t *)realloc(ring->cloned, (ring->clones + 1)
+                                                * sizeof(sector_range_t))) == NULL) {
+            return(1);
+        }
+        ring->cloned = cloned;
+        ring->cloned[ring->clones].start = first;
+        ring->cloned[ring->clones].end   = first + count;
+        ring->clones++;
+        __sync_fetch_and_add(&sectors_cloned, count);
+        first = first + count;
+    }
+    return(0);
+}
 
-    found_chapter=5;
-    for (i=0 ; (i < titles) && (i < 4) ; i++ ) {
-        if ( candidate == title_set_chapter_array[i] ) {
-            found_chapter=i+1;
-            break;
+/* Clone what of an extent isn't scrambled, in as few runs as there are
+   scrambled VOBUs. CSS scrambles a VOBU as a whole, so one is judged by
+   the packs right after its NAV pack and the rest of it isn't read.
+   Sectors outside a VOBU are read and checked each. Scrambled and
+   unreadable sectors are left to libdvdread */
+static void
+DVDCloneExtent (copy_ring_t *ring, copy_extent_t *extent)
+{
+    /* Loop variables */
+    int i, j;
+
+    unsigned char buffer[CLONE_SCAN_BLOCKS * DVD_VIDEO_LB_LEN];
+    int           end  = extent->offset + extent->size;
+    int           pos  = extent->offset;
+    int           run  = pos;
+    int           next;
+    int           nav  = 1;
+    int           count;
+    int           start;
+    int           part;
+    int           vobu;
+    int           scrambled;
+
+    while ( pos < end && ring->clone ) {
+        /* At a VOBU only its NAV pack and the packs judged are read */
+        count = (nav ? 1 + CLONE_VOBU_CHECK : CLONE_SCAN_BLOCKS);
+        if ( count > end - pos ) {
+            count = end - pos;
+        }
+        if ((part = DVDSourcePart(ring, pos, &start)) != -1
+            && count > start + ring->source_size[part] - pos ) {
+            count = start + ring->source_size[part] - pos;
+        }
+        if ( part == -1 || DVDSourceRead(ring, pos, count, buffer) != 0 ) {
+            DVDCloneRun(ring, extent, run, pos);
+            pos = pos + count;
+            run = pos;
+            nav = 1;
+            continue;
         }
 
+        next = pos + count;
+        nav  = 0;
+        for ( i = 0; i < count; i++ ) {
+            vobu = DVDNavVobu(buffer + i * DVD_VIDEO_LB_LEN);
+            if ( vobu > 0 && i + CLONE_VOBU_CHECK < count ) {
+                scrambled = 0;
+                for ( j = i + 1; j <= i + CLONE_VOBU_CHECK; j++ ) {
+                    scrambled |= DVDSectorScrambled(buffer + j * DVD_VIDEO_LB_LEN);
+                }
+                if ( scrambled ) {
+                    DVDCloneRun(ring, extent, run, pos + i);
+                    run = pos + i + vobu;
+                }
+                next = pos + i + vobu;
+                nav  = 1;
+                break;
+            }
+            if ( vobu > 0 && i > 0 ) {
+                /* Read again from the NAV pack on */
+                next = pos + i;
+                nav  = 1;
+                break;
+            }
+            if ( DVDSectorScrambled(buffer + i * DVD_VIDEO_LB_LEN) ) {
+                DVDCloneRun(ring, extent, run, pos + i);
+                run = pos + i + 1;
+            }
+        }
+        pos = next;
     }
-
-    /* Here we take chapters in to consideration*/
-    if (found == 3) {
-        FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-                        angle_angle_array, title_set_angle_array,
-                        subpicture_sub_array, title_set_sub_array,
-                        audio_audio_array, title_set_audio_array,
-                        size_size_array, title_set_size_array,
-                        channels_channel_array, title_set_channel_array);
-        titles_info->main_title_set = candidate;
-        return(titles_info);
+    if ( run < end ) {
+        DVDCloneRun(ring, extent, run, end);
     }
-
-    /* Here we do but we lower the treshold for audio, sub and channels */
-
-    if ((found > 1 ) && (found_chapter <= 4)) {
-        FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-                        angle_angle_array, title_set_angle_array,
-                        subpicture_sub_array, title_set_sub_array,
-                        audio_audio_array, title_set_audio_array,
-                        size_size_array, title_set_size_array,
-                        channels_channel_array, title_set_channel_array);
-        titles_info->main_title_set = candidate;
-        return(titles_info);
-
-        /* return it */
-    } else {
-        /* Here we give up and just return the biggest one :(*/
-        /* Just return the biggest badest one*/
-        FreeSortArrays( chapter_chapter_array, title_set_chapter_array,
-                        angle_angle_array, title_set_angle_array,
-                        subpicture_sub_array, title_set_sub_array,
-                        audio_audio_array, title_set_audio_array,
-                        size_size_array, title_set_size_array,
-                        channels_channel_array, title_set_channel_array);
-        titles_info->main_title_set = candidate;
-        return(titles_info);
-    }
-
-    /* Some radom thoughts about DVD guessing */
-    /* We will now gather as much data about the DVD-Video as we can and
-       then make a educated guess which one is the main feature film of it*/
-
-    /* Make a tripple array with chapters, angles and title sets
-       - sort out dual title sets with a low number of chapters. Tradtionaly
-       the title set with most chapters is the main film. Number of angles is
-       keept as a reference point of low value*/
-
-    /* Make a dual array with number of audio streams, sub picture streams
-       and title sets. Tradtionaly the main film has many audio streams
-       since it's supposed be synconised e.g. a English film syncronised/dubbed
-       in German. We are also keeping track of sub titles since it's also indication
-       of the main film*/
-
-    /* Which title set is the biggest one - dual array with title sets and size
-       The biggest one is usally the main film*/
-
-    /* Which title set is belonging to title 1 and how many chapters has it. Once
-       again tradtionaly title one is belonging to the main film*/
-
-    /* Yes a lot of rant - but it helps me think - some sketch on
-       paper or in the mind I sketch in the comments - beside it will
-       help you understand the code*/
-
-    /* Okay lets see if the biggest one has most chapters, it also has
-       more subtitles and audio tracks than the second one and its
-       title one.  Done it must be the main film
-
-       Hmm the biggest one doesn't have the most chapters?
-
-       See if the second one has the same amount of chapters and is
-       the biggest one If so we probably have a 4:3 and 16:9 versions
-       of film on the same disk
-
-       Now we fetch the 16:9 by default unless the forced to do 4:3
-       First check which one is which.  If the 16:9 is the biggest one
-       and has the same or more subtile, audio streams then we are
-       happy unless we are in force 4:3 mode :( The same goes in
-       reverse if we are in force 4:3 mode
-
-       Hmm, in force 4:3 mode - now we check how much smaller than the
-       biggest one it is (or the reverse if we are in 16:9 mode)
-
-       Generally a reverse division should render in 1 and with a
-       small modulo - like wise a normal modulo should give us a high
-       modulo
-
-       If we get more than one its of cource a fake however if we get
-       just one we still need to check if we subtract the smaller one
-       from the bigger one we should end up with a small number -
-       hence we need to multiply it more than 4 times to get it bigger
-       than the biggest one. Now we know that the two biggest once are
-       really big and possibly carry the same film in differnet
-       formats.
-
-       We will now return the prefered one either 16:9 or 4:3 but we
-       will first check that the one we return at lest has two or more
-       audio tracks. We don't want it if the other one has a lot more
-       sound (we may end up with a film that only has 2ch Dolby
-       Digital so we want to check for 6ch DTS or Dolby Digital. If
-       the prefered one doesn't have those features but the other once
-       has we will return the other one.
-    */
 }
 
-int
-DVDCopyTileVobX (dvd_reader_t *dvd,
-                 title_set_info_t *title_set_info,
-                 int title_set, int vob,
-                 char *targetdir, char *title_name)
+/* Whether a chunk was cloned with the rest of its extent. The first
+   chunk of an extent clones all of it that can be. Returns 0 when the
+   chunk is done, 1 when it has to be read through libdvdread, either
+   way with its blocks cut to one side of a run edge */
+static int
+DVDCloneChunk (copy_ring_t *ring, ring_slot_t *slot)
 {
     /* Loop variable */
     int i;
 
-    /* Temp filename,dirname */
-    char        targetname[PATH_MAX];
-    struct stat fileinfo;
-
-    /* Write buffer */
-
-    unsigned char *buffer = NULL;
-    unsigned char  buffy;       /* :-) */
-
-    /* File Handler */
-    int streamout;
+    copy_extent_t *extent = &ring->extent[slot->extent];
 
-    int size;
-    int left;
+    if ( extent->stream || extent->next_copy != -1 ) {
+        return(1);
+    }
+    if ( slot->extent != ring->clone_extent ) {
+        ring->clone_extent = slot->extent;
+        ring->clones       = 0;
+        DVDCloneExtent(ring, extent);
+    }
 
-    /* Buffer size in DVD sectors */
-    int buff   = READ_BUF_SIZE_IN_BLOCKS;
-    int offset = 0;
-    int tsize;
+    /* A chunk is cut at the edges of the runs, so only sectors that
+       weren't cloned are read */
+    for ( i = 0; i < ring->clones; i++ ) {
+        if ( slot->offset >= ring->cloned[i].start
+             && slot->offset < ring->cloned[i].end ) {
+            if ( slot->blocks > ring->cloned[i].end - slot->offset ) {
+                slot->blocks = ring->cloned[i].end - slot->offset;
+            }
+            return(0);
+        }
+        if ( ring->cloned[i].start > slot->offset
+             && ring->cloned[i].start < slot->offset + slot->blocks ) {
+            slot->blocks = ring->cloned[i].start - slot->offset;
+        }
+    }
+    return(1);
+}
 
-    /* DVD handler */
-    dvd_file_t *dvd_file = NULL;
+/* Point a slot at its sectors in the --mmap mapping of an image. The
+   reader touches every sector as it checks it, so the page faults are
+   taken here and not by the writer. Returns 0 when the slot was set
+   up, 1 when the chunk has to be read through libdvdread */
+static int
+DVDMapChunk (copy_ring_t *ring, ring_slot_t *slot)
+{
+    /* Loop variable */
+    int i;
 
-    if (title_set_info->number_of_title_sets + 1 < title_set) {
-        fprintf(stderr,"Failed num title test\n");
+    copy_extent_t *extent = &ring->extent[slot->extent];
+    source_map_t  *map    = ring->map;
+    off_t          from;
+    off_t          start;
+    off_t          end;
+    size_t         length = (size_t)slot->blocks * DVD_VIDEO_LB_LEN;
+    long           page   = sysconf(_SC_PAGESIZE);
+
+    from = ring->source_start[0] + (off_t)slot->offset * DVD_VIDEO_LB_LEN;
+    if ( slot->offset + slot->blocks > ring->source_size[0]
+         || from + (off_t)length > map->size ) {
         return(1);
     }
 
-    if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
-        fprintf(stderr,"Failed vob test\n");
+    /* O_DIRECT needs the data lined up with its place in the target */
+    if ( extent->direct
+         && (from - extent->image_offset - slot->position) % DIRECT_IO_ALIGN != 0 ) {
         return(1);
     }
 
-    if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
-        fprintf(stderr,"Failed vob 1 size test\n");
-        return(0);
-    } else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
-        fprintf(stderr,"Failed vob %d test\n", vob);
-        return(0);
-    } else {
-        size = title_set_info->title_set[title_set].size_vob[vob - 1]/2048;
-        if (title_set_info->title_set[title_set].size_vob[vob - 1]%2048 != 0) {
-            fprintf(stderr, "The Title VOB number %d of title set %d "
-                    "doesn't have a valid DVD size\n", vob, title_set);
-            return(1);
-        }
+    /* The whole extent is read in order, and the chunk after this one
+       is read ahead while this one is written */
+    if ( slot->offset == extent->offset ) {
+        start = from / page * page;
+        end   = ring->source_start[0] + (off_t)(extent->offset + extent->size) * DVD_VIDEO_LB_LEN;
+        madvise(map->data + start, end - start, MADV_SEQUENTIAL);
     }
-#ifdef DEBUG
-    fprintf(stderr,"After we check the vob it self %d\n", vob);
-#endif
-
-    /* Create VTS_XX_X.VOB */
-    if (title_set == 0) {
-        fprintf(stderr,"Don't try to copy a Title VOB from "
-                "the VMG domain there aren't any\n");
-        return(1);
-    } else {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",
-                targetdir, title_name, title_set, vob);
+    start = (from + length) / page * page;
+    end   = from + 2 * (off_t)length;
+    if ( end > map->size ) {
+        end = map->size;
     }
-
-    /* Now figure out the offset we will start at also check that the
-       previus files are of valid DVD size */
-    for ( i = 0; i < vob - 1; i++ ) {
-        tsize = title_set_info->title_set[title_set].size_vob[i];
-        if (tsize%2048 != 0) {
-            fprintf(stderr, "The Title VOB number %d of title set %d "
-                    "doesn't have a valid DVD size\n", i + 1, title_set);
-            return(1);
-        } else {
-            offset = offset + tsize/2048;
-        }
+    if ( end > start ) {
+        madvise(map->data + start, end - start, MADV_WILLNEED);
     }
-#ifdef DEBUG
-    fprintf(stderr,"The offset for vob %d is %d\n", vob, offset);
-#endif
 
-    if (stat(targetname, &fileinfo) == 0) {
-        fprintf(stderr, "The Title file %s exists will try to over write it.\n",
-                targetname);
-        if (! S_ISREG(fileinfo.st_mode)) {
-            fprintf(stderr,"The Title %s file is not valid, it may be a directory\n",
-                    targetname);
-            return(1);
-        } else {
-            if ((streamout = open(targetname, O_WRONLY | O_TRUNC, 0644)) == -1) {
-                fprintf(stderr, "Error opening %s\n", targetname);
-                perror("");
-                return(1);
-            }
-        }
-    } else {
-        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
-            fprintf(stderr, "Error creating %s\n", targetname);
-            perror("");
+    for ( i = 0; i < slot->blocks; i++ ) {
+        if ( DVDSectorScrambled(map->data + from + (off_t)i * DVD_VIDEO_LB_LEN) ) {
             return(1);
         }
     }
 
-    left = size;
+    slot->data = map->data + from;
+    return(0);
+}
 
-    if ((buffer = (unsigned char *)malloc(buff * 2048 * sizeof(buffy))) == NULL) {
-        fprintf(stderr, "Out of memory coping %s\n", targetname);
-        close(streamout);
-        return(1);
+/* Read the next chunk of the extent list into a slot. Only the reader
+   side calls this. Returns 1 when the slot was filled, 0 at the end of
+   the list and -1 on errors */
+static int
+DVDReadChunk (copy_ring_t *ring, ring_slot_t *slot)
+{
+    copy_extent_t *extent;
+    int            buff;
+    int            filled;
+    double         started;
+
+    /* Copies are written along with the extent that reads them */
+    while ( ring->next_extent < ring->extents
+            && (ring->next_offset == ring->extent[ring->next_extent].size
+                || ring->extent[ring->next_extent].copy) ) {
+        ring->next_extent++;
+        ring->next_offset = 0;
     }
-
-    if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_TITLE_VOBS))== 0) {
-        fprintf(stderr, "Failed opending TITLE VOB\n");
-        free(buffer);
-        close(streamout);
-        return(1);
+    if ( adaptive && ring->next_offset == 0 ) {
+        DVDAdaptReset(ring);
+    }
+    if ( ring->next_extent == ring->extents ) {
+        return(0);
     }
 
-    while( left > 0 ) {
+    extent = &ring->extent[ring->next_extent];
 
-        if (buff > left) {
-            buff = left;
+    /* Extents of the same domain share one dvd_file_t */
+    if ( ring->dvd_file == NULL || ring->title_set != extent->title_set
+         || ring->domain != extent->domain ) {
+        if ( ring->dvd_file != NULL ) {
+            DVDCloseFile(ring->dvd_file);
         }
-        if ( DVDReadBlocks(dvd_file,offset,buff, buffer) != buff) {
-            fprintf(stderr, "Error reading MENU VOB\n");
-            free(buffer);
-            DVDCloseFile(dvd_file);
-            close(streamout);
-            return(1);
+        ring->title_set = extent->title_set;
+        ring->domain    = extent->domain;
+        if ((ring->dvd_file = DVDOpenFile(ring->dvd, extent->title_set,
+                                          extent->domain)) == 0) {
+            fprintf(stderr, "Failed opending %s VOB\n",
+                    extent->domain == DVD_READ_MENU_VOBS ? "MENU" : "TITLE");
+            return(-1);
         }
+        DVDSourceOpen(ring);
+    }
+
+    buff = (adaptive ? ring->read_blocks : buf_blocks);
+    if (buff > extent->size - ring->next_offset) {
+        buff = extent->size - ring->next_offset;
+    }
 
-        if (write(streamout,buffer,buff * 2048) != buff * 2048) {
-            fprintf(stderr, "Error writing TITLE VOB\n");
-            free(buffer);
-            close(streamout);
+    slot->extent   = ring->next_extent;
+    slot->offset   = extent->offset + ring->next_offset;
+    slot->blocks   = buff;
+    slot->position = ((off_t)extent->target_offset + ring->next_offset) * 2048;
+    slot->data     = slot->buffer
+                     + (extent->image_offset + slot->position) % DIRECT_IO_ALIGN;
+    slot->failed   = 0;
+    slot->cloned   = 0;
+    slot->mapped   = 0;
+
+    if ( ring->clone && ring->source_parts > 0 ) {
+        if ( DVDCloneChunk(ring, slot) == 0 ) {
+            slot->cloned      = 1;
+            ring->next_offset = ring->next_offset + slot->blocks;
             return(1);
         }
+        buff = slot->blocks;
+    }
+    if ( ring->map != NULL && ring->source_parts == 1 && DVDMapChunk(ring, slot) == 0 ) {
+        slot->mapped      = 1;
+        ring->next_offset = ring->next_offset + buff;
+        return(1);
+    }
 
-        offset = offset + buff;
-        left = left - buff;
-
+    started = DVDClock();
+    filled  = DVDReadBlocks(ring->dvd_file, slot->offset, buff, slot->data);
+    if ( DVDStatsOn() ) {
+        DVDLatency(&stats.read, DVDClock() - started);
+    }
+    if ( filled != buff ) {
+        if ( !recover ) {
+            fprintf(stderr, "Error reading sectors %d to %d for %s\n",
+                    slot->offset, slot->offset + buff - 1, extent->targetname);
+            return(-1);
+        }
+        DVDReadRecover(ring, slot->offset, buff, slot->data);
+    } else if ( adaptive ) {
+        DVDAdaptReadSize(ring, buff, DVDClock() - started);
     }
 
-    DVDCloseFile(dvd_file);
-    free(buffer);
-    close(streamout);
-    return(0);
+    ring->next_offset = ring->next_offset + buff;
+    return(1);
 }
 
-int
-DVDCopyMenu (dvd_reader_t *dvd,
-             title_set_info_t *title_set_info,
-             int title_set,
-             char *targetdir, char *title_name)
+static void *
+DVDRingReader (void *arg)
 {
+    copy_ring_t *ring = (copy_ring_t *)arg;
+    ring_slot_t *slot;
+    int          filled;
 
-    /* Temp filename,dirname */
-    char        targetname[PATH_MAX];
-    struct stat fileinfo;
+    pthread_mutex_lock(&ring->lock);
 
-    /* Write buffer */
+    while ( !ring->error ) {
 
-    unsigned char *buffer = NULL;
-    unsigned char  buffy;       /* :-) */
+        /* Wait for the writer to hand back a buffer */
+        while ( ring->count == ring->depth && !ring->error ) {
+            pthread_cond_wait(&ring->emptied, &ring->lock);
+        }
+        if ( ring->error ) {
+            break;
+        }
 
-    /* File Handler */
-    int streamout;
+        slot = &ring->slot[ring->head];
 
-    int size;
-    int left;
+        /* The writer never touches a slot before it is counted as
+           filled, so the lock can be dropped while the drive works */
+        pthread_mutex_unlock(&ring->lock);
+        filled = DVDReadChunk(ring, slot);
+        pthread_mutex_lock(&ring->lock);
 
-    /* Buffer size in DVD sectors */
-    int buff   = READ_BUF_SIZE_IN_BLOCKS;
-    int offset = 0;
+        if ( filled != 1 ) {
+            if ( filled == -1 ) {
+                ring->error = 1;
+            }
+            break;
+        }
 
-    /* DVD handler */
-    dvd_file_t *dvd_file = NULL;
+        ring->head = (ring->head + 1) % ring->depth;
+        ring->count++;
+        pthread_cond_signal(&ring->filled);
+    }
 
-    if (title_set_info->number_of_title_sets + 1 < title_set) {
-        return(1);
+    ring->done = 1;
+    pthread_cond_signal(&ring->filled);
+    pthread_mutex_unlock(&ring->lock);
+
+    return(NULL);
+}
+
+static int
+DVDDirectSplit (off_t position, int length, int *head, int *body)
+{
+    *head = (DIRECT_IO_ALIGN - position % DIRECT_IO_ALIGN) % DIRECT_IO_ALIGN;
+    if (*head > length) {
+        *head = length;
     }
+    *body = (length - *head) & ~(DIRECT_IO_ALIGN - 1);
 
-    if (title_set_info->title_set[title_set].size_menu == 0 ) {
+    return(length - *head - *body);
+}
+
+/* Unaligned pieces of an O_DIRECT target go through a second
+   descriptor that uses the page cache */
+static int
+DVDWriteBuffered (copy_extent_t *extent,
+                  unsigned char *data, int length, off_t position)
+{
+    if ( length == 0 ) {
         return(0);
-    } else {
-        size = title_set_info->title_set[title_set].size_menu/2048;
-        if (title_set_info->title_set[title_set].size_menu%2048 != 0) {
-            fprintf(stderr, "The Menu VOB of title set %d doesn't "
-                    "have a valid DVD size\n", title_set);
-            return(1);
-        }
     }
 
-    /* Create VIDEO_TS.VOB or VTS_XX_0.VOB */
-    if (title_set == 0) {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VIDEO_TS.VOB", targetdir, title_name);
-    } else {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_0.VOB",
-                targetdir, title_name, title_set);
+    COUNT(write_calls);
+    return(pwrite(extent->buffered, data, length, position) != length);
+}
+
+/* The manifest is written anew by every backup, each file is added
+   once it is complete */
+manifest_t*
+DVDManifestOpen (char *targetdir, char *title_name)
+{
+    manifest_t *manifest;
+
+    if ((manifest = (manifest_t *)calloc(1, sizeof(manifest_t))) == NULL) {
+        return(NULL);
     }
+    sprintf(manifest->path, "%s/%s/%s", targetdir, title_name, MANIFEST_NAME);
 
-    if (stat(targetname, &fileinfo) == 0) {
-        fprintf(stderr, "The Menu file %s exists will try to over write it.\n",
-                targetname);
-        if (! S_ISREG(fileinfo.st_mode)) {
-            fprintf(stderr,"The Menu %s file is not valid, it may be a directory\n",
-                    targetname);
-            return(1);
-        } else {
-            if ((streamout = open(targetname, O_WRONLY | O_TRUNC, 0644)) == -1) {
-                fprintf(stderr, "Error opening %s\n", targetname);
-                perror("");
-                return(1);
-            }
-        }
-    } else {
-        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
-            fprintf(stderr, "Error creating %s\n", targetname);
-            perror("");
-            return(1);
-        }
+    if ((manifest->file = fopen(manifest->path, "w")) == NULL) {
+        fprintf(stderr, "Can't write the manifest %s\n", manifest->path);
+        free(manifest);
+        return(NULL);
     }
+    fprintf(manifest->file, "# dvdbackup manifest %s %d\n",
+            ChecksumName(checksum), CHECKSUM_BLOCK_SIZE);
 
-    left = size;
+    pthread_mutex_init(&manifest->lock, NULL);
+    return(manifest);
+}
 
-    if ((buffer = (unsigned char *)malloc(buff * 2048 * sizeof(buffy))) == NULL) {
-        fprintf(stderr, "Out of memory coping %s\n", targetname);
-        close(streamout);
-        return(1);
+void
+DVDManifestClose (manifest_t *manifest)
+{
+    if (manifest == NULL) {
+        return;
+    }
+    if (fclose(manifest->file) != 0) {
+        fprintf(stderr, "Error writing the manifest %s\n", manifest->path);
     }
+    pthread_mutex_destroy(&manifest->lock);
+    free(manifest);
+}
 
-    if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_MENU_VOBS))== 0) {
-        fprintf(stderr, "Failed opending MENU VOB\n");
-        free(buffer);
-        close(streamout);
-        return(1);
+static file_sum_t*
+DVDSumOpen (manifest_t *manifest, char *targetname)
+{
+    file_sum_t *sum;
+
+    if ((sum = (file_sum_t *)calloc(1, sizeof(file_sum_t))) == NULL) {
+        return(NULL);
     }
+    sum->manifest   = manifest;
+    sum->targetname = targetname;
+    ChecksumInit(&sum->file, checksum);
+    ChecksumInit(&sum->block, checksum);
+    return(sum);
+}
 
-    while( left > 0 ) {
+static void
+DVDSumFree (file_sum_t *sum)
+{
+    if (sum == NULL) {
+        return;
+    }
+    free(sum->blocks);
+    free(sum);
+}
 
-        if (buff > left) {
-            buff = left;
-        }
-        if ( DVDReadBlocks(dvd_file,offset,buff, buffer) != buff) {
-            fprintf(stderr, "Error reading MENU VOB\n");
-            free(buffer);
-            DVDCloseFile(dvd_file);
-            close(streamout);
-            return(1);
-        }
+static int
+DVDSumBlock (file_sum_t *sum)
+{
+    uint64_t *blocks;
 
-        if (write(streamout,buffer,buff * 2048) != buff * 2048) {
-            fprintf(stderr, "Error writing MENU VOB\n");
-            free(buffer);
-            close(streamout);
+    if ( sum->number_of_blocks % 64 == 0 ) {
+        if ((blocks = (uint64_t *)realloc(sum->blocks, (sum->number_of_blocks + 64)
+                                          * sizeof(uint64_t))) == NULL) {
             return(1);
         }
-
-        offset = offset + buff;
-        left = left - buff;
-
+        sum->blocks = blocks;
     }
-
-    DVDCloseFile(dvd_file);
-    free(buffer);
-    close(streamout);
+    sum->blocks[sum->number_of_blocks++] = ChecksumFinal(&sum->block);
+    ChecksumInit(&sum->block, checksum);
     return(0);
 }
 
-int
-DVDCopyIfoBup (dvd_reader_t *dvd,
-               title_set_info_t *title_set_info,
-               int title_set,
-               char *targetdir, char *title_name)
+/* Feed the next bytes of the file, a block is closed every
+   CHECKSUM_BLOCK_SIZE bytes */
+static int
+DVDSumFeed (file_sum_t *sum, unsigned char *data, size_t length)
 {
-    /* Temp filename,dirname */
-    char        targetname[PATH_MAX];
-    struct stat fileinfo;
-
-    /* Write buffer */
+    size_t n;
 
-    unsigned char *buffer = NULL;
-    unsigned char  buffy;       /* :-) */
+    ChecksumUpdate(&sum->file, data, length);
+    sum->fed = sum->fed + length;
 
-    /* File Handler */
-    int streamout;
+    while ( length > 0 ) {
+        n = CHECKSUM_BLOCK_SIZE - sum->block.total;
+        if ( n > length ) {
+            n = length;
+        }
+        ChecksumUpdate(&sum->block, data, n);
+        data   = data + n;
+        length = length - n;
 
-    int size;
+        if ( sum->block.total == CHECKSUM_BLOCK_SIZE && DVDSumBlock(sum) != 0 ) {
+            return(1);
+        }
+    }
+    return(0);
+}
 
-    /* DVD handler */
-    dvd_file_t *dvd_file = NULL;
+/* Feed what the file already holds from where the data stopped up to
+   end, a hole or sectors an earlier backup wrote */
+static int
+DVDSumReadBack (file_sum_t *sum, off_t end)
+{
+    unsigned char *buffer;
+    int            fd;
+    size_t         n;
+    ssize_t        got;
+    int            result = 0;
 
-    if (title_set_info->number_of_title_sets + 1 < title_set) {
+    if ( sum->fed >= end ) {
+        return(0);
+    }
+    if ((fd = open(sum->targetname, O_RDONLY)) == -1) {
+        return(1);
+    }
+    if ((buffer = (unsigned char *)malloc(CHECKSUM_BLOCK_SIZE)) == NULL) {
+        close(fd);
         return(1);
     }
 
-    if (title_set_info->title_set[title_set].size_ifo == 0 ) {
-        return(0);
-    } else {
-        size = title_set_info->title_set[title_set].size_ifo;
-        if (title_set_info->title_set[title_set].size_ifo%2048 != 0) {
-            fprintf(stderr, "The IFO of title set %d doesn't have a valid DVD size\n",
-                    title_set);
-            return(1);
+    while ( sum->fed < end && result == 0 ) {
+        n = CHECKSUM_BLOCK_SIZE;
+        if ( (off_t)n > end - sum->fed ) {
+            n = end - sum->fed;
+        }
+        if ((got = pread(fd, buffer, n, sum->fed)) <= 0) {
+            result = 1;
+        } else {
+            result = DVDSumFeed(sum, buffer, got);
         }
     }
 
-    /* Create VIDEO_TS.IFO or VTS_XX_0.IFO */
+    free(buffer);
+    close(fd);
+    return(result);
+}
 
-    if (title_set == 0) {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VIDEO_TS.IFO",targetdir, title_name);
-    } else {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_0.IFO",targetdir, title_name, title_set);
-    }
+/* Checksum and hash a slot on its way to the writer, in the thread
+   that hands it over so it overlaps with the reads still going on */
+static void
+DVDSumSlot (copy_ring_t *ring, ring_slot_t *slot)
+{
+    file_sum_t   *sum  = ring->extent[slot->extent].sum;
+    store_feed_t *feed = ring->extent[slot->extent].feed;
 
-    if (stat(targetname, &fileinfo) == 0) {
-        fprintf(stderr, "The IFO file %s exists will try to over write it.\n",
-                targetname);
-        if (! S_ISREG(fileinfo.st_mode)) {
-            fprintf(stderr,"The IFO %s file is not valid, it may be a directory\n",
-                    targetname);
-            return(1);
+    if ( feed != NULL ) {
+        if ( slot->cloned ) {
+            feed->unordered = 1;
         } else {
-            if ((streamout = open(targetname, O_WRONLY | O_TRUNC, 0644)) == -1) {
-                fprintf(stderr, "Error opening %s\n", targetname);
-                perror("");
-                return(1);
-            }
-        }
-    } else {
-        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
-            fprintf(stderr, "Error creating %s\n", targetname);
-            perror("");
-            return(1);
+            StoreFeed(feed, slot->position, slot->data, slot->blocks * 2048);
         }
     }
-
-    /* Copy VIDEO_TS.IFO, since it's a small file try to copy it in one shot */
-
-    if ((buffer = (unsigned char *)malloc(size * sizeof(buffy))) == NULL) {
-        fprintf(stderr, "Out of memory coping %s\n", targetname);
-        close(streamout);
-        return(1);
+    if ( sum == NULL || sum->unordered ) {
+        return;
     }
+    if ( slot->position < sum->fed
+         || DVDSumReadBack(sum, slot->position) != 0
+         || DVDSumFeed(sum, slot->data, slot->blocks * 2048) != 0 ) {
+        /* Checksummed from the file once it is complete instead */
+        sum->unordered = 1;
+    }
+}
 
-    if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_INFO_FILE))== 0) {
-        fprintf(stderr, "Failed opending IFO for tile set %d\n", title_set);
-        free(buffer);
-        close(streamout);
-        return(1);
+/* Read back what wasn't copied and add the file to the manifest */
+static int
+DVDSumFinish (file_sum_t *sum)
+{
+    /* Loop variable */
+    int i;
+
+    manifest_t  *manifest = sum->manifest;
+    struct stat  fileinfo;
+    char        *name;
+    int          digits = ChecksumDigits(checksum);
+
+    if ( sum->unordered ) {
+        free(sum->blocks);
+        sum->blocks           = NULL;
+        sum->number_of_blocks = 0;
+        sum->fed              = 0;
+        ChecksumInit(&sum->file, checksum);
+        ChecksumInit(&sum->block, checksum);
     }
 
-    if ( DVDReadBytes(dvd_file,buffer,size) != size) {
-        fprintf(stderr, "Error reading IFO for title set %d\n", title_set);
-        free(buffer);
-        DVDCloseFile(dvd_file);
-        close(streamout);
+    if ( stat(sum->targetname, &fileinfo) != 0
+         || DVDSumReadBack(sum, fileinfo.st_size) != 0
+         || (sum->block.total > 0 && DVDSumBlock(sum) != 0) ) {
+        fprintf(stderr, "Error checksumming %s\n", sum->targetname);
         return(1);
     }
 
-    DVDCloseFile(dvd_file);
+    name = strrchr(sum->targetname, '/');
+    name = (name == NULL ? sum->targetname : name + 1);
 
-    if (write(streamout,buffer,size) != size) {
-        fprintf(stderr, "Error writing %s\n",targetname);
-        free(buffer);
-        close(streamout);
-        return(1);
+    pthread_mutex_lock(&manifest->lock);
+    fprintf(manifest->file, "file %s %lld %0*llx\n", name, (long long)sum->fed,
+            digits, (unsigned long long)ChecksumFinal(&sum->file));
+    for ( i = 0; i < sum->number_of_blocks; i++ ) {
+        fprintf(manifest->file, "block %s %d %0*llx\n", name, i,
+                digits, (unsigned long long)sum->blocks[i]);
     }
+    pthread_mutex_unlock(&manifest->lock);
 
-    free(buffer);
-    close(streamout);
+    return(0);
+}
 
-    /* Create VIDEO_TS.BUP or VTS_XX_0.BUP */
+/* Mark sectors start up to end of a rescue map, the ranges stay
+   sorted, apart and merged */
+static int
+DVDRescueSet (rescue_map_t *map, int start, int end, char status)
+{
+    /* Loop variable */
+    int i;
 
-    if (title_set == 0) {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VIDEO_TS.BUP",targetdir, title_name);
-    } else {
-        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_0.BUP",targetdir, title_name, title_set);
-    }
+    rescue_range_t *range;
+    int             n = 0;
 
-    if (title_set_info->title_set[title_set].size_bup == 0 ) {
+    if ( start >= end ) {
         return(0);
-    } else {
-        size = title_set_info->title_set[title_set].size_bup;
-        if (title_set_info->title_set[title_set].size_bup%2048 != 0) {
-            fprintf(stderr, "The BUP of title set %d doesn't "
-                    "have a valid DVD size\n", title_set);
-            return(1);
+    }
+    if ((range = (rescue_range_t *)malloc((map->ranges + 2)
+                                          * sizeof(rescue_range_t))) == NULL) {
+        return(1);
+    }
+
+    for ( i = 0; i < map->ranges && map->range[i].start < start; i++ ) {
+        range[n] = map->range[i];
+        if ( range[n].end > start ) {
+            range[n].end = start;
         }
+        n++;
     }
 
-    if (stat(targetname, &fileinfo) == 0) {
-        fprintf(stderr, "The BUP file %s exists will try to over write it.\n",
-                targetname);
-        if (! S_ISREG(fileinfo.st_mode)) {
-            fprintf(stderr,"The BUP %s file is not valid, it may be a directory\n",
-                    targetname);
-            return(1);
-        } else {
-            if ((streamout = open(targetname, O_WRONLY | O_TRUNC, 0644)) == -1) {
-                fprintf(stderr, "Error opening %s\n", targetname);
-                perror("");
-                return(1);
+    range[n].start  = start;
+    range[n].end    = end;
+    range[n].status = status;
+    n++;
+
+    for ( i = 0; i < map->ranges; i++ ) {
+        if ( map->range[i].end > end ) {
+            range[n] = map->range[i];
+            if ( range[n].start < end ) {
+                range[n].start = end;
             }
+            n++;
         }
-    } else {
-        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
-            fprintf(stderr, "Error creating %s\n", targetname);
-            perror("");
-            return(1);
+    }
+
+    map->ranges = 0;
+    for ( i = 0; i < n; i++ ) {
+        if ( map->ranges > 0 && range[map->ranges - 1].end == range[i].start
+             && range[map->ranges - 1].status == range[i].status ) {
+            range[map->ranges - 1].end = range[i].end;
+        } else {
+            range[map->ranges++] = range[i];
         }
     }
 
-    /* Copy VIDEO_TS.BUP or VTS_XX_0.BUP, since it's a small file try
-       to copy it in one shot */
+    free(map->range);
+    map->range = range;
+    return(0);
+}
 
-    if ((buffer = (unsigned char *)malloc(size * sizeof(buffy))) == NULL) {
-        fprintf(stderr, "Out of memory coping %s\n", targetname);
-        close(streamout);
-        return(1);
-    }
+/* Bad sectors are kept apart until the copy is done, so the ranges
+   read around them can't cover them up */
+static void
+DVDRescueBad (rescue_map_t *map, int start, int end)
+{
+    rescue_range_t *bad;
 
-    if ((dvd_file = DVDOpenFile(dvd, title_set, DVD_READ_INFO_BACKUP_FILE))== 0) {
-        fprintf(stderr, "Failed opending BUP for title set %d\n", title_set);
-        free(buffer);
-        close(streamout);
-        return(1);
+    if ((bad = (rescue_range_t *)realloc(map->bad, (map->bads + 1)
+                                         * sizeof(rescue_range_t))) == NULL) {
+        return;
     }
+    map->bad = bad;
+    map->bad[map->bads].start  = start;
+    map->bad[map->bads].end    = end;
+    map->bad[map->bads].status = '-';
+    map->bads++;
+}
 
-    if ( DVDReadBytes(dvd_file,buffer,size) != size) {
-        fprintf(stderr, "Error reading BUP for title set %d\n", title_set);
-        free(buffer);
-        DVDCloseFile(dvd_file);
-        close(streamout);
-        return(1);
+/* The map of a file under VIDEO_TS lives in RESCUE_DIR next to it.
+   Without one a file counts as read up to its current size */
+static rescue_map_t*
+DVDRescueOpen (char *targetname)
+{
+    rescue_map_t *map;
+    FILE         *file;
+    struct stat   fileinfo;
+    char          line[MAXNAME];
+    char         *name;
+    long long     pos;
+    long long     size;
+    char          status;
+    int           header = 0;
+
+    if ((map = (rescue_map_t *)calloc(1, sizeof(rescue_map_t))) == NULL) {
+        return(NULL);
     }
-
-    DVDCloseFile(dvd_file);
-
-    if (write(streamout,buffer,size) != size) {
-        fprintf(stderr, "Error writing %s\n", targetname);
-        free(buffer);
-        close(streamout);
-        return(1);
+    name = strrchr(targetname, '/');
+    name = (name == NULL ? targetname : name + 1);
+    snprintf(map->dir, sizeof(map->dir), "%.*s/%s",
+             (int)(name - targetname) - (int)strlen("/VIDEO_TS/"), targetname,
+             RESCUE_DIR);
+    snprintf(map->path, sizeof(map->path), "%s/%s.map", map->dir, name);
+
+    if ((file = fopen(map->path, "r")) == NULL) {
+        if ( rescue && stat(targetname, &fileinfo) == 0 ) {
+            DVDRescueSet(map, 0, fileinfo.st_size / 2048, '+');
+        }
+        return(map);
     }
 
-    free(buffer);
-    close(streamout);
+    /* After the comments a status line, then pos size status in bytes.
+       A sector only counts as read if all of it was */
+    while ( fgets(line, sizeof(line), file) != NULL ) {
+        if ( line[0] == '#' ) {
+            continue;
+        }
+        if ( !header ) {
+            header = 1;
+            continue;
+        }
+        if ( sscanf(line, "%lli %lli %c", &pos, &size, &status) != 3 ) {
+            continue;
+        }
+        if ( status == '+' ) {
+            DVDRescueSet(map, (pos + 2047) / 2048, (pos + size) / 2048, status);
+        } else {
+            DVDRescueSet(map, pos / 2048, (pos + size + 2047) / 2048, status);
+        }
+    }
+    fclose(file);
 
-    return(0);
+    return(map);
 }
 
-int
-DVDMirrorVMG (dvd_reader_t *dvd,
-              title_set_info_t *title_set_info,
-              char *targetdir, char *title_name)
+static void
+DVDRescueFree (rescue_map_t *map)
 {
-    if ( DVDCopyIfoBup(dvd, title_set_info, 0, targetdir, title_name) != 0 ) {
-        return(1);
+    if (map == NULL) {
+        return;
     }
-
-    if ( DVDCopyMenu(dvd, title_set_info, 0, targetdir, title_name) != 0 ) {
-        return(1);
-    }
-    return(0);
+    free(map->range);
+    free(map->bad);
+    free(map);
 }
 
-int
-DVDMirrorTitleX (dvd_reader_t *dvd,
-                 title_set_info_t *title_set_info,
-                 int title_set, char *targetdir,char *title_name)
+/* Write the map in ddrescue's format, or remove it once the whole
+   file is read */
+static int
+DVDRescueSave (rescue_map_t *map, char *targetname)
 {
-    /* Loop through the vobs */
+    /* Loop variable */
     int i;
 
-    if ( DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
+    struct stat fileinfo;
+    FILE       *file;
+    char        temp[PATH_MAX + MAXNAME + 4];
+    int         sectors;
+    int         pos = 0;
+
+    for ( i = 0; i < map->bads; i++ ) {
+        if ( DVDRescueSet(map, map->bad[i].start, map->bad[i].end, '-') != 0 ) {
+            return(1);
+        }
+    }
+    if ( stat(targetname, &fileinfo) != 0 ) {
         return(1);
     }
+    sectors = fileinfo.st_size / 2048;
 
-    if ( DVDCopyMenu(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
+    if ( map->ranges == 0 || (map->ranges == 1 && map->range[0].start == 0
+                              && map->range[0].end >= sectors
+                              && map->range[0].status == '+') ) {
+        unlink(map->path);
+        rmdir(map->dir);
+        return(0);
+    }
+
+    if ( mkdir(map->dir, 0755) != 0 && errno != EEXIST ) {
+        fprintf(stderr, "Can't create %s\n", map->dir);
+        return(1);
+    }
+    sprintf(temp, "%s.new", map->path);
+    if ((file = fopen(temp, "w")) == NULL) {
+        fprintf(stderr, "Can't write the rescue map %s\n", map->path);
         return(1);
     }
 
-    for (i = 0; i < title_set_info->title_set[title_set].number_of_vob_files ; i++) {
+    fprintf(file, "# Mapfile. Created by dvdbackup\n"
+            "# current_pos  current_status  current_pass\n"
+            "0x00000000     +               1\n"
+            "#      pos        size  status\n");
+    for ( i = 0; i < map->ranges && pos < sectors; i++ ) {
+        if ( map->range[i].start > pos ) {
+            fprintf(file, "0x%08llX  0x%08llX  ?\n", (long long)pos * 2048,
+                    (long long)(map->range[i].start - pos) * 2048);
+            pos = map->range[i].start;
+        }
+        if ( map->range[i].end > sectors ) {
+            map->range[i].end = sectors;
+        }
+        fprintf(file, "0x%08llX  0x%08llX  %c\n", (long long)pos * 2048,
+                (long long)(map->range[i].end - pos) * 2048, map->range[i].status);
+        pos = map->range[i].end;
+    }
+    if ( pos < sectors ) {
+        fprintf(file, "0x%08llX  0x%08llX  ?\n", (long long)pos * 2048,
+                (long long)(sectors - pos) * 2048);
+    }
+
+    if ( fclose(file) != 0 || rename(temp, map->path) != 0 ) {
+        fprintf(stderr, "Error writing the rescue map %s\n", map->path);
+        unlink(temp);
+        return(1);
+    }
+    return(0);
+}
+
+/* Leave out the sectors the rescue maps have as read. Returns the
+   number of extents left in *left, which the caller frees */
+static int
+DVDRescueSkip (copy_extent_t extent[], int extents, copy_extent_t **left)
+{
+    /* Loop variables */
+    int i, r;
+
+    copy_extent_t *out;
+    rescue_map_t  *map;
+    int            count = 0;
+    int            first;
+    int            last;
+    int            next;
+    int            ranges = 0;
+
+    for ( i = 0; i < extents; i++ ) {
+        ranges = ranges + extent[i].rescue->ranges;
+    }
+    if ((out = (copy_extent_t *)malloc((extents + ranges + 1)
+                                       * sizeof(copy_extent_t))) == NULL) {
+        return(-1);
+    }
+
+    for ( i = 0; i < extents; i++ ) {
+        map   = extent[i].rescue;
+        first = extent[i].target_offset;
+        last  = extent[i].target_offset + extent[i].size;
+        next  = first;
+
+        for ( r = 0; r < map->ranges; r++ ) {
+            if ( map->range[r].status != '+'
+                 || map->range[r].end <= next || map->range[r].start >= last ) {
+                continue;
+            }
+            if ( map->range[r].start > next ) {
+                out[count] = extent[i];
+                out[count].offset        = extent[i].offset + next - first;
+                out[count].size          = map->range[r].start - next;
+                out[count].target_offset = next;
+                count++;
+            }
+            next = map->range[r].end;
+        }
+        if ( next < last ) {
+            out[count] = extent[i];
+            out[count].offset        = extent[i].offset + next - first;
+            out[count].size          = last - next;
+            out[count].target_offset = next;
+            count++;
+        }
+    }
+
+    *left = out;
+    return(count);
+}
+
+/* The copy went through, what was read goes in the maps on top of what
+   earlier runs found */
+static int
+DVDRescueFinish (copy_extent_t copied[], int copies,
+                 copy_extent_t extent[], int extents)
+{
+    /* Loop variables */
+    int i, j;
+
+    int result = 0;
+
+    for ( i = 0; i < copies; i++ ) {
+        result |= DVDRescueSet(copied[i].rescue, copied[i].target_offset,
+                               copied[i].target_offset + copied[i].size, '+');
+    }
+
+    for ( i = 0; i < extents; i++ ) {
+        for ( j = 0; j < i; j++ ) {
+            if ( extent[j].streamout == extent[i].streamout ) {
+                break;
+            }
+        }
+        if ( j == i ) {
+            result |= DVDRescueSave(extent[i].rescue, extent[i].targetname);
+        }
+    }
+    return(result);
+}
+
+/* Look up once per copy which targets are O_DIRECT and open their
+   buffered twins, and for --incremental a descriptor to read back
+   what's there, so any thread can write any slot. With a manifest
+   every target gets its running checksums, with a store its chunk
+   hashes */
+static int
+DVDPrepareExtents (copy_extent_t extent[], int extents, manifest_t *manifest)
+{
+    /* Loop variables */
+    int i, j;
+
+    int   flags;
+    char *path;
+
+    for ( i = 0; i < extents; i++ ) {
+        flags = fcntl(extent[i].streamout, F_GETFL);
+        extent[i].direct   = (flags != -1 && (flags & DIRECT_IO_FLAG));
+        extent[i].stream   = (stream_fd != -1 && extent[i].streamout == stream_fd);
+        extent[i].buffered = -1;
+        extent[i].compare  = -1;
+        extent[i].sum      = NULL;
+        extent[i].feed     = NULL;
+        extent[i].rescue   = NULL;
+        extent[i].stat     = NULL;
+    }
+
+    for ( i = 0; i < extents; i++ ) {
+        for ( j = 0; j < i; j++ ) {
+            if ( extent[j].streamout == extent[i].streamout ) {
+                extent[i].buffered = extent[j].buffered;
+                extent[i].compare  = extent[j].compare;
+                extent[i].sum      = extent[j].sum;
+                extent[i].feed     = extent[j].feed;
+                extent[i].rescue   = extent[j].rescue;
+                extent[i].stat     = extent[j].stat;
+                break;
+            }
+        }
+        if ( j < i ) {
+            continue;
+        }
+
+        path = (current_image != NULL ? current_image->path : extent[i].targetname);
+        if ( extent[i].direct
+             && (extent[i].buffered = open(path, O_WRONLY)) == -1) {
+            fprintf(stderr, "Error opening %s\n", path);
+            perror("");
+            return(1);
+        }
+        if ( incremental
+             && (extent[i].compare = open(path, O_RDONLY)) == -1) {
+            fprintf(stderr, "Error opening %s\n", path);
+            perror("");
+            return(1);
+        }
+        if ( manifest != NULL
+             && (extent[i].sum = DVDSumOpen(manifest, extent[i].targetname)) == NULL) {
+            fprintf(stderr, "Out of memory checksumming %s\n", extent[i].targetname);
+            return(1);
+        }
+        if ( dedup_store != NULL && !extent[i].stream
+             && (extent[i].feed = StoreFeedOpen(dedup_store)) == NULL) {
+            fprintf(stderr, "Out of memory hashing %s\n", extent[i].targetname);
+            return(1);
+        }
+        if ( DVDStatsOn() ) {
+            extent[i].stat = DVDFileStat(extent[i].targetname);
+        }
+        if ( recover && (extent[i].rescue = DVDRescueOpen(extent[i].targetname)) == NULL) {
+            fprintf(stderr, "Out of memory reading the rescue map of %s\n",
+                    extent[i].targetname);
+            return(1);
+        }
+    }
+    return(0);
+}
+
+/* Every target is complete, put it in the manifest */
+static int
+DVDFinishExtents (copy_extent_t extent[], int extents)
+{
+    /* Loop variables */
+    int i, j;
+
+    int result = 0;
+
+    for ( i = 0; i < extents; i++ ) {
+        for ( j = 0; j < i; j++ ) {
+            if ( extent[j].streamout == extent[i].streamout ) {
+                break;
+            }
+        }
+        if ( j < i ) {
+            continue;
+        }
+        if ( extent[i].sum != NULL ) {
+            result |= DVDSumFinish(extent[i].sum);
+        }
+        /* The backup is complete either way, it just isn't shared */
+        if ( dedup_store != NULL && !extent[i].stream
+             && StoreFile(dedup_store, extent[i].targetname, extent[i].feed) != 0 ) {
+            fprintf(stderr, "Couldn't put %s in the store\n", extent[i].targetname);
+        }
+    }
+    return(result);
+}
+
+static void
+DVDReleaseExtents (copy_extent_t extent[], int extents)
+{
+    /* Loop variables */
+    int i, j;
+
+    for ( i = 0; i < extents; i++ ) {
+        for ( j = 0; j < i; j++ ) {
+            if ( extent[j].streamout == extent[i].streamout ) {
+                break;
+            }
+        }
+        if ( j < i ) {
+            continue;
+        }
+        if ( extent[i].buffered != -1 ) {
+            close(extent[i].buffered);
+        }
+        if ( extent[i].compare != -1 ) {
+            close(extent[i].compare);
+        }
+        DVDSumFree(extent[i].sum);
+        StoreFeedFree(extent[i].feed);
+        DVDRescueFree(extent[i].rescue);
+    }
+}
+
+static int
+CompareJournalRanges (const void *a, const void *b)
+{
+    const journal_range_t *range_a = (const journal_range_t *)a;
+    const journal_range_t *range_b = (const journal_range_t *)b;
+    int                    order;
+
+    if ((order = strcmp(range_a->name, range_b->name)) != 0) {
+        return(order);
+    }
+    return(range_a->start - range_b->start);
+}
+
+/* Read back what an interrupted run committed. Ranges past the end of
+   the file as it is now, or of a file that is gone, are dropped; a
+   torn last line is ignored */
+static void
+DVDJournalLoad (journal_t *journal, char *videodir)
+{
+    /* Loop variables */
+    int i, n;
+
+    FILE            *file;
+    char             line[MAXNAME];
+    char             filename[PATH_MAX + 16];
+    journal_range_t  range;
+    journal_range_t *more;
+    struct stat      fileinfo;
+    int              allocated = 0;
+
+    if ((file = fopen(journal->path, "r")) == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (strchr(line, '\n') == NULL
+            || sscanf(line, "%15s %d %d", range.name, &range.start, &range.end) != 3
+            || range.start < 0 || range.end <= 0) {
+            continue;
+        }
+        range.end = range.start + range.end;
+
+        sprintf(filename, "%s/%s", videodir, range.name);
+        if (stat(filename, &fileinfo) != 0) {
+            continue;
+        }
+        if (range.end > fileinfo.st_size / 2048) {
+            range.end = fileinfo.st_size / 2048;
+        }
+        if (range.start >= range.end) {
+            continue;
+        }
+
+        if (journal->ranges == allocated) {
+            allocated = allocated * 2 + 64;
+            if ((more = (journal_range_t *)realloc(journal->range,
+                                                   allocated * sizeof(journal_range_t))) == NULL) {
+                break;
+            }
+            journal->range = more;
+        }
+        journal->range[journal->ranges++] = range;
+    }
+    fclose(file);
+
+    /* Sorted by file and start, overlapping ranges merged */
+    qsort(journal->range, journal->ranges, sizeof(journal_range_t), CompareJournalRanges);
+    for (i = 0, n = 0; i < journal->ranges; i++) {
+        if (n > 0 && strcmp(journal->range[n - 1].name, journal->range[i].name) == 0
+            && journal->range[n - 1].end >= journal->range[i].start) {
+            if (journal->range[n - 1].end < journal->range[i].end) {
+                journal->range[n - 1].end = journal->range[i].end;
+            }
+        } else {
+            journal->range[n++] = journal->range[i];
+        }
+    }
+    journal->ranges = n;
+}
+
+journal_t*
+DVDJournalOpen (char *targetdir, char *title_name)
+{
+    journal_t *journal;
+    char       videodir[PATH_MAX];
+
+    if ((journal = (journal_t *)calloc(1, sizeof(journal_t))) == NULL) {
+        return(NULL);
+    }
+    sprintf(journal->path, "%s/%s/%s", targetdir, title_name, JOURNAL_NAME);
+    sprintf(videodir, "%s/%s/VIDEO_TS", targetdir, title_name);
+
+    if (resume) {
+        DVDJournalLoad(journal, videodir);
+        if ( verbose > 0 ) {
+            fprintf(stderr, "Resuming with %d copied ranges from %s\n",
+                    journal->ranges, journal->path);
+        }
+    }
+
+    if ((journal->fd = open(journal->path, O_WRONLY | O_CREAT | O_APPEND
+                            | (resume ? 0 : O_TRUNC), 0644)) == -1) {
+        fprintf(stderr, "Can't write the journal %s, an interrupted backup "
+                "will have to start over\n", journal->path);
+        free(journal->range);
+        free(journal);
+        return(NULL);
+    }
+
+    pthread_mutex_init(&journal->lock, NULL);
+    journal->synced = time(NULL);
+    return(journal);
+}
+
+/* A finished backup needs no journal */
+void
+DVDJournalClose (journal_t *journal, int complete)
+{
+    if (journal == NULL) {
+        return;
+    }
+    close(journal->fd);
+    if (complete) {
+        unlink(journal->path);
+    }
+    pthread_mutex_destroy(&journal->lock);
+    free(journal->range);
+    free(journal);
+}
+
+/* Sectors are only journaled once the target has them on disk */
+static void
+DVDJournalCommit (copy_ring_t *ring)
+{
+    journal_t     *journal = ring->journal;
+    copy_extent_t *extent;
+    char           line[MAXNAME];
+    char          *name;
+
+    if ( ring->mark_extent < 0 || ring->mark_end == ring->mark_start ) {
+        return;
+    }
+    extent = &ring->extent[ring->mark_extent];
+    name   = strrchr(extent->targetname, '/');
+    name   = (name == NULL ? extent->targetname : name + 1);
+
+    if (fdatasync(extent->streamout) == 0) {
+        sprintf(line, "%s %d %d\n", name, ring->mark_start,
+                ring->mark_end - ring->mark_start);
+        pthread_mutex_lock(&journal->lock);
+        if (write(journal->fd, line, strlen(line)) != (ssize_t)strlen(line)
+            || fsync(journal->fd) != 0) {
+            fprintf(stderr, "Error writing the journal %s\n", journal->path);
+        }
+        journal->synced = time(NULL);
+        pthread_mutex_unlock(&journal->lock);
+    }
+    ring->mark_start = ring->mark_end;
+}
+
+/* Slots come back in ring order, so what is written grows as one run
+   per extent until a write fails */
+static void
+DVDJournalMark (copy_ring_t *ring, ring_slot_t *slot)
+{
+    int start = slot->position / 2048;
+
+    if ( slot->failed ) {
+        DVDJournalCommit(ring);
+        ring->mark_extent = -1;
+        return;
+    }
+
+    if ( ring->mark_extent != slot->extent || ring->mark_end != start ) {
+        DVDJournalCommit(ring);
+        ring->mark_extent = slot->extent;
+        ring->mark_start  = start;
+    }
+    ring->mark_end = start + slot->blocks;
+
+    if ( time(NULL) - ring->journal->synced >= journal_interval ) {
+        DVDJournalCommit(ring);
+    }
+}
+
+/* Leave out the sectors the journal already has. Returns the number
+   of extents left in *left, which the caller frees */
+static int
+DVDJournalSkip (journal_t *journal, copy_extent_t extent[], int extents,
+                copy_extent_t **left)
+{
+    /* Loop variables */
+    int i, r;
+
+    copy_extent_t *out;
+    int            count = 0;
+    int            first;
+    int            last;
+    int            next;
+    char          *name;
+
+    if ((out = (copy_extent_t *)malloc((extents + journal->ranges)
+                                       * sizeof(copy_extent_t))) == NULL) {
+        return(-1);
+    }
+
+    for ( i = 0; i < extents; i++ ) {
+        name  = strrchr(extent[i].targetname, '/');
+        name  = (name == NULL ? extent[i].targetname : name + 1);
+        first = extent[i].target_offset;
+        last  = extent[i].target_offset + extent[i].size;
+        next  = first;
+
+        for ( r = 0; r < journal->ranges; r++ ) {
+            if ( strcmp(journal->range[r].name, name) != 0
+                 || journal->range[r].end <= next || journal->range[r].start >= last ) {
+                continue;
+            }
+            if ( journal->range[r].start > next ) {
+                out[count] = extent[i];
+                out[count].offset        = extent[i].offset + next - first;
+                out[count].size          = journal->range[r].start - next;
+                out[count].target_offset = next;
+                count++;
+            }
+            next = journal->range[r].end;
+        }
+        if ( next < last ) {
+            out[count] = extent[i];
+            out[count].offset        = extent[i].offset + next - first;
+            out[count].size          = last - next;
+            out[count].target_offset = next;
+            count++;
+        }
+
+        if ( verbose > 0 && next != first ) {
+            fprintf(stderr, "%s: skipping sectors already copied\n", name);
+        }
+    }
+
+    *left = out;
+    return(count);
+}
+
+/* Bytes copied for the batch summary and --stats, and progress for the
+   journal */
+static void
+DVDSlotDone (copy_ring_t *ring, ring_slot_t *slot)
+{
+    /* Loop variable */
+    int e;
+
+    if ( ring->job != NULL ) {
+        __sync_fetch_and_add(&ring->job->bytes, (long long)slot->blocks * 2048);
+    }
+    if ( ring->journal != NULL ) {
+        DVDJournalMark(ring, slot);
+    }
+    if ( DVDStatsOn() ) {
+        for ( e = slot->extent; e != -1; e = ring->extent[e].next_copy ) {
+            DVDStatBytes(ring->extent[e].stat, (long long)slot->blocks * 2048);
+        }
+    }
+}
+
+/* A pipe takes the slots in the order they come, with write() */
+static int
+DVDWriteStream (int streamout, unsigned char *data, int length)
+{
+    ssize_t written;
+
+    while ( length > 0 ) {
+        COUNT(write_calls);
+        if ((written = write(streamout, data, length)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return(1);
+        }
+        data   = data + written;
+        length = length - written;
+    }
+    return(0);
+}
+
+/* Write part of a slot. The data is shifted in its buffer so that any
+   part of it lines up with its place in the target */
+static int
+DVDWriteRange (copy_extent_t *extent, unsigned char *data, int length,
+               off_t position)
+{
+    int head;
+    int body;
+    int tail;
+
+    position = position + extent->image_offset;
+
+    if ( extent->stream ) {
+        return(DVDWriteStream(extent->streamout, data, length));
+    }
+    if ( !extent->direct ) {
+        COUNT(write_calls);
+        return(pwrite(extent->streamout, data, length, position) != length);
+    }
+
+    /* A slot lined up for another target can't go straight to disk */
+    if ( ((uintptr_t)data - position) % DIRECT_IO_ALIGN != 0 ) {
+        return(DVDWriteBuffered(extent, data, length, position));
+    }
+
+    tail = DVDDirectSplit(position, length, &head, &body);
+
+    if ( DVDWriteBuffered(extent, data, head, position) != 0 ) {
+        return(1);
+    }
+    if ( body > 0 ) {
+        COUNT(write_calls);
+        if (pwrite(extent->streamout, data + head, body, position + head) != body) {
+            return(1);
+        }
+    }
+    return(DVDWriteBuffered(extent, data + head + body, tail,
+                            position + head + body));
+}
+
+/* Rewrite only the block groups of a slot that differ from what the
+   target already holds, or that it doesn't have yet */
+static int
+DVDWriteChanged (copy_extent_t *extent, ring_slot_t *slot, off_t position)
+{
+    int     length = slot->blocks * 2048;
+    int     group  = COMPARE_GROUP_IN_BLOCKS * 2048;
+    int     start  = -1;
+    int     i, n;
+    ssize_t have;
+
+    if ( compare_buffer == NULL
+         && (compare_buffer = (unsigned char *)malloc(buf_blocks * 2048)) == NULL ) {
+        return(DVDWriteRange(extent, slot->data, length, position));
+    }
+
+    if ((have = pread(extent->compare, compare_buffer, length,
+                      extent->image_offset + position)) < 0) {
+        have = 0;
+    }
+
+    for ( i = 0; i < length; i = i + group ) {
+        n = (length - i < group ? length - i : group);
+        if ( i + n <= have && memcmp(slot->data + i, compare_buffer + i, n) == 0 ) {
+            if ( start != -1 ) {
+                if ( DVDWriteRange(extent, slot->data + start, i - start,
+                                   position + start) != 0 ) {
+                    return(1);
+                }
+                start = -1;
+            }
+            __sync_fetch_and_add(&sectors_unchanged, n / 2048);
+        } else {
+            if ( start == -1 ) {
+                start = i;
+            }
+            __sync_fetch_and_add(&sectors_rewritten, n / 2048);
+        }
+    }
+
+    if ( start != -1 ) {
+        return(DVDWriteRange(extent, slot->data + start, length - start,
+                             position + start));
+    }
+    return(0);
+}
+
+static int
+DVDWriteSlot (copy_ring_t *ring, ring_slot_t *slot)
+{
+    copy_extent_t *extent = &ring->extent[slot->extent];
+    double         started = DVDClock();
+    off_t          position = slot->position;
+    int            result = 0;
+
+    if ( slot->cloned ) {
+        return(0);
+    }
+
+    /* The same sectors go to every copy of the extent, each at its own
+       place */
+    for (;;) {
+        if ( incremental ) {
+            result |= DVDWriteChanged(extent, slot, position);
+        } else {
+            result |= DVDWriteRange(extent, slot->data, slot->blocks * 2048, position);
+        }
+        if ( extent->next_copy == -1 ) {
+            break;
+        }
+        extent   = &ring->extent[extent->next_copy];
+        position = ((off_t)extent->target_offset + slot->offset - extent->offset) * 2048;
+        /* Checksummed and hashed from the file once it is complete */
+        if ( extent->sum != NULL ) {
+            extent->sum->unordered = 1;
+        }
+        if ( extent->feed != NULL ) {
+            extent->feed->unordered = 1;
+        }
+    }
+    if ( DVDStatsOn() ) {
+        DVDLatency(&stats.write, DVDClock() - started);
+    }
+    return(result);
+}
+
+static int
+DVDRingWritePosix (copy_ring_t *ring)
+{
+    ring_slot_t *slot;
+    int          result = 0;
+
+    /* Drain buffers in the order the reader filled them */
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        while ( ring->count == 0 && !ring->done ) {
+            pthread_cond_wait(&ring->filled, &ring->lock);
+        }
+        if ( ring->count == 0 ) {
+            break;
+        }
+
+        slot = &ring->slot[ring->tail];
+        pthread_mutex_unlock(&ring->lock);
+
+        DVDSumSlot(ring, slot);
+        if ( DVDWriteSlot(ring, slot) != 0 ) {
+            fprintf(stderr, "Error writing %s\n",
+                    ring->extent[slot->extent].targetname);
+            pthread_mutex_lock(&ring->lock);
+            ring->error = 1;
+            pthread_cond_signal(&ring->emptied);
+            break;
+        }
+
+        DVDSlotDone(ring, slot);
+
+        pthread_mutex_lock(&ring->lock);
+        ring->tail = (ring->tail + 1) % ring->depth;
+        ring->count--;
+        pthread_cond_signal(&ring->emptied);
+    }
+    if ( ring->error ) {
+        result = 1;
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    return(result);
+}
+
+#ifdef HAVE_LIBURING
+static int
+DVDUringComplete (copy_ring_t *ring, struct io_uring_cqe *cqe)
+{
+    ring_slot_t *slot;
+    int          result = 0;
+
+    slot = &ring->slot[(int)(long)io_uring_cqe_get_data(cqe)];
+    if (cqe->res != slot->queued) {
+        if (cqe->res < 0) {
+            errno = -cqe->res;
+            perror("");
+        }
+        fprintf(stderr, "Error writing %s\n",
+                ring->extent[slot->extent].targetname);
+        slot->failed = 1;
+        result = 1;
+    }
+    io_uring_cqe_seen(&ring->pool->uring, cqe);
+    COUNT(uring_completions);
+    if ( DVDStatsOn() ) {
+        DVDLatency(&stats.write, DVDClock() - slot->started);
+    }
+
+    slot->written = 1;
+    return(result);
+}
+
+/* Queue one slot on the ring. Unaligned pieces of O_DIRECT targets are
+   written on the spot, only the body goes through io_uring */
+static int
+DVDUringQueue (copy_ring_t *ring, ring_slot_t *slot, int index, int *inflight)
+{
+    struct io_uring     *uring  = &ring->pool->uring;
+    copy_extent_t       *extent = &ring->extent[slot->extent];
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    off_t                position = extent->image_offset + slot->position;
+    int                  head   = 0;
+    int                  body   = slot->blocks * 2048;
+    int                  tail   = 0;
+    int                  error  = 0;
+
+    if ( slot->cloned ) {
+        slot->written = 1;
+        return(0);
+    }
+
+    /* Switching the fixed file waits for writes to the old one */
+    if ( ring->pool->uring_fd != extent->streamout ) {
+        while ( *inflight > 0 && io_uring_wait_cqe(uring, &cqe) == 0 ) {
+            error |= DVDUringComplete(ring, cqe);
+            (*inflight)--;
+        }
+        if (io_uring_register_files_update(uring, 0, &extent->streamout, 1) != 1) {
+            fprintf(stderr, "Error registering %s with io_uring\n",
+                    extent->targetname);
+            slot->failed  = 1;
+            slot->written = 1;
+            return(1);
+        }
+        ring->pool->uring_fd = extent->streamout;
+    }
+
+    if ( extent->direct ) {
+        tail = DVDDirectSplit(position, slot->blocks * 2048, &head, &body);
+        error |= DVDWriteBuffered(extent, slot->data, head, position);
+        error |= DVDWriteBuffered(extent, slot->data + head + body, tail,
+                                  position + head + body);
+        if ( error ) {
+            fprintf(stderr, "Error writing %s\n", extent->targetname);
+            slot->failed = 1;
+        }
+    }
+
+    slot->queued  = body;
+    slot->written = 0;
+    if ( body == 0 ) {
+        slot->written = 1;
+        return(error);
+    }
+
+    sqe = io_uring_get_sqe(uring);
+    if ( slot->mapped ) {
+        io_uring_prep_write(sqe, 0, slot->data + head, body, position + head);
+    } else {
+        io_uring_prep_write_fixed(sqe, 0, slot->data + head, body,
+                                  position + head, index);
+    }
+    sqe->flags |= IOSQE_FIXED_FILE;
+    io_uring_sqe_set_data(sqe, (void *)(long)index);
+    if (io_uring_submit(uring) != 1) {
+        fprintf(stderr, "Error queueing write to %s\n", extent->targetname);
+        slot->failed  = 1;
+        slot->written = 1;
+        return(1);
+    }
+    COUNT(uring_submissions);
+    (*inflight)++;
+    slot->started = DVDClock();
+
+    return(error);
+}
+
+static int
+DVDRingWriteUring (copy_ring_t *ring)
+{
+    struct io_uring     *uring = &ring->pool->uring;
+    struct io_uring_cqe *cqe;
+    int                  none     = -1;
+    int                  submit   = 0;
+    int                  queued   = 0;
+    int                  inflight = 0;
+    int                  error    = 0;
+
+    /* Slots from tail up to submit are queued on the ring, slots from
+       submit up to head are filled and waiting to be queued */
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        while ( ring->count == queued && inflight == 0 && !ring->done ) {
+            pthread_cond_wait(&ring->filled, &ring->lock);
+        }
+
+        if ( ring->count > queued && !error ) {
+            pthread_mutex_unlock(&ring->lock);
+
+            DVDSumSlot(ring, &ring->slot[submit]);
+            error |= DVDUringQueue(ring, &ring->slot[submit], submit, &inflight);
+            submit = (submit + 1) % ring->depth;
+            queued++;
+
+            /* Reap whatever finished meanwhile without blocking */
+            while ( inflight > 0 && io_uring_peek_cqe(uring, &cqe) == 0 ) {
+                error |= DVDUringComplete(ring, cqe);
+                inflight--;
+            }
+        } else if ( inflight > 0 ) {
+            pthread_mutex_unlock(&ring->lock);
+
+            if (io_uring_wait_cqe(uring, &cqe) == 0) {
+                error |= DVDUringComplete(ring, cqe);
+                inflight--;
+            }
+        } else {
+            break;
+        }
+
+        /* Completions arrive in any order, buffers go back to the
+           reader in ring order */
+        pthread_mutex_lock(&ring->lock);
+        while ( queued > 0 && ring->slot[ring->tail].written ) {
+            ring->slot[ring->tail].written = 0;
+            DVDSlotDone(ring, &ring->slot[ring->tail]);
+            ring->tail = (ring->tail + 1) % ring->depth;
+            ring->count--;
+            queued--;
+            pthread_cond_signal(&ring->emptied);
+        }
+        if ( error && !ring->error ) {
+            ring->error = 1;
+            pthread_cond_signal(&ring->emptied);
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+
+    /* Don't keep the last target open through the fixed file table */
+    io_uring_register_files_update(uring, 0, &none, 1);
+    ring->pool->uring_fd = -1;
+
+    return(error || ring->error);
+}
+#endif
+
+/* Writers shared by every source of a batch run */
+static write_pool_t *write_pool = NULL;
+
+/* The batch job the calling thread works for, if any */
+static __thread batch_job_t *current_job = NULL;
+
+/* The journal of the backup the calling thread works on, if any */
+static __thread journal_t *current_journal = NULL;
+
+/* The manifest of that backup, if any */
+static __thread manifest_t *current_manifest = NULL;
+
+/* Where --recover lists unreadable sectors, if anywhere */
+static __thread bad_map_t *current_bad_map = NULL;
+
+/* Open the image for the file targetname names and find where in it
+   the file goes. The image was laid out for the DVD, so every file of
+   it has its place */
+static int
+DVDImageOpen (char *targetname, off_t *image_offset)
+{
+    image_file_t *file;
+    char         *name;
+    int           fd;
+
+    name = strrchr(targetname, '/');
+    name = (name == NULL ? targetname : name + 1);
+    if ((file = ImageFindFile(current_image, name)) == NULL) {
+        fprintf(stderr, "%s has no place in %s\n", name, current_image->path);
+        return(-1);
+    }
+    if ((fd = open(current_image->path, O_WRONLY)) == -1) {
+        fprintf(stderr, "Error opening %s\n", current_image->path);
+        perror("");
+        return(-1);
+    }
+    *image_offset = (off_t)file->sector * IMAGE_BLOCK_LEN;
+    return(fd);
+}
+
+static void *
+DVDPoolWriter (void *arg)
+{
+    write_pool_t *pool = (write_pool_t *)arg;
+    ring_slot_t  *slot;
+    copy_ring_t  *ring;
+    int           result;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while ( pool->first == NULL && !pool->stop ) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        if ( pool->first == NULL ) {
+            break;
+        }
+        slot = pool->first;
+        pool->first = slot->next;
+        if ( pool->first == NULL ) {
+            pool->last = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        ring   = slot->ring;
+        result = DVDWriteSlot(ring, slot);
+
+        pthread_mutex_lock(&ring->lock);
+        if ( result != 0 ) {
+            fprintf(stderr, "Error writing %s\n",
+                    ring->extent[slot->extent].targetname);
+            ring->error  = 1;
+            slot->failed = 1;
+            pthread_cond_signal(&ring->emptied);
+        }
+        slot->written = 1;
+        pthread_cond_signal(&ring->filled);
+        pthread_mutex_unlock(&ring->lock);
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    DVDFreeCopyPool();
+
+    return(NULL);
+}
+
+int
+DVDStartWritePool (int writers)
+{
+    int i;
+
+    if ((write_pool = (write_pool_t *)calloc(1, sizeof(write_pool_t))) == NULL
+        || (write_pool->writer = (pthread_t *)malloc(writers * sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, "Out of memory starting %d writers\n", writers);
+        free(write_pool);
+        write_pool = NULL;
+        return(1);
+    }
+
+    pthread_mutex_init(&write_pool->lock, NULL);
+    pthread_cond_init(&write_pool->queued, NULL);
+
+    for ( i = 0; i < writers; i++ ) {
+        if (pthread_create(&write_pool->writer[i], NULL, DVDPoolWriter, write_pool) != 0) {
+            break;
+        }
+    }
+    write_pool->writers = i;
+
+    if ( i == 0 ) {
+        fprintf(stderr, "Failed creating writer threads\n");
+        DVDStopWritePool();
+        return(1);
+    }
+    return(0);
+}
+
+void
+DVDStopWritePool (void)
+{
+    int i;
+
+    if (write_pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&write_pool->lock);
+    write_pool->stop = 1;
+    pthread_cond_broadcast(&write_pool->queued);
+    pthread_mutex_unlock(&write_pool->lock);
+
+    for ( i = 0; i < write_pool->writers; i++ ) {
+        pthread_join(write_pool->writer[i], NULL);
+    }
+
+    pthread_cond_destroy(&write_pool->queued);
+    pthread_mutex_destroy(&write_pool->lock);
+    free(write_pool->writer);
+    free(write_pool);
+    write_pool = NULL;
+}
+
+static int
+DVDRingWritePool (copy_ring_t *ring)
+{
+    ring_slot_t *slot;
+    int          queued = 0;
+    int          result;
+
+    /* Slots from tail on are handed to the writers in order, any writer
+       may finish first but buffers go back to the reader in ring order */
+    pthread_mutex_lock(&ring->lock);
+    for (;;) {
+        while ( queued > 0 && ring->slot[ring->tail].written ) {
+            slot = &ring->slot[ring->tail];
+            slot->written = 0;
+            DVDSlotDone(ring, slot);
+            ring->tail = (ring->tail + 1) % ring->depth;
+            ring->count--;
+            queued--;
+            pthread_cond_signal(&ring->emptied);
+        }
+
+        if ( ring->count > queued && !ring->error ) {
+            slot = &ring->slot[(ring->tail + queued) % ring->depth];
+
+            /* The slot is ours until it is queued */
+            pthread_mutex_unlock(&ring->lock);
+            DVDSumSlot(ring, slot);
+            pthread_mutex_lock(&ring->lock);
+
+            slot->ring    = ring;
+            slot->next    = NULL;
+            slot->written = 0;
+            queued++;
+
+            pthread_mutex_lock(&write_pool->lock);
+            if ( write_pool->last == NULL ) {
+                write_pool->first = slot;
+            } else {
+                write_pool->last->next = slot;
+            }
+            write_pool->last = slot;
+            pthread_cond_signal(&write_pool->queued);
+            pthread_mutex_unlock(&write_pool->lock);
+            continue;
+        }
+
+        /* Nothing may be left with the writers on the way out */
+        if ( queued == 0 && (ring->done || ring->error) ) {
+            break;
+        }
+        pthread_cond_wait(&ring->filled, &ring->lock);
+    }
+    result = ring->error;
+    pthread_mutex_unlock(&ring->lock);
+
+    return(result);
+}
+
+/* Chain up extents of different targets that copy the same sectors,
+   they are read once for all of them. Returns the number of copies */
+static int
+DVDShareExtents (copy_extent_t extent[], int extents)
+{
+    /* Loop variables */
+    int i, j;
+
+    int copies = 0;
+
+    for ( i = 0; i < extents; i++ ) {
+        extent[i].next_copy = -1;
+        extent[i].copy      = 0;
+        for ( j = 0; j < i; j++ ) {
+            if ( !extent[j].copy && extent[i].size > 0
+                 && extent[j].title_set == extent[i].title_set
+                 && extent[j].domain == extent[i].domain
+                 && extent[j].offset == extent[i].offset
+                 && extent[j].size == extent[i].size ) {
+                break;
+            }
+        }
+        if ( j < i ) {
+            while ( extent[j].next_copy != -1 ) {
+                j = extent[j].next_copy;
+            }
+            extent[j].next_copy = i;
+            extent[i].copy      = 1;
+            copies++;
+        }
+    }
+    return(copies);
+}
+
+int
+DVDCopyExtents (dvd_reader_t *dvd, copy_extent_t extent[], int extents)
+{
+    copy_ring_t    ring;
+    ring_slot_t   *slot;
+    pthread_t      reader;
+    copy_extent_t *all     = extent;
+    int            all_extents = extents;
+    copy_extent_t *left    = NULL;
+    copy_extent_t *missing = NULL;
+    int            filled;
+    int            copies;
+    int            result = 0;
+
+    memset(&ring, 0, sizeof(ring));
+    ring.dvd         = dvd;
+    ring.job         = current_job;
+    ring.journal     = current_journal;
+    ring.mark_extent = -1;
+    ring.bad_map     = current_bad_map;
+    ring.bad_extent  = -1;
+    ring.source      = current_source;
+    /* What --incremental compares and --checksum sums has to be read
+       anyway */
+    ring.clone       = (clone_source && !incremental && current_manifest == NULL);
+    ring.reflink     = 1;
+    ring.clone_extent = -1;
+    ring.cloned      = NULL;
+    ring.clones      = 0;
+    ring.map         = current_map;
+
+    if ((ring.pool = DVDGetCopyPool()) == NULL) {
+        fprintf(stderr, "Out of memory allocating %d read buffers\n", ring_depth);
+        return(1);
+    }
+    if ( DVDPrepareExtents(all, all_extents, current_manifest) != 0 ) {
+        DVDReleaseExtents(all, all_extents);
+        return(1);
+    }
+
+    /* A file the journal has in full still goes in the manifest */
+    if ( ring.journal != NULL && ring.journal->ranges > 0 ) {
+        if ((extents = DVDJournalSkip(ring.journal, extent, extents, &left)) == -1) {
+            fprintf(stderr, "Out of memory reading the journal\n");
+            DVDReleaseExtents(all, all_extents);
+            return(1);
+        }
+        extent = left;
+    }
+
+    /* A rescue pass only reads what is still missing */
+    if ( rescue ) {
+        if ((extents = DVDRescueSkip(extent, extents, &missing)) == -1) {
+            fprintf(stderr, "Out of memory reading the rescue maps\n");
+            DVDReleaseExtents(all, all_extents);
+            free(left);
+            return(1);
+        }
+        extent = missing;
+    }
+    if ((copies = DVDShareExtents(extent, extents)) > 0 && verbose > 1) {
+        fprintf(stderr, "%d extents copy sectors another one reads\n", copies);
+    }
+    ring.extent  = extent;
+    ring.extents = extents;
+    ring.slot  = ring.pool->slot;
+    ring.depth = ring.pool->depth;
+
+    if (ring.depth == 1) {
+
+        /* Plain serial copy, nothing to overlap */
+        slot = &ring.slot[0];
+        while ( (filled = DVDReadChunk(&ring, slot)) == 1 ) {
+            DVDSumSlot(&ring, slot);
+            if ( DVDWriteSlot(&ring, slot) != 0 ) {
+                fprintf(stderr, "Error writing %s\n",
+                        extent[slot->extent].targetname);
+                break;
+            }
+            DVDSlotDone(&ring, slot);
+        }
+        result = (filled != 0);
+
+    } else {
+
+        pthread_mutex_init(&ring.lock, NULL);
+        pthread_cond_init(&ring.filled, NULL);
+        pthread_cond_init(&ring.emptied, NULL);
+
+        if (pthread_create(&reader, NULL, DVDRingReader, &ring) != 0) {
+            fprintf(stderr, "Failed creating reader thread\n");
+            result = 1;
+        } else {
+#ifdef HAVE_LIBURING
+            if ( write_pool != NULL ) {
+                result = DVDRingWritePool(&ring);
+            } else if ( ring.pool->uring_ready && !incremental && copies == 0 ) {
+                result = DVDRingWriteUring(&ring);
+            } else {
+                result = DVDRingWritePosix(&ring);
+            }
+#else
+            if ( write_pool != NULL ) {
+                result = DVDRingWritePool(&ring);
+            } else {
+                result = DVDRingWritePosix(&ring);
+            }
+#endif
+
+            pthread_join(reader, NULL);
+        }
+
+        pthread_cond_destroy(&ring.emptied);
+        pthread_cond_destroy(&ring.filled);
+        pthread_mutex_destroy(&ring.lock);
+    }
+
+    if ( ring.dvd_file != NULL ) {
+        DVDCloseFile(ring.dvd_file);
+    }
+    DVDSourceClose(&ring);
+    free(ring.cloned);
+    DVDBadFlush(&ring);
+    /* What made it to disk is kept even if the copy failed */
+    if ( ring.journal != NULL ) {
+        DVDJournalCommit(&ring);
+    }
+
+    if ( result == 0 ) {
+        result = DVDFinishExtents(all, all_extents);
+    }
+    if ( result == 0 && recover ) {
+        result = DVDRescueFinish(extent, extents, all, all_extents);
+    }
+    DVDReleaseExtents(all, all_extents);
+    free(missing);
+    free(left);
+
+    return(result);
+}
+
+/* A VOB hard linked into the --dedup store is shared with other
+   backups, it gets an inode of its own before anything is written to
+   it. What it holds is kept if the copy only fills in part of it */
+static int
+DVDUnshareFile (char *targetname, int keep)
+{
+    struct stat fileinfo;
+    char        temp[PATH_MAX + 16];
+    int         from, to;
+    ssize_t     copied;
+    int         result = 0;
+#ifndef __linux__
+    char        buffer[65536];
+#endif
+
+    if (stat(targetname, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)
+        || fileinfo.st_nlink < 2) {
+        return(0);
+    }
+    if (!keep) {
+        return(unlink(targetname) != 0);
+    }
+
+    snprintf(temp, sizeof(temp), "%s.unshare", targetname);
+    if ((from = open(targetname, O_RDONLY)) == -1) {
+        return(1);
+    }
+    if ((to = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        close(from);
+        return(1);
+    }
+#ifdef __linux__
+    while ((copied = copy_file_range(from, NULL, to, NULL, 1024 * 1024 * 1024, 0)) > 0) {
+    }
+#else
+    while ((copied = read(from, buffer, sizeof(buffer))) > 0
+           && write(to, buffer, copied) == copied) {
+    }
+#endif
+    if (copied != 0 || close(to) != 0 || rename(temp, targetname) != 0) {
+        unlink(temp);
+        result = 1;
+    }
+    close(from);
+    return(result);
+}
+
+/* Open a vob for cells written at their own offsets and give it the
+   size of the original. A file of any other size was written by an
+   appending backup, its contents are in the wrong places */
+static int
+DVDOpenSparseVob (char *targetname, int sectors, int *streamout)
+{
+    struct stat fileinfo;
+
+    if (DVDUnshareFile(targetname, 1) != 0
+        || (*streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
+        fprintf(stderr, "Error creating %s\n", targetname);
+        perror("");
+        return(1);
+    }
+
+    if (fstat(*streamout, &fileinfo) == 0
+        && fileinfo.st_size != (off_t)sectors * 2048) {
+        if (fileinfo.st_size != 0) {
+            fprintf(stderr, "%s isn't %d sectors, starting it over\n",
+                    targetname, sectors);
+        }
+        if (ftruncate(*streamout, 0) != 0
+            || ftruncate(*streamout, (off_t)sectors * 2048) != 0) {
+            fprintf(stderr, "Error sizing %s\n", targetname);
+            perror("");
+            return(1);
+        }
+    }
+
+    DVDSetDirectIO(*streamout, targetname);
+    return(0);
+}
+
+/* Reserve the blocks a cell is about to fill, so it lands in one piece
+   while the holes around it stay free */
+static void
+DVDAllocateExtent (copy_extent_t *extent)
+{
+#ifdef __linux__
+    if (fallocate(extent->streamout, FALLOC_FL_KEEP_SIZE,
+                  (off_t)extent->target_offset * 2048,
+                  (off_t)extent->size * 2048) != 0 && verbose > 1) {
+        fprintf(stderr, "Can't preallocate %s: %s\n",
+                extent->targetname, strerror(errno));
+    }
+#else
+    /* Only Linux reserves blocks without growing the file */
+    (void)extent;
+#endif
+}
+
+/* Open the VOB files of a title and work out the extents that copy
+   its cells to them. The plan is freed with DVDFreeCellPlan even if
+   this fails */
+static int
+DVDPlanCells (cell_plan_t *plan,
+              int cell_start_sector[], int cell_end_sector[],
+              int length, int titles,
+              title_set_info_t *title_set_info,
+              titles_info_t *titles_info,
+              char *targetdir, char *title_name)
+{
+    /* Loop variables */
+    int i, f;
+
+    /* Temp filename,dirname, one per VTS_XX_X.VOB, and their file
+       handlers */
+    char (*targetname)[PATH_MAX] = plan->targetname;
+    int   *streamout             = plan->streamout;
+
+    /* Sectors appended to each vob so far */
+    int written[10];
+
+    /* First sector of each vob in the title VOB domain */
+    int vob_offset[11];
+
+    int size;
+    int start;
+    int end;
+    int tsize;
+    int streamed = 0;
+    int result = 0;
+
+    /* Everything to copy, in one list */
+    copy_extent_t *extent;
+    int            extents = 0;
+
+    int title_set;
+    int number_of_vob_files;
+
+    for ( i = 0 ; i < 10 ; i++ ) {
+        streamout[i] = -1;
+    }
+    plan->extent  = NULL;
+    plan->extents = 0;
+
+#ifdef DEBUG
+    fprintf(stderr,"DVDWriteCells: length is %d\n", length);
+#endif
+
+    title_set = titles_info->titles[titles - 1].title_set;
+    number_of_vob_files = title_set_info->title_set[title_set].number_of_vob_files;
+#ifdef DEBUG
+    fprintf(stderr,"DVDWriteCells: title set is %d\n", title_set);
+    fprintf(stderr,"DVDWriteCells: vob files are %d\n", number_of_vob_files);
+#endif
+
+    if (title_set == 0) {
+        fprintf(stderr,
+                "Don't try to copy chapters from the VMG domain there aren't any\n");
+        return(1);
+    }
+
+    /* Figure out where each vob starts */
+    vob_offset[0] = 0;
+    for ( i = 0; i < number_of_vob_files ; i++ ) {
+        tsize = title_set_info->title_set[title_set].size_vob[i];
+        if (tsize%2048 != 0) {
+            fprintf(stderr, "The Title VOB number %d of title set %d "
+                    "doesn't have a valid DVD size\n", i + 1, title_set);
+            return(1);
+        }
+        vob_offset[i + 1] = vob_offset[i] + tsize/2048;
+#ifdef DEBUG
+        fprintf(stderr,"DVDWriteCells: vob %d is sectors %d to %d\n",
+                i + 1, vob_offset[i], vob_offset[i + 1] - 1);
+#endif
+    }
+
+    /* Remove all old files silently if they exists, unless the cells
+       go to their own offsets. Then cells already there stay and more
+       can be added later */
+
+    for ( i = 0 ; i < 10 ; i++ ) {
+        sprintf(targetname[i],"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",targetdir,
+                title_name, title_set, i + 1);
+#ifdef DEBUG
+        fprintf(stderr,"DVDWriteCells: file is %s\n", targetname[i]);
+#endif
+        if ( !sparse && stream_fd == -1 ) {
+            unlink(targetname[i]);
+        }
+        streamout[i] = -1;
+        written[i] = 0;
+    }
+
+    /* Every vob gets its original size, the sectors not copied are
+       holes */
+    for ( i = 0 ; i < number_of_vob_files && sparse ; i++ ) {
+        if ( DVDOpenSparseVob(targetname[i], vob_offset[i + 1] - vob_offset[i],
+                              &streamout[i]) != 0 ) {
+            result = 1;
+            break;
+        }
+    }
+
+    /* A cell is split at every vob boundary it crosses */
+    if ((extent = (copy_extent_t *)malloc(length * (number_of_vob_files + 1)
+                                          * sizeof(copy_extent_t))) == NULL) {
+        fprintf(stderr, "Out of memory coping title %d\n", titles);
+        return(1);
+    }
+    plan->extent = extent;
+
+    for (f = 0; f < length && result == 0 ; f++) {
+
+        start = cell_start_sector[f];
+        end   = cell_end_sector[f];
+
+        while ( start <= end ) {
+
+            /* Find out which vob this part of the cell is in */
+            for ( i = 0; i < number_of_vob_files ; i++ ) {
+                if ( vob_offset[i] <= start && vob_offset[i + 1] > start ) {
+                    break;
+                }
+            }
+            if ( i == number_of_vob_files ) {
+                fprintf(stderr, "Cell sectors %d to %d are outside the "
+                        "title VOBs of title set %d\n", start, end, title_set);
+                result = 1;
+                break;
+            }
+
+            size = end - start + 1;
+            if ( start + size > vob_offset[i + 1] ) {
+                size = vob_offset[i + 1] - start;
+            }
+
+            /* Create VTS_XX_X.VOB */
+            if ( streamout[i] == -1 && !sparse && stream_fd == -1 ) {
+                if ((streamout[i] = open(targetname[i], O_WRONLY | O_CREAT, 0644)) == -1) {
+                    fprintf(stderr, "Error creating %s\n", targetname[i]);
+                    perror("");
+                    result = 1;
+                    break;
+                }
+                DVDSetDirectIO(streamout[i], targetname[i]);
+            }
+
+#ifdef DEBUG
+            fprintf(stderr,"DVDWriteCells: sectors %d to %d go to vob %d at %d\n",
+                    start, start + size - 1, i + 1, written[i]);
+#endif
+
+            extent[extents].title_set     = title_set;
+            extent[extents].domain        = DVD_READ_TITLE_VOBS;
+            extent[extents].offset        = start;
+            extent[extents].size          = size;
+            extent[extents].streamout     = streamout[i];
+            extent[extents].targetname    = targetname[i];
+            extent[extents].target_offset = written[i];
+            extent[extents].image_offset  = 0;
+            if ( sparse ) {
+                extent[extents].target_offset = start - vob_offset[i];
+                DVDAllocateExtent(&extent[extents]);
+            }
+            if ( stream_fd != -1 ) {
+                /* One program stream, cell after cell */
+                extent[extents].streamout     = stream_fd;
+                extent[extents].targetname    = targetdir;
+                extent[extents].target_offset = streamed;
+                streamed = streamed + size;
+            }
+            extents++;
+            plan->extents = extents;
+
+            written[i] = written[i] + size;
+            start = start + size;
+        }
+    }
+
+    return(result);
+}
+
+static void
+DVDFreeCellPlan (cell_plan_t *plan)
+{
+    /* Loop variable */
+    int i;
+
+    for ( i = 0 ; i < 10 ; i++ ) {
+        if ( plan->streamout[i] != -1 ) {
+            close(plan->streamout[i]);
+        }
+    }
+    free(plan->extent);
+}
+
+int
+DVDWriteCells (dvd_reader_t *dvd,
+               int cell_start_sector[], int cell_end_sector[],
+               int length, int titles,
+               title_set_info_t *title_set_info,
+               titles_info_t *titles_info,
+               char *targetdir, char *title_name)
+{
+    cell_plan_t plan;
+    int         result;
+
+    result = DVDPlanCells(&plan, cell_start_sector, cell_end_sector, length, titles,
+                          title_set_info, titles_info, targetdir, title_name);
+    if ( result == 0 ) {
+        result = DVDCopyExtents(dvd, plan.extent, plan.extents);
+    }
+    DVDFreeCellPlan(&plan);
+
+    return(result);
+}
+
+/* Playback time in seconds, dvd_time_t is BCD coded */
+static int
+DVDTimeToSeconds (dvd_time_t *time)
+{
+    return(((time->hour >> 4) * 10 + (time->hour & 0x0f)) * 3600
+           + ((time->minute >> 4) * 10 + (time->minute & 0x0f)) * 60
+           + (time->second >> 4) * 10 + (time->second & 0x0f));
+}
+
+static int
+CompareFeatureScores (const void *a, const void *b)
+{
+    const feature_score_t *score_a = (const feature_score_t *)a;
+    const feature_score_t *score_b = (const feature_score_t *)b;
+
+    if (score_a->score != score_b->score) {
+        return(score_a->score < score_b->score ? 1 : -1);
+    }
+    return(score_a->title - score_b->title);
+}
+
+/* Add up the playback time and cells of every PGC a title plays,
+   straight from its VTS IFO */
+static void
+DVDScoreTitle (disc_info_t *disc, titles_t *title, feature_score_t *score)
+{
+    /* Loop variables */
+    int i, c;
+
+    ifo_handle_t  *vts_ifo;
+    ttu_t         *ttu;
+    pgc_t         *pgc;
+    unsigned char *counted;
+    int            pgcn;
+    int            seconds;
+
+    memset(score, 0, sizeof(feature_score_t));
+    score->title         = title->title;
+    score->title_set     = title->title_set;
+    score->audio_streams = title->audio_tracks;
+    score->sub_pictures  = title->sub_pictures;
+    score->channels      = title->audio_channels;
+    score->aspect_match  = (title->aspect_ratio == aspect);
+
+    vts_ifo = DVDGetVTSInfo(disc, title->title_set);
+    if ( vts_ifo != NULL && vts_ifo->vts_ptt_srpt != NULL && vts_ifo->vts_pgcit != NULL
+         && title->vts_title >= 1
+         && title->vts_title <= vts_ifo->vts_ptt_srpt->nr_of_srpts
+         && (counted = (unsigned char *)calloc(vts_ifo->vts_pgcit->nr_of_pgci_srp + 1, 1)) != NULL) {
+
+        /* Chapters may spread over several PGCs, count each one once */
+        ttu = &vts_ifo->vts_ptt_srpt->title[title->vts_title - 1];
+        for ( i = 0; i < ttu->nr_of_ptts; i++ ) {
+            pgcn = ttu->ptt[i].pgcn;
+            if ( pgcn < 1 || pgcn > vts_ifo->vts_pgcit->nr_of_pgci_srp || counted[pgcn] ) {
+                continue;
+            }
+            counted[pgcn] = 1;
+            pgc = vts_ifo->vts_pgcit->pgci_srp[pgcn - 1].pgc;
+
+            seconds = DVDTimeToSeconds(&pgc->playback_time);
+            if ( seconds == 0 ) {
+                for ( c = 0; c < pgc->nr_of_cells; c++ ) {
+                    seconds = seconds + DVDTimeToSeconds(&pgc->cell_playback[c].playback_time);
+                }
+            }
+            score->seconds = score->seconds + seconds;
+            score->cells   = score->cells + pgc->nr_of_cells;
+            score->pgcs++;
+        }
+        free(counted);
+    } else {
+        fprintf(stderr, "Can't read the PGCs of title %d, scoring it by "
+                "its streams only\n", title->title);
+    }
+
+    score->score = (long)score->seconds * SCORE_SECOND
+        + (score->cells < SCORE_MAX_CELLS ? score->cells : SCORE_MAX_CELLS) * SCORE_CELL
+        + score->audio_streams * SCORE_AUDIO
+        + score->sub_pictures * SCORE_SUBPICTURE
+        + score->channels * SCORE_CHANNEL
+        + score->aspect_match * SCORE_ASPECT;
+}
+
+titles_info_t*
+DVDGetInfo (disc_info_t *disc)
+{
+    /* title interation */
+    int counter, i, f;
+
+    int titles;
+    int title_sets;
+    int channels;
+
+    /*DVD handlers*/
+    ifo_handle_t    *vmg_ifo     = disc->vmg_ifo;
+    titles_info_t   *titles_info = NULL;
+    feature_score_t *score;
+
+    if ((vmg_ifo->tt_srpt == 0) || (vmg_ifo->vts_atrt == 0)) {
+        return(0);
+    }
+
+    titles = vmg_ifo->tt_srpt->nr_of_srpts;
+    title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+
+    if ( titles < 1 ) {
+        fprintf(stderr, "There are no titles on this DVD\n");
+        return(0);
+    }
+
+    /* Todo fix malloc check */
+    titles_info = ( titles_info_t *)malloc(sizeof(titles_info_t));
+    titles_info->titles = (titles_t *)calloc(titles, sizeof(titles_t));
+
+    titles_info->number_of_titles = titles;
+
+    /* Interate over the titles nr_of_srpts */
+
+    for (counter=0; counter < titles; counter++ )  {
+        titles_info->titles[counter].title = counter + 1;
+        titles_info->titles[counter].title_set = vmg_ifo->tt_srpt->title[counter].title_set_nr;
+        titles_info->titles[counter].vts_title = vmg_ifo->tt_srpt->title[counter].vts_ttn;
+        titles_info->titles[counter].chapters = vmg_ifo->tt_srpt->title[counter].nr_of_ptts;
+        titles_info->titles[counter].angles = vmg_ifo->tt_srpt->title[counter].nr_of_angles;
+    }
+
+    /* Interate over vmg_nr_of_title_sets */
+
+    for (counter=0; counter < title_sets ; counter++ )  {
+
+        channels=0;
+        for  (i=0; i < vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams; i++) {
+            if ( channels < vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1) {
+                channels = vmg_ifo->vts_atrt->vts[counter].vtstt_audio_attr[i].channels + 1;
+            }
+        }
+
+        for (f=0; f < titles_info->number_of_titles ; f++ ) {
+            if ( titles_info->titles[f].title_set == counter + 1 ) {
+                titles_info->titles[f].aspect_ratio =
+                    vmg_ifo->vts_atrt->vts[counter].vtstt_vobs_video_attr.display_aspect_ratio;
+                titles_info->titles[f].sub_pictures =
+                    vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_subp_streams;
+                titles_info->titles[f].audio_tracks =
+                    vmg_ifo->vts_atrt->vts[counter].nr_of_vtstt_audio_streams;
+                titles_info->titles[f].audio_channels = channels;
+            }
+        }
+    }
+
+    /* The main feature is the title that plays longest. Cells and
+       streams only tip the balance between titles of about the same
+       length, and the aspect ratio asked for with -a between two
+       versions of the same film */
+
+    if ((score = (feature_score_t *)malloc(titles * sizeof(feature_score_t))) == NULL) {
+        fprintf(stderr, "Out of memory scoring the titles\n");
+        DVDFreeTitlesInfo(titles_info);
+        return(0);
+    }
+
+    for (counter=0; counter < titles; counter++ )  {
+        DVDScoreTitle(disc, &titles_info->titles[counter], &score[counter]);
+    }
+
+    qsort(score, titles, sizeof(feature_score_t), CompareFeatureScores);
+
+    if ( verbose > 0 ) {
+        fprintf(stderr, "\nMain feature scores:\n");
+        for (i=0; i < titles; i++ ) {
+            fprintf(stderr, "Title %d (title set %d): %d:%02d:%02d in %d PGC(s), "
+                    "%d cells, %d audio, %d subpicture, %d channels%s = %ld\n",
+                    score[i].title, score[i].title_set,
+                    score[i].seconds / 3600, score[i].seconds / 60 % 60,
+                    score[i].seconds % 60, score[i].pgcs, score[i].cells,
+                    score[i].audio_streams, score[i].sub_pictures,
+                    score[i].channels,
+                    score[i].aspect_match ? ", preferred aspect" : "",
+                    score[i].score);
+            if ( verbose > 1 ) {
+                fprintf(stderr, "\ttime %ld + cells %ld + audio %ld + subpicture %ld "
+                        "+ channels %ld + aspect %ld\n",
+                        (long)score[i].seconds * SCORE_SECOND,
+                        (long)(score[i].cells < SCORE_MAX_CELLS
+                               ? score[i].cells : SCORE_MAX_CELLS) * SCORE_CELL,
+                        (long)score[i].audio_streams * SCORE_AUDIO,
+                        (long)score[i].sub_pictures * SCORE_SUBPICTURE,
+                        (long)score[i].channels * SCORE_CHANNEL,
+                        (long)score[i].aspect_match * SCORE_ASPECT);
+            }
+        }
+    }
+
+    titles_info->main_title_set = score[0].title_set;
+    free(score);
+
+    return(titles_info);
+}
+
+/* The parts of extent some PGC plays, the whole of it without ranges.
+   There is always at least one, empty if nothing is played, so the
+   file still goes through the copy. Returns how many, -1 if out of
+   memory, the caller frees *played */
+static int
+DVDPlayableExtents (copy_extent_t *extent, sector_range_t *range, int ranges,
+                    copy_extent_t **played)
+{
+    /* Loop variable */
+    int i;
+
+    copy_extent_t *part;
+    int            parts = 0;
+    int            start, end;
+
+    if ((part = (copy_extent_t *)malloc((ranges + 1) * sizeof(copy_extent_t))) == NULL) {
+        return(-1);
+    }
+    *played = part;
+
+    if (range == NULL) {
+        part[0] = *extent;
+        return(1);
+    }
+
+    for (i = 0; i < ranges; i++) {
+        start = (range[i].start > extent->offset ? range[i].start : extent->offset);
+        end   = (range[i].end < extent->offset + extent->size
+                 ? range[i].end : extent->offset + extent->size);
+        if (start < end) {
+            part[parts] = *extent;
+            part[parts].offset        = start;
+            part[parts].size          = end - start;
+            part[parts].target_offset = extent->target_offset + start - extent->offset;
+            parts++;
+        }
+    }
+    if (parts == 0) {
+        part[0] = *extent;
+        part[0].size = 0;
+        parts = 1;
+    }
+    return(parts);
+}
+
+static int
+DVDCopyTileVobXFile (dvd_reader_t *dvd,
+                     title_set_info_t *title_set_info,
+                     int title_set, int vob,
+                     char *targetdir, char *title_name)
+{
+    /* Loop variable */
+    int i;
+
+    /* Temp filename,dirname */
+    char        targetname[PATH_MAX];
+    struct stat fileinfo;
+
+    /* File Handler, and where the file starts in an --image */
+    int   streamout;
+    off_t image_offset = 0;
+
+    int size;
+    int offset = 0;
+    int tsize;
+
+    /* Sectors to copy, and the ones of them some PGC plays */
+    copy_extent_t  extent;
+    copy_extent_t *played;
+    int            extents;
+
+    if (title_set_info->number_of_title_sets + 1 < title_set) {
+        fprintf(stderr,"Failed num title test\n");
+        return(1);
+    }
+
+    if (title_set_info->title_set[title_set].number_of_vob_files < vob ) {
+        fprintf(stderr,"Failed vob test\n");
+        return(1);
+    }
+
+    if (title_set_info->title_set[title_set].size_vob[0] == 0 ) {
+        fprintf(stderr,"Failed vob 1 size test\n");
+        return(0);
+    } else if (title_set_info->title_set[title_set].size_vob[vob - 1] == 0 ) {
+        fprintf(stderr,"Failed vob %d test\n", vob);
+        return(0);
+    } else {
+        size = title_set_info->title_set[title_set].size_vob[vob - 1]/2048;
+        if (title_set_info->title_set[title_set].size_vob[vob - 1]%2048 != 0) {
+            fprintf(stderr, "The Title VOB number %d of title set %d "
+                    "doesn't have a valid DVD size\n", vob, title_set);
+            return(1);
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr,"After we check the vob it self %d\n", vob);
+#endif
+
+    /* Create VTS_XX_X.VOB */
+    if (title_set == 0) {
+        fprintf(stderr,"Don't try to copy a Title VOB from "
+                "the VMG domain there aren't any\n");
+        return(1);
+    } else {
+        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_%i.VOB",
+                targetdir, title_name, title_set, vob);
+    }
+
+    /* Now figure out the offset we will start at also check that the
+       previus files are of valid DVD size */
+    for ( i = 0; i < vob - 1; i++ ) {
+        tsize = title_set_info->title_set[title_set].size_vob[i];
+        if (tsize%2048 != 0) {
+            fprintf(stderr, "The Title VOB number %d of title set %d "
+                    "doesn't have a valid DVD size\n", i + 1, title_set);
+            return(1);
+        } else {
+            offset = offset + tsize/2048;
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr,"The offset for vob %d is %d\n", vob, offset);
+#endif
+
+    if (DVDUnshareFile(targetname, resume || incremental || rescue) != 0) {
+        fprintf(stderr, "Error unsharing %s from the store\n", targetname);
+        perror("");
+        return(1);
+    }
+
+    if (current_image != NULL) {
+        if ((streamout = DVDImageOpen(targetname, &image_offset)) == -1) {
+            return(1);
+        }
+    } else if (stat(targetname, &fileinfo) == 0) {
+        if ( !resume && !incremental && !rescue ) {
+            fprintf(stderr, "The Title file %s exists will try to over write it.\n",
+                    targetname);
+        }
+        if (! S_ISREG(fileinfo.st_mode)) {
+            fprintf(stderr,"The Title %s file is not valid, it may be a directory\n",
+                    targetname);
+            return(1);
+        } else {
+            /* When resuming the journal tells which sectors to keep,
+               an incremental backup compares them with the DVD */
+            if ((streamout = open(targetname, O_WRONLY
+                                  | (resume || incremental || rescue ? 0 : O_TRUNC),
+                                  0644)) == -1
+                || ((resume || incremental || rescue) && fileinfo.st_size > (off_t)size * 2048
+                    && ftruncate(streamout, (off_t)size * 2048) != 0)) {
+                fprintf(stderr, "Error opening %s\n", targetname);
+                perror("");
+                return(1);
+            }
+        }
+    } else {
+        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
+            fprintf(stderr, "Error creating %s\n", targetname);
+            perror("");
+            return(1);
+        }
+    }
+
+    /* What isn't played stays a hole of the original size */
+    if ( playable && current_image == NULL
+         && ftruncate(streamout, (off_t)size * 2048) != 0 ) {
+        fprintf(stderr, "Error sizing %s\n", targetname);
+        perror("");
+        close(streamout);
+        return(1);
+    }
+
+    DVDSetDirectIO(streamout, targetname);
+
+    extent.title_set     = title_set;
+    extent.domain        = DVD_READ_TITLE_VOBS;
+    extent.offset        = offset;
+    extent.size          = size;
+    extent.streamout     = streamout;
+    extent.targetname    = targetname;
+    extent.target_offset = 0;
+    extent.image_offset  = image_offset;
+
+    if ((extents = DVDPlayableExtents(&extent,
+                                      title_set_info->title_set[title_set].title_played,
+                                      title_set_info->title_set[title_set].title_ranges,
+                                      &played)) == -1) {
+        fprintf(stderr, "Out of memory copying %s\n", targetname);
+        close(streamout);
+        return(1);
+    }
+    if ( DVDCopyExtents(dvd, played, extents) != 0 ) {
+        free(played);
+        close(streamout);
+        return(1);
+    }
+
+    free(played);
+    close(streamout);
+    return(0);
+}
+
+int
+DVDCopyTileVobX (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+                 int title_set, int vob, char *targetdir, char *title_name)
+{
+    phase_t phase;
+    int     result;
+
+    DVDPhaseStart(&phase);
+    result = DVDCopyTileVobXFile(dvd, title_set_info, title_set, vob,
+                                 targetdir, title_name);
+    DVDPhaseEnd(&phase, "DVDCopyTileVobX");
+    return(result);
+}
+
+static int
+DVDCopyMenuFile (dvd_reader_t *dvd,
+                 title_set_info_t *title_set_info,
+                 int title_set,
+                 char *targetdir, char *title_name)
+{
+
+    /* Temp filename,dirname */
+    char        targetname[PATH_MAX];
+    struct stat fileinfo;
+
+    /* File Handler, and where the file starts in an --image */
+    int   streamout;
+    off_t image_offset = 0;
+
+    int size;
+    int offset = 0;
+
+    /* Sectors to copy, and the ones of them some PGC plays */
+    copy_extent_t  extent;
+    copy_extent_t *played;
+    int            extents;
+
+    if (title_set_info->number_of_title_sets + 1 < title_set) {
+        return(1);
+    }
+
+    if (title_set_info->title_set[title_set].size_menu == 0 ) {
+        return(0);
+    } else {
+        size = title_set_info->title_set[title_set].size_menu/2048;
+        if (title_set_info->title_set[title_set].size_menu%2048 != 0) {
+            fprintf(stderr, "The Menu VOB of title set %d doesn't "
+                    "have a valid DVD size\n", title_set);
+            return(1);
+        }
+    }
+
+    /* Create VIDEO_TS.VOB or VTS_XX_0.VOB */
+    if (title_set == 0) {
+        sprintf(targetname,"%s/%s/VIDEO_TS/VIDEO_TS.VOB", targetdir, title_name);
+    } else {
+        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_0.VOB",
+                targetdir, title_name, title_set);
+    }
+
+    if (DVDUnshareFile(targetname, resume || incremental || rescue) != 0) {
+        fprintf(stderr, "Error unsharing %s from the store\n", targetname);
+        perror("");
+        return(1);
+    }
+
+    if (current_image != NULL) {
+        if ((streamout = DVDImageOpen(targetname, &image_offset)) == -1) {
+            return(1);
+        }
+    } else if (stat(targetname, &fileinfo) == 0) {
+        if ( !resume && !incremental && !rescue ) {
+            fprintf(stderr, "The Menu file %s exists will try to over write it.\n",
+                    targetname);
+        }
+        if (! S_ISREG(fileinfo.st_mode)) {
+            fprintf(stderr,"The Menu %s file is not valid, it may be a directory\n",
+                    targetname);
+            return(1);
+        } else {
+            /* When resuming the journal tells which sectors to keep,
+               an incremental backup compares them with the DVD */
+            if ((streamout = open(targetname, O_WRONLY
+                                  | (resume || incremental || rescue ? 0 : O_TRUNC),
+                                  0644)) == -1
+                || ((resume || incremental || rescue) && fileinfo.st_size > (off_t)size * 2048
+                    && ftruncate(streamout, (off_t)size * 2048) != 0)) {
+                fprintf(stderr, "Error opening %s\n", targetname);
+                perror("");
+                return(1);
+            }
+        }
+    } else {
+        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
+            fprintf(stderr, "Error creating %s\n", targetname);
+            perror("");
+            return(1);
+        }
+    }
+
+    /* What isn't played stays a hole of the original size */
+    if ( playable && current_image == NULL
+         && ftruncate(streamout, (off_t)size * 2048) != 0 ) {
+        fprintf(stderr, "Error sizing %s\n", targetname);
+        perror("");
+        close(streamout);
+        return(1);
+    }
+
+    DVDSetDirectIO(streamout, targetname);
+
+    extent.title_set     = title_set;
+    extent.domain        = DVD_READ_MENU_VOBS;
+    extent.offset        = offset;
+    extent.size          = size;
+    extent.streamout     = streamout;
+    extent.targetname    = targetname;
+    extent.target_offset = 0;
+    extent.image_offset  = image_offset;
+
+    if ((extents = DVDPlayableExtents(&extent,
+                                      title_set_info->title_set[title_set].menu_played,
+                                      title_set_info->title_set[title_set].menu_ranges,
+                                      &played)) == -1) {
+        fprintf(stderr, "Out of memory copying %s\n", targetname);
+        close(streamout);
+        return(1);
+    }
+    if ( DVDCopyExtents(dvd, played, extents) != 0 ) {
+        free(played);
+        close(streamout);
+        return(1);
+    }
+
+    free(played);
+    close(streamout);
+    return(0);
+}
+
+int
+DVDCopyMenu (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+             int title_set, char *targetdir, char *title_name)
+{
+    phase_t phase;
+    int     result;
+
+    DVDPhaseStart(&phase);
+    result = DVDCopyMenuFile(dvd, title_set_info, title_set, targetdir, title_name);
+    DVDPhaseEnd(&phase, "DVDCopyMenu");
+    return(result);
+}
+
+/* Write an IFO or a BUP in one shot, at position in an --image. An
+   incremental backup leaves the file alone if it already holds the
+   same bytes */
+static int
+DVDWriteSmallFile (int streamout, unsigned char *buffer, int size, off_t position)
+{
+    unsigned char *current;
+    int            same = 0;
+    double         started;
+
+    if ( incremental ) {
+        if ((current = (unsigned char *)malloc(size + 1)) != NULL) {
+            same = (pread(streamout, current, size + 1, 0) == size
+                    && memcmp(current, buffer, size) == 0);
+            free(current);
+        }
+        if ( same ) {
+            __sync_fetch_and_add(&sectors_unchanged, size / 2048);
+            return(0);
+        }
+        __sync_fetch_and_add(&sectors_rewritten, size / 2048);
+    }
+
+    COUNT(write_calls);
+    started = DVDClock();
+    if (pwrite(streamout, buffer, size, position) != size) {
+        return(1);
+    }
+    if ( DVDStatsOn() ) {
+        DVDLatency(&stats.write, DVDClock() - started);
+    }
+    return(incremental && ftruncate(streamout, size) != 0);
+}
+
+/* IFOs and BUPs are checksummed from the buffer they were written from */
+static int
+DVDSumBuffer (char *targetname, unsigned char *buffer, int size)
+{
+    file_sum_t *sum;
+    int         result;
+
+    if (current_manifest == NULL) {
+        return(0);
+    }
+    if ((sum = DVDSumOpen(current_manifest, targetname)) == NULL) {
+        fprintf(stderr, "Out of memory checksumming %s\n", targetname);
+        return(1);
+    }
+    if ((result = DVDSumFeed(sum, buffer, size)) == 0) {
+        result = DVDSumFinish(sum);
+    }
+    DVDSumFree(sum);
+    return(result);
+}
+
+/* Copy the IFO, or with backup the BUP, of a title set. Both are small
+   enough to copy in one shot */
+static int
+DVDCopyInfoFile (dvd_reader_t *dvd,
+                 title_set_info_t *title_set_info,
+                 int title_set, int backup,
+                 char *targetdir, char *title_name)
+{
+    /* Temp filename,dirname */
+    char        targetname[PATH_MAX];
+    struct stat fileinfo;
+
+    /* Write buffer */
+
+    unsigned char *buffer = NULL;
+    unsigned char  buffy;       /* :-) */
+
+    /* File Handler, and where the file starts in an --image */
+    int   streamout;
+    off_t image_offset = 0;
+
+    int   size;
+    char *what = (backup ? "BUP" : "IFO");
+
+    /* DVD handler */
+    dvd_file_t *dvd_file = NULL;
+
+    if (title_set_info->number_of_title_sets + 1 < title_set) {
+        return(1);
+    }
+
+    size = (backup ? title_set_info->title_set[title_set].size_bup
+            : title_set_info->title_set[title_set].size_ifo);
+    if (size == 0 ) {
+        return(0);
+    } else if (size%2048 != 0) {
+        fprintf(stderr, "The %s of title set %d doesn't have a valid DVD size\n",
+                what, title_set);
+        return(1);
+    }
+
+    /* Create VIDEO_TS.IFO/BUP or VTS_XX_0.IFO/BUP */
+
+    if (title_set == 0) {
+        sprintf(targetname,"%s/%s/VIDEO_TS/VIDEO_TS.%s",targetdir, title_name, what);
+    } else {
+        sprintf(targetname,"%s/%s/VIDEO_TS/VTS_%02i_0.%s",targetdir, title_name,
+                title_set, what);
+    }
+
+    if (current_image != NULL) {
+        if ((streamout = DVDImageOpen(targetname, &image_offset)) == -1) {
+            return(1);
+        }
+    } else if (stat(targetname, &fileinfo) == 0) {
+        if ( !incremental && !rescue ) {
+            fprintf(stderr, "The %s file %s exists will try to over write it.\n",
+                    what, targetname);
+        }
+        if (! S_ISREG(fileinfo.st_mode)) {
+            fprintf(stderr,"The %s %s file is not valid, it may be a directory\n",
+                    what, targetname);
+            return(1);
+        } else {
+            if ((streamout = open(targetname, incremental ? O_RDWR
+                                  : O_WRONLY | O_TRUNC, 0644)) == -1) {
+                fprintf(stderr, "Error opening %s\n", targetname);
+                perror("");
+                return(1);
+            }
+        }
+    } else {
+        if ((streamout = open(targetname, O_WRONLY | O_CREAT, 0644)) == -1) {
+            fprintf(stderr, "Error creating %s\n", targetname);
+            perror("");
+            return(1);
+        }
+    }
+
+    if ((buffer = (unsigned char *)malloc(size * sizeof(buffy))) == NULL) {
+        fprintf(stderr, "Out of memory coping %s\n", targetname);
+        close(streamout);
+        return(1);
+    }
+
+    if ((dvd_file = DVDOpenFile(dvd, title_set, backup ? DVD_READ_INFO_BACKUP_FILE
+                                : DVD_READ_INFO_FILE))== 0) {
+        fprintf(stderr, "Failed opending %s for title set %d\n", what, title_set);
+        free(buffer);
+        close(streamout);
+        return(1);
+    }
+
+    if ( DVDReadBytes(dvd_file,buffer,size) != size) {
+        fprintf(stderr, "Error reading %s for title set %d\n", what, title_set);
+        free(buffer);
+        DVDCloseFile(dvd_file);
+        close(streamout);
+        return(1);
+    }
+
+    DVDCloseFile(dvd_file);
+
+    if (DVDWriteSmallFile(streamout, buffer, size, image_offset) != 0) {
+        fprintf(stderr, "Error writing %s\n",targetname);
+        free(buffer);
+        close(streamout);
+        return(1);
+    }
+
+    if (DVDSumBuffer(targetname, buffer, size) != 0) {
+        free(buffer);
+        close(streamout);
+        return(1);
+    }
+    if ( DVDStatsOn() ) {
+        DVDStatBytes(DVDFileStat(targetname), size);
+    }
+
+    free(buffer);
+    close(streamout);
+
+    return(0);
+}
+
+int
+DVDCopyIfoBup (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+               int title_set, char *targetdir, char *title_name)
+{
+    phase_t phase;
+    int     result;
+
+    DVDPhaseStart(&phase);
+    result = DVDCopyInfoFile(dvd, title_set_info, title_set, 0, targetdir, title_name);
+    if ( result == 0 ) {
+        result = DVDCopyInfoFile(dvd, title_set_info, title_set, 1, targetdir, title_name);
+    }
+    DVDPhaseEnd(&phase, "DVDCopyIfoBup");
+    return(result);
+}
+
+/* The IFO or the BUP alone, for a mirror that copies in disc order */
+static int
+DVDCopyInfo (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+             int title_set, int backup, char *targetdir, char *title_name)
+{
+    phase_t phase;
+    int     result;
+
+    DVDPhaseStart(&phase);
+    result = DVDCopyInfoFile(dvd, title_set_info, title_set, backup,
+                             targetdir, title_name);
+    DVDPhaseEnd(&phase, "DVDCopyIfoBup");
+    return(result);
+}
+
+int
+DVDMirrorVMG (dvd_reader_t *dvd,
+              title_set_info_t *title_set_info,
+              char *targetdir, char *title_name)
+{
+    if ( DVDCopyIfoBup(dvd, title_set_info, 0, targetdir, title_name) != 0 ) {
+        return(1);
+    }
+
+    if ( DVDCopyMenu(dvd, title_set_info, 0, targetdir, title_name) != 0 ) {
+        return(1);
+    }
+    return(0);
+}
+
+int
+DVDMirrorTitleX (dvd_reader_t *dvd,
+                 title_set_info_t *title_set_info,
+                 int title_set, char *targetdir,char *title_name)
+{
+    /* Loop through the vobs */
+    int i;
+
+    if ( DVDCopyIfoBup(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
+        return(1);
+    }
+
+    if ( DVDCopyMenu(dvd, title_set_info, title_set, targetdir, title_name) != 0 ) {
+        return(1);
+    }
+
+    for (i = 0; i < title_set_info->title_set[title_set].number_of_vob_files ; i++) {
 #ifdef DEBUG
         fprintf(stderr,"In the VOB copy loop for %d\n", i);
 #endif
@@ -1362,46 +4203,27 @@ DVDGetTitleName (const char *device, char *title)
     /* Terminate the title string */
 
     title[32] = '\0';
-
-    /* Remove trailing white space */
-
-    last = 32;
-    for ( i = 0; i < 32; i++ ) {
-        if ( title[i] != ' ' ) { last = i; }
-    }
-
-    title[last + 1] = '\0';
-
-    return(0);
-}
-
-void
-bsort_min_to_max (int sector[], int title[], int size)
-{
-    int temp_title, temp_sector, i, j;
-
-    for ( i=0; i < size ; i++ ) {
-        for ( j=0; j < size ; j++ ) {
-            if (sector[i] < sector[j]) {
-                temp_sector = sector[i];
-                temp_title = title[i];
-                sector[i] = sector[j];
-                title[i] = title[j];
-                sector[j] = temp_sector;
-                title[j] = temp_title;
-            }
-        }
+
+    /* Remove trailing white space */
+
+    last = 32;
+    for ( i = 0; i < 32; i++ ) {
+        if ( title[i] != ' ' ) { last = i; }
     }
+
+    title[last + 1] = '\0';
+
+    return(0);
 }
 
 void
-bsort_max_to_min (int sector[], int title[], int size)
+bsort_min_to_max (int sector[], int title[], int size)
 {
     int temp_title, temp_sector, i, j;
 
     for ( i=0; i < size ; i++ ) {
         for ( j=0; j < size ; j++ ) {
-            if (sector[i] > sector[j]) {
+            if (sector[i] < sector[j]) {
                 temp_sector = sector[i];
                 temp_title = title[i];
                 sector[i] = sector[j];
@@ -1452,6 +4274,12 @@ align_end_sector (int cell_start_sector[], int cell_end_sector[], int size)
 void
 DVDFreeTitleSetInfo (title_set_info_t *title_set_info)
 {
+    int i;
+
+    for (i = 0; i <= title_set_info->number_of_title_sets; i++) {
+        free(title_set_info->title_set[i].menu_played);
+        free(title_set_info->title_set[i].title_played);
+    }
     free(title_set_info->title_set);
     free(title_set_info);
 }
@@ -1464,7 +4292,7 @@ DVDFreeTitlesInfo (titles_info_t *titles_info)
 }
 
 title_set_info_t*
-DVDGetFileSet (dvd_reader_t *_dvd)
+DVDGetFileSet (dvd_reader_t *_dvd, ifo_handle_t *vmg_ifo)
 {
     /* title interation */
     int title_sets, counter, i;
@@ -1473,204 +4301,746 @@ DVDGetFileSet (dvd_reader_t *_dvd)
     char     filename[MAXNAME];
     uint32_t size;
 
-    /*DVD ifo handler*/
-    ifo_handle_t *vmg_ifo = NULL;
-
     /* The Title Set Info struct*/
     title_set_info_t *title_set_info;
 
+    title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+
+    /* Todo fix malloc check */
+    title_set_info = (title_set_info_t *)malloc(sizeof(title_set_info_t));
+    title_set_info->title_set = (title_set_t *)calloc(title_sets + 1, sizeof(title_set_t));
+
+    title_set_info->number_of_title_sets = title_sets;
+
+    /* Find VIDEO_TS.IFO is present - must be present since we did a ifo open 0*/
+
+    sprintf(filename,"/VIDEO_TS/VIDEO_TS.IFO");
+
+    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+        title_set_info->title_set[0].size_ifo = size;
+    } else {
+        DVDFreeTitleSetInfo(title_set_info);
+        return(0);
+    }
+
+    /* Find VIDEO_TS.VOB if present*/
+
+    sprintf(filename,"/VIDEO_TS/VIDEO_TS.VOB");
+
+    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+        title_set_info->title_set[0].size_menu = size;
+    } else {
+        title_set_info->title_set[0].size_menu = 0 ;
+    }
+
+    /* Find VIDEO_TS.BUP if present */
+
+    sprintf(filename,"/VIDEO_TS/VIDEO_TS.BUP");
+
+    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+        title_set_info->title_set[0].size_bup = size;
+    } else {
+        DVDFreeTitleSetInfo(title_set_info);
+        return(0);
+    }
+
+    if (title_set_info->title_set[0].size_ifo != title_set_info->title_set[0].size_bup) {
+        fprintf(stderr,"BUP and IFO size not the same be warened!\n");
+    }
+
+    /* Take care of the titles which we don't have in VMG */
+
+    title_set_info->title_set[0].number_of_vob_files = 0;
+    title_set_info->title_set[0].size_vob[0] = 0;
+
+    if ( verbose > 0 ){
+        fprintf(stderr,"\n\n\nFile sizes for Title set 0 VIDEO_TS.XXX\n");
+        fprintf(stderr,"IFO = %d, MENU_VOB = %d, BUP = %d\n",
+                title_set_info->title_set[0].size_ifo,
+                title_set_info->title_set[0].size_menu,
+                title_set_info->title_set[0].size_bup );
+    }
+
+    if ( title_sets >= 1 ) {
+        for (counter=0; counter < title_sets; counter++ ){
+
+            if ( verbose > 1 ){
+                fprintf(stderr,"At top of loop\n");
+            }
+
+            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.IFO",counter + 1);
+
+            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+                title_set_info->title_set[counter + 1].size_ifo = size;
+            } else {
+                DVDFreeTitleSetInfo(title_set_info);
+                return(0);
+            }
+
+            if ( verbose > 1 ){
+                fprintf(stderr,"After opening files\n");
+            }
+
+            /* Find VTS_XX_0.VOB if present*/
+
+            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.VOB", counter + 1);
+
+            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+                title_set_info->title_set[counter + 1].size_menu = size;
+            } else {
+                title_set_info->title_set[counter + 1].size_menu = 0 ;
+            }
+
+            if ( verbose > 1 ){
+                fprintf(stderr,"After Menu VOB check\n");
+            }
+
+            /* Find all VTS_XX_[1 to 9].VOB files if they are present*/
+
+            for( i = 0; i < 9; ++i ) {
+                sprintf(filename,"/VIDEO_TS/VTS_%02i_%i.VOB", counter + 1, i + 1 );
+                if(UDFFindFile(_dvd, filename, &size) == 0 ) {
+                    break;
+                }
+                title_set_info->title_set[counter + 1].size_vob[i] = size;
+            }
+            title_set_info->title_set[counter + 1].number_of_vob_files = i;
+
+            if ( verbose > 1 ){
+                fprintf(stderr,"After Menu Title VOB check\n");
+            }
+
+            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.BUP", counter + 1);
+
+            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
+                title_set_info->title_set[counter +1].size_bup = size;
+            } else {
+                DVDFreeTitleSetInfo(title_set_info);
+                return(0);
+            }
+
+            if (title_set_info->title_set[counter +1].size_ifo !=
+                title_set_info->title_set[counter + 1].size_bup) {
+                fprintf(stderr,"BUP and IFO size for fileset %d is "
+                        "not the same be warened!\n", counter + 1);
+            }
+
+            if ( verbose > 1 ){
+                fprintf(stderr,"After Menu Title BUP check\n");
+            }
+
+            if ( verbose > 0 ) {
+                fprintf(stderr,"\n\n\nFile sizes for Title set %d "
+                        "i.e.VTS_%02d_X.XXX\n", counter + 1, counter + 1);
+                fprintf(stderr,"IFO: %d, MENU: %d\n",
+                        title_set_info->title_set[counter +1].size_ifo,
+                        title_set_info->title_set[counter +1].size_menu);
+                for (i = 0;
+                     i < title_set_info->title_set[counter + 1].number_of_vob_files;
+                     i++) {
+                    fprintf(stderr, "VOB %d is %d\n", i + 1,
+                            title_set_info->title_set[counter + 1].size_vob[i]);
+                }
+                fprintf(stderr, "BUP: %d\n",
+                        title_set_info->title_set[counter +1].size_bup);
+            }
+
+            if ( verbose > 1 ){
+                fprintf(stderr, "Bottom of loop \n");
+            }
+        }
+
+    }
+
+    /* Return the info */
+    return(title_set_info);
+}
+
+disc_info_t*
+DVDOpenDiscInfo (dvd_reader_t *_dvd)
+{
+    disc_info_t *disc;
+
+    if ((disc = (disc_info_t *)calloc(1, sizeof(disc_info_t))) == NULL) {
+        fprintf(stderr, "Out of memory reading the disc structure\n");
+        return(NULL);
+    }
+    disc->dvd = _dvd;
+
     /*  Open main info file */
-    vmg_ifo = ifoOpen( _dvd, 0 );
-    if( !vmg_ifo ) {
+    disc->vmg_ifo = ifoOpen(_dvd, 0);
+    if( !disc->vmg_ifo ) {
         fprintf( stderr, "Can't open VMG info.\n" );
-        return (0);
+        free(disc);
+        return(NULL);
     }
 
-    title_sets = vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+    disc->number_of_title_sets = disc->vmg_ifo->vmgi_mat->vmg_nr_of_title_sets;
+    disc->vts_ifo = (ifo_handle_t **)calloc(disc->number_of_title_sets + 1,
+                                            sizeof(ifo_handle_t *));
+    if ( disc->vts_ifo == NULL ) {
+        fprintf(stderr, "Out of memory reading the disc structure\n");
+        DVDCloseDiscInfo(disc);
+        return(NULL);
+    }
+    disc->vts_ifo[0] = disc->vmg_ifo;
+
+    return(disc);
+}
+
+void
+DVDCloseDiscInfo (disc_info_t *disc)
+{
+    int i;
+
+    if ( disc->vts_ifo != NULL ) {
+        for ( i = 1; i <= disc->number_of_title_sets; i++ ) {
+            if ( disc->vts_ifo[i] != NULL ) {
+                ifoClose(disc->vts_ifo[i]);
+            }
+        }
+        free(disc->vts_ifo);
+    }
+    if ( disc->title_set_info != NULL ) {
+        DVDFreeTitleSetInfo(disc->title_set_info);
+    }
+    if ( disc->titles_info != NULL ) {
+        DVDFreeTitlesInfo(disc->titles_info);
+    }
+    ifoClose(disc->vmg_ifo);
+    free(disc);
+}
+
+/* Each VTS IFO is read at most once per disc */
+ifo_handle_t*
+DVDGetVTSInfo (disc_info_t *disc, int title_set)
+{
+    if ( title_set < 0 || title_set > disc->number_of_title_sets ) {
+        return(NULL);
+    }
+    if ( disc->vts_ifo[title_set] == NULL ) {
+        disc->vts_ifo[title_set] = ifoOpen(disc->dvd, title_set);
+    }
+    return(disc->vts_ifo[title_set]);
+}
+
+title_set_info_t*
+DVDGetTitleSetInfo (disc_info_t *disc)
+{
+    phase_t phase;
+
+    if ( disc->title_set_info == NULL ) {
+        DVDPhaseStart(&phase);
+        disc->title_set_info = DVDGetFileSet(disc->dvd, disc->vmg_ifo);
+        DVDPhaseEnd(&phase, "DVDGetFileSet");
+    }
+    return(disc->title_set_info);
+}
+
+titles_info_t*
+DVDGetTitlesInfo (disc_info_t *disc)
+{
+    phase_t phase;
+
+    if ( disc->titles_info == NULL ) {
+        DVDPhaseStart(&phase);
+        disc->titles_info = DVDGetInfo(disc);
+        DVDPhaseEnd(&phase, "DVDGetInfo");
+    }
+    return(disc->titles_info);
+}
+
+static int
+ComparePlayed (const void *a, const void *b)
+{
+    const sector_range_t *range_a = (const sector_range_t *)a;
+    const sector_range_t *range_b = (const sector_range_t *)b;
+
+    return((range_a->start > range_b->start) - (range_a->start < range_b->start));
+}
+
+/* Add the cells of a PGC to the sectors played. Returns 1 if out of memory */
+static int
+DVDAddPlayed (pgc_t *pgc, sector_range_t **range, int *ranges)
+{
+    /* Loop variable */
+    int c;
+
+    sector_range_t *more;
+
+    if (pgc == NULL || pgc->cell_playback == NULL || pgc->nr_of_cells == 0) {
+        return(0);
+    }
+    more = (sector_range_t *)realloc(*range, (*ranges + pgc->nr_of_cells)
+                                     * sizeof(sector_range_t));
+    if (more == NULL) {
+        return(1);
+    }
+    *range = more;
+    for (c = 0; c < pgc->nr_of_cells; c++) {
+        more[*ranges].start = pgc->cell_playback[c].first_sector;
+        more[*ranges].end   = pgc->cell_playback[c].last_sector + 1;
+        (*ranges)++;
+    }
+    return(0);
+}
+
+/* Sort the sectors played and merge the ranges that overlap or touch */
+static void
+DVDMergePlayed (sector_range_t *range, int *ranges)
+{
+    /* Loop variable */
+    int i;
+
+    int merged = 0;
 
-    /* Close the VMG ifo file we got all the info we need */
-    ifoClose(vmg_ifo);
+    if (*ranges == 0) {
+        return;
+    }
+    qsort(range, *ranges, sizeof(sector_range_t), ComparePlayed);
+    for (i = 1; i < *ranges; i++) {
+        if (range[i].start <= range[merged].end) {
+            if (range[i].end > range[merged].end) {
+                range[merged].end = range[i].end;
+            }
+        } else {
+            range[++merged] = range[i];
+        }
+    }
+    *ranges = merged + 1;
+}
+
+static int
+DVDCountPlayed (sector_range_t *range, int ranges)
+{
+    /* Loop variable */
+    int i;
+
+    int sectors = 0;
+
+    for (i = 0; i < ranges; i++) {
+        sectors += range[i].end - range[i].start;
+    }
+    return(sectors);
+}
+
+/* Find the sectors of every menu and title VOB some PGC plays: the
+   first play PGC, the menus of every language unit and the titles. A
+   domain whose IFO or PGC table can't be read is copied in full.
+   Returns 1 if out of memory */
+static int
+DVDFindPlayable (disc_info_t *disc, title_set_info_t *title_set_info)
+{
+    /* Loop variables */
+    int i, l, p;
+
+    ifo_handle_t *ifo;
+    title_set_t  *set;
+    pgcit_t      *pgcit;
+    int           vob_sectors;
+    int           failed = 0;
+
+    for (i = 0; i <= title_set_info->number_of_title_sets && !failed; i++) {
+        set = &title_set_info->title_set[i];
+        ifo = (i == 0 ? disc->vmg_ifo : DVDGetVTSInfo(disc, i));
+        if (ifo == NULL || set->menu_played != NULL || set->title_played != NULL) {
+            continue;
+        }
+
+        if (ifo->pgci_ut != NULL) {
+            for (l = 0; l < ifo->pgci_ut->nr_of_lus && !failed; l++) {
+                if ((pgcit = ifo->pgci_ut->lu[l].pgcit) == NULL) {
+                    continue;
+                }
+                for (p = 0; p < pgcit->nr_of_pgci_srp && !failed; p++) {
+                    failed = DVDAddPlayed(pgcit->pgci_srp[p].pgc,
+                                          &set->menu_played, &set->menu_ranges);
+                }
+            }
+            if (i == 0 && !failed) {
+                failed = DVDAddPlayed(ifo->first_play_pgc,
+                                      &set->menu_played, &set->menu_ranges);
+            }
+            DVDMergePlayed(set->menu_played, &set->menu_ranges);
+        }
+
+        if (i > 0 && (pgcit = ifo->vts_pgcit) != NULL) {
+            for (p = 0; p < pgcit->nr_of_pgci_srp && !failed; p++) {
+                failed = DVDAddPlayed(pgcit->pgci_srp[p].pgc,
+                                      &set->title_played, &set->title_ranges);
+            }
+            DVDMergePlayed(set->title_played, &set->title_ranges);
+        }
+
+        if (verbose >= 1) {
+            fprintf(stderr, "Title set %d plays %d of %d menu sectors",
+                    i, set->menu_played != NULL
+                    ? DVDCountPlayed(set->menu_played, set->menu_ranges)
+                    : set->size_menu / 2048, set->size_menu / 2048);
+            if (i > 0) {
+                vob_sectors = 0;
+                for (p = 0; p < set->number_of_vob_files; p++) {
+                    vob_sectors += set->size_vob[p] / 2048;
+                }
+                fprintf(stderr, ", %d of %d title sectors",
+                        set->title_played != NULL
+                        ? DVDCountPlayed(set->title_played, set->title_ranges)
+                        : vob_sectors, vob_sectors);
+            }
+            fprintf(stderr, "\n");
+        }
+    }
 
-    /* Todo fix malloc check */
-    title_set_info = (title_set_info_t *)malloc(sizeof(title_set_info_t));
-    title_set_info->title_set = (title_set_t *)malloc((title_sets + 1)* sizeof(title_set_t));
+    if (failed) {
+        fprintf(stderr, "Out of memory finding the playable sectors\n");
+    }
+    return(failed);
+}
 
-    title_set_info->number_of_title_sets = title_sets;
+/* Map an image source for --mmap. A directory is read as usual */
+static source_map_t *
+DVDMapSource (const char *dvd)
+{
+    struct stat   fileinfo;
+    source_map_t *map;
+    int           fd;
 
-    /* Find VIDEO_TS.IFO is present - must be present since we did a ifo open 0*/
+    if (stat(dvd, &fileinfo) != 0 || !S_ISREG(fileinfo.st_mode)
+        || fileinfo.st_size == 0) {
+        return(NULL);
+    }
+    if ((map = malloc(sizeof(source_map_t))) == NULL) {
+        fprintf(stderr, "Out of memory mapping %s\n", dvd);
+        return(NULL);
+    }
+    if ((fd = open(dvd, O_RDONLY)) == -1) {
+        fprintf(stderr, "Error opening %s\n", dvd);
+        perror("");
+        free(map);
+        return(NULL);
+    }
+    map->size = fileinfo.st_size;
+    map->data = mmap(NULL, map->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if ( map->data == MAP_FAILED ) {
+        fprintf(stderr, "Can't map %s, reading it through libdvdread\n", dvd);
+        free(map);
+        return(NULL);
+    }
+    return(map);
+}
 
-    sprintf(filename,"/VIDEO_TS/VIDEO_TS.IFO");
+int
+DVDIsDrive (const char *dvd)
+{
+    struct stat   fileinfo;
+    struct statfs fsinfo;
 
-    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-        title_set_info->title_set[0].size_ifo = size;
-    } else {
-        DVDFreeTitleSetInfo(title_set_info);
-        return(0);
+    if (stat(dvd, &fileinfo) != 0) {
+        return(1);
     }
 
-    /* Find VIDEO_TS.VOB if present*/
-
-    sprintf(filename,"/VIDEO_TS/VIDEO_TS.VOB");
+    if (S_ISBLK(fileinfo.st_mode) || S_ISCHR(fileinfo.st_mode)) {
+        return(1);
+    }
 
-    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-        title_set_info->title_set[0].size_menu = size;
-    } else {
-        title_set_info->title_set[0].size_menu = 0 ;
+    /* A mounted disc, libdvdread reads the device behind it */
+#ifdef __linux__
+    if (S_ISDIR(fileinfo.st_mode) && statfs(dvd, &fsinfo) == 0
+        && (fsinfo.f_type == UDF_SUPER_MAGIC || fsinfo.f_type == ISOFS_SUPER_MAGIC)) {
+        return(1);
+    }
+#else
+    if (S_ISDIR(fileinfo.st_mode) && statfs(dvd, &fsinfo) == 0
+        && (strcmp(fsinfo.f_fstypename, "udf") == 0
+            || strcmp(fsinfo.f_fstypename, "cd9660") == 0)) {
+        return(1);
     }
+#endif
 
-    /* Find VIDEO_TS.BUP if present */
+    return(0);
+}
 
-    sprintf(filename,"/VIDEO_TS/VIDEO_TS.BUP");
+static void
+DVDMirrorAddJob (dvd_reader_t *dvd, mirror_job_t *job, int *jobs,
+                 int title_set, int vob, int size)
+{
+    char     filename[MAXNAME];
+    char     base[32];
+    uint32_t found;
 
-    if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-        title_set_info->title_set[0].size_bup = size;
+    if (title_set == 0) {
+        strcpy(base, "/VIDEO_TS/VIDEO_TS");
     } else {
-        DVDFreeTitleSetInfo(title_set_info);
-        return(0);
-    }
-
-    if (title_set_info->title_set[0].size_ifo != title_set_info->title_set[0].size_bup) {
-        fprintf(stderr,"BUP and IFO size not the same be warened!\n");
+        snprintf(base, sizeof(base), "/VIDEO_TS/VTS_%02i_%i", title_set, vob > 0 ? vob : 0);
     }
+    snprintf(filename, sizeof(filename), "%s.%s", base, vob == MIRROR_IFO ? "IFO"
+            : vob == MIRROR_BUP ? "BUP" : "VOB");
+
+    job[*jobs].title_set = title_set;
+    job[*jobs].vob       = vob;
+    job[*jobs].size      = size;
+    job[*jobs].sector    = (dvd != NULL ? UDFFindFile(dvd, filename, &found) : 0);
+    job[*jobs].order     = *jobs;
+    (*jobs)++;
+}
 
-    /* Take care of the titles which we don't have in VMG */
+/* Every file of the title sets, and of the VMG if vmg is set, in the
+   order a disc holds them. With a reader each job gets the sector UDF
+   says its file starts at. Returns the number of jobs, -1 on error */
+static int
+DVDMirrorPlan (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+               int vmg, mirror_job_t **plan)
+{
+    /* Loop variables */
+    int i, f;
 
-    title_set_info->title_set[0].number_of_vob_files = 0;
-    title_set_info->title_set[0].size_vob[0] = 0;
+    mirror_job_t *job;
+    title_set_t  *set;
+    int           jobs = 0;
 
-    if ( verbose > 0 ){
-        fprintf(stderr,"\n\n\nFile sizes for Title set 0 VIDEO_TS.XXX\n");
-        fprintf(stderr,"IFO = %d, MENU_VOB = %d, BUP = %d\n",
-                title_set_info->title_set[0].size_ifo,
-                title_set_info->title_set[0].size_menu,
-                title_set_info->title_set[0].size_bup );
+    job = (mirror_job_t *)malloc((title_set_info->number_of_title_sets + 1) * 13
+                                 * sizeof(mirror_job_t));
+    if (job == NULL) {
+        fprintf(stderr, "Out of memory planning the mirror\n");
+        return(-1);
     }
 
-    if ( title_sets >= 1 ) {
-        for (counter=0; counter < title_sets; counter++ ){
+    for (i = (vmg ? 0 : 1); i <= title_set_info->number_of_title_sets; i++) {
+        set = &title_set_info->title_set[i];
+        DVDMirrorAddJob(dvd, job, &jobs, i, MIRROR_IFO, set->size_ifo);
+        if (set->size_menu > 0) {
+            DVDMirrorAddJob(dvd, job, &jobs, i, MIRROR_MENU, set->size_menu);
+        }
+        for (f = 0; f < set->number_of_vob_files; f++) {
+            DVDMirrorAddJob(dvd, job, &jobs, i, f + 1, set->size_vob[f]);
+        }
+        DVDMirrorAddJob(dvd, job, &jobs, i, MIRROR_BUP, set->size_bup);
+    }
 
-            if ( verbose > 1 ){
-                fprintf(stderr,"At top of loop\n");
-            }
+    *plan = job;
+    return(jobs);
+}
 
-            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.IFO",counter + 1);
+static int
+DVDMirrorCopy (dvd_reader_t *dvd, title_set_info_t *title_set_info,
+               mirror_job_t *job, char *targetdir, char *title_name)
+{
+    switch (job->vob) {
+    case MIRROR_IFO:
+        return(DVDCopyInfo(dvd, title_set_info, job->title_set, 0, targetdir, title_name));
+    case MIRROR_BUP:
+        return(DVDCopyInfo(dvd, title_set_info, job->title_set, 1, targetdir, title_name));
+    case MIRROR_MENU:
+        return(DVDCopyMenu(dvd, title_set_info, job->title_set, targetdir, title_name));
+    default:
+        return(DVDCopyTileVobX(dvd, title_set_info, job->title_set, job->vob,
+                               targetdir, title_name));
+    }
+}
 
-            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-                title_set_info->title_set[counter + 1].size_ifo = size;
-            } else {
-                DVDFreeTitleSetInfo(title_set_info);
-                return(0);
-            }
+/* Files a disc doesn't say the place of keep their disc order */
+static int
+CompareMirrorSectors (const void *a, const void *b)
+{
+    const mirror_job_t *job_a = (const mirror_job_t *)a;
+    const mirror_job_t *job_b = (const mirror_job_t *)b;
 
-            if ( verbose > 1 ){
-                fprintf(stderr,"After opening files\n");
-            }
+    if (job_a->sector != job_b->sector) {
+        return(job_a->sector < job_b->sector ? -1 : 1);
+    }
+    return(job_a->order - job_b->order);
+}
 
-            /* Find VTS_XX_0.VOB if present*/
+static int
+CompareMirrorJobs (const void *a, const void *b)
+{
+    const mirror_job_t *job_a = (const mirror_job_t *)a;
+    const mirror_job_t *job_b = (const mirror_job_t *)b;
 
-            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.VOB", counter + 1);
+    /* Biggest first so the last job to finish is a small one */
+    if (job_a->size != job_b->size) {
+        return(job_a->size < job_b->size ? 1 : -1);
+    }
+    return(job_a->order - job_b->order);
+}
 
-            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-                title_set_info->title_set[counter + 1].size_menu = size;
-            } else {
-                title_set_info->title_set[counter + 1].size_menu = 0 ;
-            }
+static void *
+DVDMirrorWorker (void *arg)
+{
+    mirror_pool_t *pool = (mirror_pool_t *)arg;
+    mirror_job_t  *job;
+    dvd_reader_t  *_dvd;
+    int            result;
+
+    current_job     = pool->owner;
+    current_journal  = pool->journal;
+    current_manifest = pool->manifest;
+    current_bad_map  = pool->bad_map;
+    current_image    = pool->image;
+    current_source   = pool->source;
+    current_map      = pool->map;
+
+    /* Each worker reads through its own reader and dvd_file_t */
+    if ((_dvd = DVDOpen(pool->dvd)) == NULL) {
+        fprintf(stderr, "Worker failed opening %s\n", pool->dvd);
+        pthread_mutex_lock(&pool->lock);
+        pool->error = 1;
+        pthread_mutex_unlock(&pool->lock);
+        return(NULL);
+    }
 
-            if ( verbose > 1 ){
-                fprintf(stderr,"After Menu VOB check\n");
-            }
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        if ( pool->error || pool->next == pool->jobs ) {
+            pthread_mutex_unlock(&pool->lock);
+            break;
+        }
+        job = &pool->job[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        result = DVDMirrorCopy(_dvd, pool->title_set_info, job,
+                               pool->targetdir, pool->title_name);
+        if ( result != 0 ) {
+            fprintf(stderr,"Mirror of Title set %d failed\n", job->title_set);
+            pthread_mutex_lock(&pool->lock);
+            pool->error = 1;
+            pthread_mutex_unlock(&pool->lock);
+        }
+    }
 
-            /* Find all VTS_XX_[1 to 9].VOB files if they are present*/
+    DVDFreeCopyPool();
+    DVDClose(_dvd);
 
-            for( i = 0; i < 9; ++i ) {
-                sprintf(filename,"/VIDEO_TS/VTS_%02i_%i.VOB", counter + 1, i + 1 );
-                if(UDFFindFile(_dvd, filename, &size) == 0 ) {
-                    break;
-                }
-                title_set_info->title_set[counter + 1].size_vob[i] = size;
-            }
-            title_set_info->title_set[counter + 1].number_of_vob_files = i;
+    return(NULL);
+}
 
-            if ( verbose > 1 ){
-                fprintf(stderr,"After Menu Title VOB check\n");
-            }
+/* Copy the title sets, and the VOB files within them, with several
+   workers at once. Only used when the source isn't a drive, where
+   concurrent reads would just make it seek */
+int
+DVDMirrorParallel (char *dvd, title_set_info_t *title_set_info,
+                   char *targetdir, char *title_name)
+{
+    /* Loop variable */
+    int i;
 
-            sprintf(filename,"/VIDEO_TS/VTS_%02i_0.BUP", counter + 1);
+    mirror_pool_t  pool;
+    pthread_t     *worker;
+    int            workers;
+
+    memset(&pool, 0, sizeof(pool));
+    pool.dvd            = dvd;
+    pool.title_set_info = title_set_info;
+    pool.targetdir      = targetdir;
+    pool.title_name     = title_name;
+    pool.owner          = current_job;
+    pool.journal        = current_journal;
+    pool.manifest       = current_manifest;
+    pool.bad_map        = current_bad_map;
+    pool.image          = current_image;
+    pool.source         = current_source;
+    pool.map            = current_map;
+
+    /* Where the files are doesn't matter off a drive */
+    if ((pool.jobs = DVDMirrorPlan(NULL, title_set_info, 0, &pool.job)) < 0) {
+        return(1);
+    }
 
-            if ( UDFFindFile(_dvd, filename, &size) != 0 ) {
-                title_set_info->title_set[counter +1].size_bup = size;
-            } else {
-                DVDFreeTitleSetInfo(title_set_info);
-                return(0);
-            }
+    qsort(pool.job, pool.jobs, sizeof(mirror_job_t), CompareMirrorJobs);
 
-            if (title_set_info->title_set[counter +1].size_ifo !=
-                title_set_info->title_set[counter + 1].size_bup) {
-                fprintf(stderr,"BUP and IFO size for fileset %d is "
-                        "not the same be warened!\n", counter + 1);
-            }
+    workers = mirror_jobs;
+    if (workers > pool.jobs) {
+        workers = pool.jobs;
+    }
 
-            if ( verbose > 1 ){
-                fprintf(stderr,"After Menu Title BUP check\n");
-            }
+    if ((worker = (pthread_t *)malloc(workers * sizeof(pthread_t))) == NULL) {
+        fprintf(stderr, "Out of memory planning the mirror\n");
+        free(pool.job);
+        return(1);
+    }
 
-            if ( verbose > 0 ) {
-                fprintf(stderr,"\n\n\nFile sizes for Title set %d "
-                        "i.e.VTS_%02d_X.XXX\n", counter + 1, counter + 1);
-                fprintf(stderr,"IFO: %d, MENU: %d\n",
-                        title_set_info->title_set[counter +1].size_ifo,
-                        title_set_info->title_set[counter +1].size_menu);
-                for (i = 0;
-                     i < title_set_info->title_set[counter + 1].number_of_vob_files;
-                     i++) {
-                    fprintf(stderr, "VOB %d is %d\n", i + 1,
-                            title_set_info->title_set[counter + 1].size_vob[i]);
-                }
-                fprintf(stderr, "BUP: %d\n",
-                        title_set_info->title_set[counter +1].size_bup);
-            }
+    pthread_mutex_init(&pool.lock, NULL);
 
-            if ( verbose > 1 ){
-                fprintf(stderr, "Bottom of loop \n");
-            }
+    for (i = 0; i < workers; i++) {
+        if (pthread_create(&worker[i], NULL, DVDMirrorWorker, &pool) != 0) {
+            fprintf(stderr, "Failed creating mirror worker %d\n", i + 1);
+            pthread_mutex_lock(&pool.lock);
+            pool.error = 1;
+            pthread_mutex_unlock(&pool.lock);
+            break;
         }
+    }
+    workers = i;
 
+    for (i = 0; i < workers; i++) {
+        pthread_join(worker[i], NULL);
     }
 
-    /* Return the info */
-    return(title_set_info);
+    pthread_mutex_destroy(&pool.lock);
+    free(worker);
+    free(pool.job);
+
+    return(pool.error);
 }
 
 int
-DVDMirror (dvd_reader_t *_dvd, char *targetdir, char *title_name)
+DVDMirror (disc_info_t *disc, char *dvd, char *targetdir, char *title_name)
 {
     int i;
+    int jobs;
+    mirror_job_t     *job;
     title_set_info_t *title_set_info=NULL;
+    dvd_reader_t     *_dvd = disc->dvd;
 
-    title_set_info = DVDGetFileSet(_dvd);
+    title_set_info = DVDGetTitleSetInfo(disc);
     if (!title_set_info) {
-        DVDClose(_dvd);
         return(1);
     }
 
-    if ( DVDMirrorVMG(_dvd, title_set_info, targetdir, title_name) != 0 ) {
-        fprintf(stderr,"Mirror of VMG failed\n");
-        DVDFreeTitleSetInfo(title_set_info);
+    if ( mirror_jobs > 1 && !DVDIsDrive(dvd) ) {
+
+        /* The VMG goes last, a half written mirror is then never
+           mistaken for a complete one */
+        if ( DVDMirrorParallel(dvd, title_set_info, targetdir, title_name) != 0
+             || DVDMirrorVMG(_dvd, title_set_info, targetdir, title_name) != 0 ) {
+            return(1);
+        }
+        return(0);
+    }
+
+    if ( mirror_jobs > 1 && verbose > 0 ) {
+        fprintf(stderr, "%s is a drive, copying one file at a time\n", dvd);
+    }
+
+    /* One sweep over the disc, whatever order the title sets are in,
+       and across the layer break */
+    if ((jobs = DVDMirrorPlan(_dvd, title_set_info, 1, &job)) < 0) {
         return(1);
     }
+    qsort(job, jobs, sizeof(mirror_job_t), CompareMirrorSectors);
 
-    for ( i=0; i < title_set_info->number_of_title_sets; i++) {
-        if ( DVDMirrorTitleX(_dvd, title_set_info, i + 1, targetdir, title_name) != 0 ) {
-            fprintf(stderr,"Mirror of Title set %d failed\n", i + 1);
-            DVDFreeTitleSetInfo(title_set_info);
+    for ( i = 0; i < jobs; i++ ) {
+        if ( verbose > 1 ) {
+            fprintf(stderr, "Copying title set %d file %d at sector %u\n",
+                    job[i].title_set, job[i].vob, job[i].sector);
+        }
+        if ( DVDMirrorCopy(_dvd, title_set_info, &job[i], targetdir, title_name) != 0 ) {
+            if ( job[i].title_set == 0 ) {
+                fprintf(stderr,"Mirror of VMG failed\n");
+            } else {
+                fprintf(stderr,"Mirror of Title set %d failed\n", job[i].title_set);
+            }
+            free(job);
             return(1);
         }
     }
+    free(job);
     return(0);
 }
 
 int
-DVDMirrorTitleSet (dvd_reader_t *_dvd,
+DVDMirrorTitleSet (disc_info_t *disc,
                    char *targetdir,
                    char *title_name,
                    int title_set)
@@ -1681,10 +5051,9 @@ DVDMirrorTitleSet (dvd_reader_t *_dvd,
     fprintf(stderr,"In DVDMirrorTitleSet\n");
 #endif
 
-    title_set_info = DVDGetFileSet(_dvd);
+    title_set_info = DVDGetTitleSetInfo(disc);
 
     if (!title_set_info) {
-        DVDClose(_dvd);
         return(1);
     }
 
@@ -1692,116 +5061,80 @@ DVDMirrorTitleSet (dvd_reader_t *_dvd,
         fprintf(stderr, "Can't copy title_set %d there is only %d "
                 "title_sets present on this DVD\n", title_set,
                 title_set_info->number_of_title_sets);
-        DVDFreeTitleSetInfo(title_set_info);
         return(1);
     }
 
     if ( title_set == 0 ) {
-        if ( DVDMirrorVMG(_dvd, title_set_info, targetdir, title_name) != 0 ) {
+        if ( DVDMirrorVMG(disc->dvd, title_set_info, targetdir, title_name) != 0 ) {
             fprintf(stderr,"Mirror of Title set 0 (VMG) failed\n");
-            DVDFreeTitleSetInfo(title_set_info);
             return(1);
         }
     } else {
-        if ( DVDMirrorTitleX(_dvd, title_set_info, title_set,
+        if ( DVDMirrorTitleX(disc->dvd, title_set_info, title_set,
                              targetdir, title_name) != 0 ) {
             fprintf(stderr,"Mirror of Title set %d failed\n", title_set);
-            DVDFreeTitleSetInfo(title_set_info);
             return(1);
         }
     }
-    DVDFreeTitleSetInfo(title_set_info);
     return(0);
 }
 
 int
-DVDMirrorMainFeature (dvd_reader_t *_dvd,
+DVDMirrorMainFeature (disc_info_t *disc,
                       char *targetdir,
                       char *title_name)
 {
     title_set_info_t *title_set_info=NULL;
     titles_info_t *titles_info=NULL;
 
-    titles_info = DVDGetInfo(_dvd);
+    titles_info = DVDGetTitlesInfo(disc);
     if (!titles_info) {
         fprintf(stderr, "Guess work of main feature film failed\n");
         return(1);
     }
 
-    title_set_info = DVDGetFileSet(_dvd);
+    title_set_info = DVDGetTitleSetInfo(disc);
     if (!title_set_info) {
-        DVDFreeTitlesInfo(titles_info);
         return(1);
     }
 
-    if ( DVDMirrorTitleX(_dvd, title_set_info, titles_info->main_title_set,
+    if ( DVDMirrorTitleX(disc->dvd, title_set_info, titles_info->main_title_set,
                          targetdir, title_name) != 0 ) {
         fprintf(stderr,"Mirror of main featur file which is title set %d failed\n",
                 titles_info->main_title_set);
-        DVDFreeTitleSetInfo(title_set_info);
         return(1);
     }
 
-    DVDFreeTitlesInfo(titles_info);
-    DVDFreeTitleSetInfo(title_set_info);
     return(0);
 }
 
-int
-DVDMirrorChapters (dvd_reader_t *_dvd,
-                   char *targetdir,
-                   char *title_name, 
-                   int start_chapter,
-                   int end_chapter,
-                   int titles)
+/* Look up the sectors of the cells chapters start_chapter to
+   end_chapter of a title play, in disc order for VOB files. The caller
+   frees both arrays */
+static int
+DVDGetChapterCells (disc_info_t *disc,
+                    titles_info_t *titles_info,
+                    int start_chapter,
+                    int end_chapter,
+                    int titles,
+                    int **cell_start_sector_out,
+                    int **cell_end_sector_out,
+                    int *length)
 {
-    int result;
-    int chapters = 0;
     int i, s;
     int spg, epg;
     int pgc;
     int start_cell, end_cell;
     int vts_title;
 
-    title_set_info_t *title_set_info    = NULL;
-    titles_info_t    *titles_info       = NULL;
     ifo_handle_t     *vts_ifo_info      = NULL;
     int              *cell_start_sector = NULL;
     int              *cell_end_sector   = NULL;
 
-    /* To do free memory*/
-
-    titles_info = DVDGetInfo(_dvd);
-    if (!titles_info) {
-        fprintf(stderr, "Failed to obtain titles information\n");
-        return(1);
-    }
-
-    title_set_info = DVDGetFileSet(_dvd);
-    if (!title_set_info) {
-        DVDFreeTitlesInfo(titles_info);
-        return(1);
-    }
-
-    if(titles == 0) {
-        fprintf(stderr, "No title specified for chapter extraction, "
-                "will try to figure out main feature title\n");
-        for (i=0; i < titles_info->number_of_titles ; i++ ) {
-            if ( titles_info->titles[i].title_set == titles_info->main_title_set ) {
-                if(chapters < titles_info->titles[i].chapters) {
-                    chapters = titles_info->titles[i].chapters;
-                    titles = i + 1;
-                }
-            }
-        }
-    }
-
-    vts_ifo_info = ifoOpen(_dvd, titles_info->titles[titles - 1].title_set);
+    vts_ifo_info = DVDGetVTSInfo(disc, titles_info->titles[titles - 1].title_set);
     if(!vts_ifo_info) {
         fprintf(stderr, "Coundn't open tile_set %d IFO file\n",
                 titles_info->titles[titles - 1].title_set);
-        DVDFreeTitlesInfo(titles_info);
-        DVDFreeTitleSetInfo(title_set_info);
         return(1);
     }
 
@@ -1862,17 +5195,11 @@ DVDMirrorChapters (dvd_reader_t *_dvd,
     cell_start_sector = (int *)malloc( (end_cell - start_cell + 1) * sizeof(int));
     if(!cell_start_sector) {
         fprintf(stderr,"Memory allocation error 1\n");
-        DVDFreeTitlesInfo(titles_info);
-        DVDFreeTitleSetInfo(title_set_info);
-        ifoClose(vts_ifo_info);
         return(1);
     }
     cell_end_sector = (int *)malloc( (end_cell - start_cell + 1) * sizeof(int));
     if(!cell_end_sector) {
         fprintf(stderr,"Memory allocation error\n");
-        DVDFreeTitlesInfo(titles_info);
-        DVDFreeTitleSetInfo(title_set_info);
-        ifoClose(vts_ifo_info);
         free(cell_start_sector);
         return(1);
     }
@@ -1897,24 +5224,81 @@ DVDMirrorChapters (dvd_reader_t *_dvd,
 #endif
     }
 
-    bsort_min_to_max(cell_start_sector, cell_end_sector, end_cell - start_cell + 1);
+    /* VOB files keep the cells in disc order, a stream in the order
+       they are played */
+    if ( stream_fd == -1 ) {
+        bsort_min_to_max(cell_start_sector, cell_end_sector, end_cell - start_cell + 1);
+
+        align_end_sector(cell_start_sector, cell_end_sector,end_cell - start_cell + 1);
+    }
+
+#ifdef DEBUG
+    for (i=0 ; i < end_cell - start_cell + 1; i++) {
+        fprintf(stderr, "DVDMirrorChapter: Start sector is %d end sector is %d\n",
+                cell_start_sector[i], cell_end_sector[i]);
+    }
+#endif
+
+    *cell_start_sector_out = cell_start_sector;
+    *cell_end_sector_out   = cell_end_sector;
+    *length                = end_cell - start_cell + 1;
+    return(0);
+}
+
+int
+DVDMirrorChapters (disc_info_t *disc,
+                   char *targetdir,
+                   char *title_name, 
+                   int start_chapter,
+                   int end_chapter,
+                   int titles)
+{
+    int result;
+    int chapters = 0;
+    int i;
+    int length;
+
+    title_set_info_t *title_set_info    = NULL;
+    titles_info_t    *titles_info       = NULL;
+    int              *cell_start_sector = NULL;
+    int              *cell_end_sector   = NULL;
+    phase_t           phase;
+
+    titles_info = DVDGetTitlesInfo(disc);
+    if (!titles_info) {
+        fprintf(stderr, "Failed to obtain titles information\n");
+        return(1);
+    }
+
+    title_set_info = DVDGetTitleSetInfo(disc);
+    if (!title_set_info) {
+        return(1);
+    }
 
-    align_end_sector(cell_start_sector, cell_end_sector,end_cell - start_cell + 1);
+    if(titles == 0) {
+        fprintf(stderr, "No title specified for chapter extraction, "
+                "will try to figure out main feature title\n");
+        for (i=0; i < titles_info->number_of_titles ; i++ ) {
+            if ( titles_info->titles[i].title_set == titles_info->main_title_set ) {
+                if(chapters < titles_info->titles[i].chapters) {
+                    chapters = titles_info->titles[i].chapters;
+                    titles = i + 1;
+                }
+            }
+        }
+    }
 
-#ifdef DEBUG
-    for (i=0 ; i < end_cell - start_cell + 1; i++) {
-        fprintf(stderr, "DVDMirrorChapter: Start sector is %d end sector is %d\n",
-                cell_start_sector[i], cell_end_sector[i]);
+    if ( DVDGetChapterCells(disc, titles_info, start_chapter, end_chapter, titles,
+                            &cell_start_sector, &cell_end_sector, &length) != 0 ) {
+        return(1);
     }
-#endif
 
-    result = DVDWriteCells(_dvd, cell_start_sector,
-                           cell_end_sector , end_cell - start_cell + 1,
+    DVDPhaseStart(&phase);
+    result = DVDWriteCells(disc->dvd, cell_start_sector,
+                           cell_end_sector , length,
                            titles, title_set_info, titles_info, targetdir, title_name);
+    DVDPhaseEnd(&phase, "DVDWriteCells");
 
-    DVDFreeTitlesInfo(titles_info);
-    DVDFreeTitleSetInfo(title_set_info);
-    ifoClose(vts_ifo_info);
     free(cell_start_sector);
     free(cell_end_sector);
 
@@ -1926,7 +5310,7 @@ DVDMirrorChapters (dvd_reader_t *_dvd,
 }
 
 int
-DVDMirrorTitles (dvd_reader_t *_dvd,
+DVDMirrorTitles (disc_info_t *disc,
                  char *targetdir,
                  char *title_name,
                  int titles)
@@ -1939,7 +5323,7 @@ DVDMirrorTitles (dvd_reader_t *_dvd,
     fprintf(stderr,"In DVDMirrorTitles\n");
 #endif
 
-    titles_info = DVDGetInfo(_dvd);
+    titles_info = DVDGetTitlesInfo(disc);
     if (!titles_info) {
         fprintf(stderr, "Failed to obtain titles information\n");
         return(1);
@@ -1950,18 +5334,201 @@ DVDMirrorTitles (dvd_reader_t *_dvd,
     fprintf(stderr,"DVDMirrorTitles: end_chapter %d\n", end_chapter);
 #endif
 
-    if (DVDMirrorChapters( _dvd, targetdir, title_name, 1, end_chapter, titles) != 0 ) {
-        DVDFreeTitlesInfo(titles_info);
+    if (DVDMirrorChapters( disc, targetdir, title_name, 1, end_chapter, titles) != 0 ) {
         return(1);
     }
 
-    DVDFreeTitlesInfo(titles_info);
-
     return(0);
 }
 
+static int
+ComparePieces (const void *a, const void *b)
+{
+    const copy_extent_t *piece_a = (const copy_extent_t *)a;
+    const copy_extent_t *piece_b = (const copy_extent_t *)b;
+
+    if (piece_a->title_set != piece_b->title_set) {
+        return(piece_a->title_set - piece_b->title_set);
+    }
+    if (piece_a->offset != piece_b->offset) {
+        return(piece_a->offset - piece_b->offset);
+    }
+    return(piece_a->size - piece_b->size);
+}
+
+/* Cut the extents wherever another one of the same title set starts or
+   ends, so sectors several titles play come out as identical extents.
+   The pieces are in disc order. Returns how many are in *split, -1 if
+   out of memory */
+static int
+DVDSplitExtents (copy_extent_t extent[], int extents, copy_extent_t **split)
+{
+    /* Loop variables */
+    int i, j;
+
+    copy_extent_t *piece = NULL;
+    copy_extent_t *more;
+    int            pieces = 0;
+    int            room = 0;
+    int            start, end, cut;
+
+    for ( i = 0; i < extents; i++ ) {
+        start = extent[i].offset;
+        end   = extent[i].offset + extent[i].size;
+
+        while ( start < end ) {
+            cut = end;
+            for ( j = 0; j < extents; j++ ) {
+                if ( extent[j].title_set != extent[i].title_set ) {
+                    continue;
+                }
+                if ( extent[j].offset > start && extent[j].offset < cut ) {
+                    cut = extent[j].offset;
+                }
+                if ( extent[j].offset + extent[j].size > start
+                     && extent[j].offset + extent[j].size < cut ) {
+                    cut = extent[j].offset + extent[j].size;
+                }
+            }
+
+            if ( pieces == room ) {
+                room = room * 2 + extents;
+                if ((more = (copy_extent_t *)realloc(piece, room * sizeof(copy_extent_t))) == NULL) {
+                    free(piece);
+                    return(-1);
+                }
+                piece = more;
+            }
+            piece[pieces] = extent[i];
+            piece[pieces].offset        = start;
+            piece[pieces].size          = cut - start;
+            piece[pieces].target_offset = extent[i].target_offset + start - extent[i].offset;
+            pieces++;
+
+            start = cut;
+        }
+    }
+
+    qsort(piece, pieces, sizeof(copy_extent_t), ComparePieces);
+    *split = piece;
+    return(pieces);
+}
+
+/* Copy several titles in one pass, each to title_name/TITLE_XX. Every
+   sector is read once, however many of the titles play it */
+int
+DVDMirrorTitleList (disc_info_t *disc,
+                    char *targetdir,
+                    char *title_name,
+                    int title[],
+                    int number_of_titles)
+{
+    /* Loop variable */
+    int i;
+
+    title_set_info_t *title_set_info    = NULL;
+    titles_info_t    *titles_info       = NULL;
+    cell_plan_t      *plan              = NULL;
+    copy_extent_t    *extent            = NULL;
+    copy_extent_t    *split             = NULL;
+    int              *cell_start_sector = NULL;
+    int              *cell_end_sector   = NULL;
+    char              name[PATH_MAX];
+    int               length;
+    int               planned = 0;
+    int               extents = 0;
+    int               pieces;
+    int               played = 0;
+    int               read = 0;
+    int               result = 0;
+    phase_t           phase;
+
+    titles_info = DVDGetTitlesInfo(disc);
+    if (!titles_info) {
+        fprintf(stderr, "Failed to obtain titles information\n");
+        return(1);
+    }
+
+    title_set_info = DVDGetTitleSetInfo(disc);
+    if (!title_set_info) {
+        return(1);
+    }
+
+    if ((plan = (cell_plan_t *)malloc(number_of_titles * sizeof(cell_plan_t))) == NULL) {
+        fprintf(stderr, "Out of memory planning %d titles\n", number_of_titles);
+        return(1);
+    }
+
+    for ( i = 0; i < number_of_titles && result == 0; i++ ) {
+        if ( title[i] > titles_info->number_of_titles ) {
+            fprintf(stderr, "There is no title %d, the DVD has %d\n",
+                    title[i], titles_info->number_of_titles);
+            result = 1;
+            break;
+        }
+        if ( DVDGetChapterCells(disc, titles_info, 1, titles_info->titles[title[i] - 1].chapters,
+                                title[i], &cell_start_sector, &cell_end_sector,
+                                &length) != 0 ) {
+            result = 1;
+            break;
+        }
+
+        snprintf(name, sizeof(name), "%s/TITLE_%02i", title_name, title[i]);
+        planned = i + 1;
+        result  = DVDPlanCells(&plan[i], cell_start_sector, cell_end_sector, length,
+                               title[i], title_set_info, titles_info, targetdir, name);
+        extents = extents + plan[i].extents;
+
+        free(cell_start_sector);
+        free(cell_end_sector);
+    }
+
+    /* One list of every cell of every title, cut where they overlap */
+    if ( result == 0 ) {
+        if ((extent = (copy_extent_t *)malloc(extents * sizeof(copy_extent_t))) == NULL) {
+            fprintf(stderr, "Out of memory planning %d titles\n", number_of_titles);
+            result = 1;
+        } else {
+            for ( extents = 0, i = 0; i < planned; i++ ) {
+                memcpy(&extent[extents], plan[i].extent, plan[i].extents * sizeof(copy_extent_t));
+                extents = extents + plan[i].extents;
+            }
+            if ((pieces = DVDSplitExtents(extent, extents, &split)) == -1) {
+                fprintf(stderr, "Out of memory planning %d titles\n", number_of_titles);
+                result = 1;
+            }
+        }
+    }
+
+    if ( result == 0 ) {
+        for ( i = 0; i < pieces; i++ ) {
+            played = played + split[i].size;
+            if ( i == 0 || ComparePieces(&split[i - 1], &split[i]) != 0 ) {
+                read = read + split[i].size;
+            }
+        }
+        if ( verbose >= 1 ) {
+            fprintf(stderr, "Reading %d sectors for %d titles that play %d\n",
+                    read, number_of_titles, played);
+        }
+
+        DVDPhaseStart(&phase);
+        result = DVDCopyExtents(disc->dvd, split, pieces);
+        DVDPhaseEnd(&phase, "DVDWriteCells");
+    }
+
+    for ( i = 0; i < planned; i++ ) {
+        DVDFreeCellPlan(&plan[i]);
+    }
+    free(plan);
+    free(extent);
+    free(split);
+
+    return(result);
+}
+
 int
-DVDDisplayInfo (dvd_reader_t *_dvd, char *dvd)
+DVDDisplayInfo (disc_info_t *disc, char *dvd)
 {
     int               i, f;
     int               chapters;
@@ -1970,15 +5537,14 @@ DVDDisplayInfo (dvd_reader_t *_dvd, char *dvd)
     title_set_info_t *title_set_info = NULL;
     titles_info_t    *titles_info    = NULL;
 
-    titles_info = DVDGetInfo(_dvd);
+    titles_info = DVDGetTitlesInfo(disc);
     if (!titles_info) {
         fprintf(stderr, "Guess work of main feature film failed\n");
         return(1);
     }
 
-    title_set_info = DVDGetFileSet(_dvd);
+    title_set_info = DVDGetTitleSetInfo(disc);
     if (!title_set_info) {
-        DVDFreeTitlesInfo(titles_info);
         return(1);
     }
 
@@ -2055,42 +5621,463 @@ DVDDisplayInfo (dvd_reader_t *_dvd, char *dvd)
 
     }
 
-    fprintf(stdout,"\n\nTitle Sets:");
-    for (f=0; f < title_set_info->number_of_title_sets ; f++ ) {
-        fprintf(stdout,"\n\n\tTitle set %d\n", f + 1);
-        for (i=0; i < titles_info->number_of_titles ; i++ ) {
-            if (titles_info->titles[i].title_set == f + 1) {
-                if(titles_info->titles[i].aspect_ratio == 3) {
-                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is 16:9\n", f + 1);
-                } else if (titles_info->titles[i].aspect_ratio == 0) {
-                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is 4:3\n", f + 1);
-                } else {
-                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is unknown\n", f + 1);
-                }
-                fprintf(stdout,"\t\tTitle set %d has %d angle(s)\n",
-                        f + 1, titles_info->titles[i].angles);
-                fprintf(stdout,"\t\tTitle set %d has %d audio_track(s)\n",
-                        f + 1, titles_info->titles[i].angles);
-                fprintf(stdout,"\t\tTitle set %d has %d subpicture channel(s)\n",
-                        f + 1, titles_info->titles[i].sub_pictures);
-                break;
-            }
+    fprintf(stdout,"\n\nTitle Sets:");
+    for (f=0; f < title_set_info->number_of_title_sets ; f++ ) {
+        fprintf(stdout,"\n\n\tTitle set %d\n", f + 1);
+        for (i=0; i < titles_info->number_of_titles ; i++ ) {
+            if (titles_info->titles[i].title_set == f + 1) {
+                if(titles_info->titles[i].aspect_ratio == 3) {
+                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is 16:9\n", f + 1);
+                } else if (titles_info->titles[i].aspect_ratio == 0) {
+                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is 4:3\n", f + 1);
+                } else {
+                    fprintf(stdout,"\t\tThe aspect ratio of title set %d is unknown\n", f + 1);
+                }
+                fprintf(stdout,"\t\tTitle set %d has %d angle(s)\n",
+                        f + 1, titles_info->titles[i].angles);
+                fprintf(stdout,"\t\tTitle set %d has %d audio_track(s)\n",
+                        f + 1, titles_info->titles[i].angles);
+                fprintf(stdout,"\t\tTitle set %d has %d subpicture channel(s)\n",
+                        f + 1, titles_info->titles[i].sub_pictures);
+                break;
+            }
+        }
+        fprintf(stdout,"\n\t\tTitles included in title set %d is/are\n", f + 1);
+        for (i=0; i < titles_info->number_of_titles ; i++ ) {
+            if (titles_info->titles[i].title_set == f + 1) {
+                fprintf(stdout,"\t\t\tTitle %d:\n", i + 1);
+                fprintf(stdout,"\t\t\t\tTitle %d has %d chapter(s)\n",
+                        i + 1, titles_info->titles[i].chapters);
+                fprintf(stdout,"\t\t\t\tTitle %d has %d audio channle(s)\n",
+                        i + 1, titles_info->titles[i].audio_channels);
+            }
+        }
+    }
+
+    return(0);
+}
+
+static int
+DVDCreateDirectory (char *targetname, char *what)
+{
+    struct stat fileinfo;
+
+    if (stat(targetname, &fileinfo) == 0) {
+        if (! S_ISDIR(fileinfo.st_mode)) {
+            fprintf(stderr,"The %s directory is not valid, "
+                    "it may be a ordinary file\n", what);
+        }
+    } else {
+        if (mkdir(targetname, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
+            fprintf(stderr,"Failed creating %s directory\n", what);
+            perror("");
+            return(1);
+        }
+    }
+    return(0);
+}
+
+/* Lay out targetdir/title_name.iso for the files of the disc, in the
+   order they are on it, and write everything but the files */
+static image_t*
+DVDImageCreate (disc_info_t *disc, char *targetdir, char *title_name)
+{
+    /* Loop variables */
+    int i, j;
+
+    title_set_info_t *title_set_info;
+    image_t          *image;
+    title_set_t      *set;
+    char              targetname[PATH_MAX];
+    char              base[32];
+    char              name[MAXNAME];
+    struct stat       fileinfo;
+    int               fd;
+    int               result = 0;
+
+    if ((title_set_info = DVDGetTitleSetInfo(disc)) == NULL) {
+        return(NULL);
+    }
+    if ((image = (image_t *)malloc(sizeof(image_t))) == NULL) {
+        fprintf(stderr, "Out of memory laying out the image\n");
+        return(NULL);
+    }
+
+    snprintf(targetname, sizeof(targetname), "%s/%s.iso", targetdir, title_name);
+    ImageInit(image, targetname, title_name);
+
+    for ( i = 0; i <= title_set_info->number_of_title_sets; i++ ) {
+        set = &title_set_info->title_set[i];
+        if (i == 0) {
+            strcpy(base, "VIDEO_TS");
+        } else {
+            snprintf(base, sizeof(base), "VTS_%02i_0", i);
+        }
+        snprintf(name, sizeof(name), "%s.IFO", base);
+        result |= ImageAddFile(image, name, set->size_ifo);
+        if (set->size_menu > 0) {
+            snprintf(name, sizeof(name), "%s.VOB", base);
+            result |= ImageAddFile(image, name, set->size_menu);
+        }
+        for ( j = 0; j < set->number_of_vob_files; j++ ) {
+            snprintf(name, sizeof(name), "VTS_%02i_%i.VOB", i, j + 1);
+            result |= ImageAddFile(image, name, set->size_vob[j]);
+        }
+        snprintf(name, sizeof(name), "%s.BUP", base);
+        result |= ImageAddFile(image, name, set->size_bup);
+    }
+    if (result != 0) {
+        fprintf(stderr, "Out of memory laying out the image\n");
+        ImageFree(image);
+        free(image);
+        return(NULL);
+    }
+    ImageLayout(image);
+
+    if (stat(targetname, &fileinfo) == 0) {
+        fprintf(stderr, "The image %s exists will try to over write it.\n", targetname);
+    }
+    if ((fd = open(targetname, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        fprintf(stderr, "Error creating %s\n", targetname);
+        perror("");
+        ImageFree(image);
+        free(image);
+        return(NULL);
+    }
+    if (ImageWriteHeader(image, fd) != 0 || close(fd) != 0) {
+        ImageFree(image);
+        free(image);
+        return(NULL);
+    }
+    return(image);
+}
+
+/* Back up one source into targetdir/title_name, the target directory
+   itself must exist. Returns the exit code for it */
+int
+DVDBackup (disc_info_t *disc, char *dvd, backup_mode_t *mode, char *title_name)
+{
+    int               i;
+    int               return_code = EXIT_SUCCESS;
+    char              targetname[PATH_MAX];
+    title_set_info_t *title_set_info;
+
+    if ( !DVDIsDrive(dvd) && (clone_source || map_source) ) {
+        current_source = dvd;
+        current_map    = (map_source ? DVDMapSource(dvd) : NULL);
+    }
+
+    if ( playable ) {
+        if ((title_set_info = DVDGetTitleSetInfo(disc)) == NULL
+            || DVDFindPlayable(disc, title_set_info) != 0) {
+            return(-1);
+        }
+    }
+
+    /* An image takes the place of the title and VIDEO_TS directories,
+       a stream needs neither */
+    if ( image ) {
+        if ((current_image = DVDImageCreate(disc, mode->targetdir, title_name)) == NULL) {
+            return(-1);
+        }
+    } else if ( stream_fd == -1 ) {
+        sprintf(targetname,"%s/%s",mode->targetdir, title_name);
+        if ( DVDCreateDirectory(targetname, "title") != 0 ) {
+            return(-1);
+        }
+
+        /* Each title of a list gets a directory of its own */
+        for ( i = 0; i < mode->number_of_titles && mode->number_of_titles > 1; i++ ) {
+            sprintf(targetname,"%s/%s/TITLE_%02i",mode->targetdir, title_name,
+                    mode->title_list[i]);
+            if ( DVDCreateDirectory(targetname, "title") != 0 ) {
+                return(-1);
+            }
+            strcat(targetname, "/VIDEO_TS");
+            if ( DVDCreateDirectory(targetname, "VIDEO_TS") != 0 ) {
+                return(-1);
+            }
+        }
+
+        sprintf(targetname,"%s/%s/VIDEO_TS",mode->targetdir, title_name);
+        if ( mode->number_of_titles <= 1
+             && DVDCreateDirectory(targetname, "VIDEO_TS") != 0 ) {
+            return(-1);
+        }
+    }
+
+    /* Whole files are journaled so an interrupted backup can resume */
+    if ( !image && (mode->do_mirror || mode->do_title_set || mode->do_feature) ) {
+        current_journal = DVDJournalOpen(mode->targetdir, title_name);
+    }
+
+    if ( checksum != CHECKSUM_NONE ) {
+        if ((current_manifest = DVDManifestOpen(mode->targetdir, title_name)) == NULL) {
+            DVDJournalClose(current_journal, 0);
+            current_journal = NULL;
+            return(-1);
+        }
+    }
+
+    if ( recover ) {
+        current_bad_map = DVDBadMapOpen(mode->targetdir, title_name);
+    }
+
+#ifdef DEBUG
+    fprintf(stderr,"After dirs\n");
+#endif
+
+    if(mode->do_mirror) {
+        if ( DVDMirror(disc, dvd, mode->targetdir, title_name)  != 0 ) {
+            fprintf(stderr, "Mirror of DVD failed\n");
+            return_code = EXIT_FAILURE;
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr,"After Mirror\n");
+#endif
+
+    if (mode->do_title_set) {
+        if (DVDMirrorTitleSet(disc, mode->targetdir, title_name,
+                              mode->title_set) != 0) {
+            fprintf(stderr, "Mirror of title set %d failed\n", mode->title_set);
+            return_code = EXIT_FAILURE;
+        }
+    }
+#ifdef DEBUG
+    fprintf(stderr,"After Title Set\n");
+#endif
+
+    if(mode->do_feature) {
+        if ( DVDMirrorMainFeature(disc, mode->targetdir, title_name)  != 0 ) {
+            fprintf(stderr, "Mirror of main feature film of DVD failed\n");
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    if(mode->do_titles && mode->number_of_titles > 1) {
+        if (DVDMirrorTitleList(disc, mode->targetdir, title_name,
+                               mode->title_list, mode->number_of_titles) != 0) {
+            fprintf(stderr, "Mirror of %d titles failed\n", mode->number_of_titles);
+            return_code = EXIT_FAILURE;
+        }
+    } else if(mode->do_titles) {
+        if (DVDMirrorTitles(disc, mode->targetdir, title_name,
+                            mode->titles) != 0) {
+            fprintf(stderr, "Mirror of title  %d failed\n", mode->titles);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    if(mode->do_chapter) {
+        if (DVDMirrorChapters(disc, mode->targetdir, title_name,
+                              mode->start_chapter, mode->end_chapter,
+                              mode->titles) != 0) {
+            fprintf(stderr, "Mirror of chapters %d to %d in title %d failed\n",
+                    mode->start_chapter, mode->end_chapter, mode->titles);
+            return_code = EXIT_FAILURE;
+        }
+    }
+
+    DVDJournalClose(current_journal, return_code == EXIT_SUCCESS);
+    current_journal = NULL;
+    DVDManifestClose(current_manifest);
+    current_manifest = NULL;
+    DVDBadMapClose(current_bad_map);
+    current_bad_map = NULL;
+    if ( current_image != NULL ) {
+        ImageFree(current_image);
+        free(current_image);
+        current_image = NULL;
+    }
+    current_source = NULL;
+    if ( current_map != NULL ) {
+        munmap(current_map->data, current_map->size);
+        free(current_map);
+        current_map = NULL;
+    }
+
+    return(return_code);
+}
+
+/* Two discs of a batch with the same title get their own directories,
+   the later one a _2, _3 ... suffix */
+static void
+DVDBatchClaimTitle (batch_job_t *job, char *title_name)
+{
+    /* Loop variable */
+    int i;
+
+    int suffix = 1;
+
+    pthread_mutex_lock(job->lock);
+    strcpy(job->title_name, title_name);
+    for ( i = 0; i < job->jobs; i++ ) {
+        if ( &job->batch[i] != job
+             && strcmp(job->batch[i].title_name, job->title_name) == 0 ) {
+            sprintf(job->title_name, "%s_%d", title_name, ++suffix);
+            i = -1;
+        }
+    }
+    pthread_mutex_unlock(job->lock);
+}
+
+static void
+DVDBatchReport (batch_job_t *job)
+{
+    double megabytes = job->bytes / (1024.0 * 1024.0);
+
+    fprintf(stderr, "%s: %s %s, %.1f MB in %.1f s, %.1f MB/s\n",
+            job->dvd, job->title_name[0] != '\0' ? job->title_name : "-",
+            job->result == EXIT_SUCCESS ? "done" : "failed",
+            megabytes, job->seconds,
+            job->seconds > 0 ? megabytes / job->seconds : 0.0);
+}
+
+static void *
+DVDBatchJob (void *arg)
+{
+    batch_job_t     *job = (batch_job_t *)arg;
+    dvd_reader_t    *_dvd;
+    disc_info_t     *disc;
+    char             title_name[33];
+    struct timespec  start;
+    struct timespec  end;
+
+    /* Bytes copied on this thread, and by its mirror workers, are
+       counted for this job */
+    current_job = job;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    job->result = EXIT_FAILURE;
+
+    if ((_dvd = DVDOpen(job->dvd)) == NULL) {
+        fprintf(stderr, "Failed opening %s\n", job->dvd);
+    } else {
+        if (DVDGetTitleName(job->dvd, title_name) != 0) {
+            fprintf(stderr, "Can't determine the title of %s, "
+                    "back it up on its own with -n\n", job->dvd);
+        } else if (strstr(title_name, "DVD_VIDEO") != NULL) {
+            fprintf(stderr, "The DVD-Video title of %s is DVD_VIDEO which "
+                    "is to generic, back it up on its own with -n\n", job->dvd);
+            job->result = 2;
+        } else if ((disc = DVDOpenDiscInfo(_dvd)) != NULL) {
+            DVDBatchClaimTitle(job, title_name);
+            job->result = DVDBackup(disc, job->dvd, job->mode, job->title_name);
+            DVDCloseDiscInfo(disc);
+        }
+        DVDFreeCopyPool();
+        DVDClose(_dvd);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    job->seconds = (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    pthread_mutex_lock(job->lock);
+    DVDBatchReport(job);
+    pthread_mutex_unlock(job->lock);
+
+    return(NULL);
+}
+
+/* Back up every source at once, each with its own reader and one set
+   of writers shared by all. A failing source doesn't stop the others */
+int
+DVDBatch (char *sources[], int number_of_sources, backup_mode_t *mode)
+{
+    /* Loop variable */
+    int i;
+
+    pthread_mutex_t  lock;
+    batch_job_t      job[MAX_SOURCES];
+    pthread_t        thread[MAX_SOURCES];
+    int              started[MAX_SOURCES];
+    int              return_code = EXIT_SUCCESS;
+    long long        bytes       = 0;
+    double           megabytes;
+    double           seconds;
+    struct timespec  start;
+    struct timespec  end;
+
+    if ( DVDStartWritePool(writers) != 0 ) {
+        return(EXIT_FAILURE);
+    }
+
+    pthread_mutex_init(&lock, NULL);
+    memset(job, 0, sizeof(job));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for ( i = 0; i < number_of_sources; i++ ) {
+        job[i].lock  = &lock;
+        job[i].batch = job;
+        job[i].jobs  = number_of_sources;
+        job[i].dvd   = sources[i];
+        job[i].mode  = mode;
+    }
+
+    for ( i = 0; i < number_of_sources; i++ ) {
+        started[i] = (pthread_create(&thread[i], NULL, DVDBatchJob, &job[i]) == 0);
+        if ( !started[i] ) {
+            fprintf(stderr, "Failed starting the backup of %s\n", sources[i]);
+            job[i].result = EXIT_FAILURE;
         }
-        fprintf(stdout,"\n\t\tTitles included in title set %d is/are\n", f + 1);
-        for (i=0; i < titles_info->number_of_titles ; i++ ) {
-            if (titles_info->titles[i].title_set == f + 1) {
-                fprintf(stdout,"\t\t\tTitle %d:\n", i + 1);
-                fprintf(stdout,"\t\t\t\tTitle %d has %d chapter(s)\n",
-                        i + 1, titles_info->titles[i].chapters);
-                fprintf(stdout,"\t\t\t\tTitle %d has %d audio channle(s)\n",
-                        i + 1, titles_info->titles[i].audio_channels);
-            }
+    }
+
+    for ( i = 0; i < number_of_sources; i++ ) {
+        if ( started[i] ) {
+            pthread_join(thread[i], NULL);
         }
     }
-    DVDFreeTitlesInfo(titles_info);
-    DVDFreeTitleSetInfo(title_set_info);
 
-    return(0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    DVDStopWritePool();
+    pthread_mutex_destroy(&lock);
+
+    fprintf(stderr, "\nBatch summary:\n");
+    for ( i = 0; i < number_of_sources; i++ ) {
+        fprintf(stderr, "  ");
+        DVDBatchReport(&job[i]);
+        bytes = bytes + job[i].bytes;
+        if ( job[i].result != EXIT_SUCCESS ) {
+            return_code = EXIT_FAILURE;
+        }
+    }
+    megabytes = bytes / (1024.0 * 1024.0);
+    fprintf(stderr, "  Total: %.1f MB in %.1f s, %.1f MB/s\n",
+            megabytes, seconds, seconds > 0 ? megabytes / seconds : 0.0);
+
+    return(return_code);
+}
+
+/* A backup with zero filled sectors is complete but not intact */
+static void
+DVDReportUnreadable (void)
+{
+    if ( sectors_unreadable > 0 ) {
+        fprintf(stderr, "%lu unreadable sectors were zero filled, they are "
+                "listed in %s\n", sectors_unreadable, BAD_MAP_NAME);
+    }
+}
+
+static void
+DVDReportCloned (void)
+{
+    if ( sectors_cloned > 0 ) {
+        fprintf(stderr, "Cloned: %lu sectors copied from the source file "
+                "in the kernel\n", sectors_cloned);
+    }
+}
+
+static void
+DVDReportIncremental (void)
+{
+    if ( incremental ) {
+        fprintf(stderr, "Incremental: %lu sectors unchanged, %lu sectors rewritten\n",
+                sectors_unchanged, sectors_rewritten);
+    }
 }
 
 int
@@ -2100,10 +6087,16 @@ main (int argc, char *argv[])
     int flags;
 
     /* Switches */
-    int title_set = 0;
-    int titles;
-    int start_chapter;
-    int end_chapter;
+    int title_set     = 0;
+    int titles        = 0;
+    int start_chapter = 0;
+    int end_chapter   = 0;
+
+    /* Every title of -t 1,3,5 */
+    int  *title_list       = NULL;
+    int   number_of_titles = 0;
+    char *next;
+    int   i, j;
 
     int do_mirror    = 0;
     int do_title_set = 0;
@@ -2111,12 +6104,23 @@ main (int argc, char *argv[])
     int do_titles    = 0;
     int do_feature   = 0;
     int do_info      = 0;
+    int dedup        = 0;
 
     int return_code;
 
     /* DVD Video device */
     char *dvd = NULL;
 
+    /* Every -i given, more than one is a batch */
+    char *sources[MAX_SOURCES];
+    int   number_of_sources = 0;
+
+    /* What to back up */
+    backup_mode_t mode;
+
+    /* To tell a named pipe -o from a directory */
+    struct stat fileinfo;
+
     /* Temp switch helpers */
     char *verbose_temp       = NULL;
     char *aspect_temp        = NULL;
@@ -2124,6 +6128,12 @@ main (int argc, char *argv[])
     char *end_chapter_temp   = NULL;
     char *titles_temp        = NULL;
     char *title_set_temp     = NULL;
+    char *ring_depth_temp    = NULL;
+    char *buf_blocks_temp    = NULL;
+    char *mirror_jobs_temp   = NULL;
+    char *writers_temp       = NULL;
+    char *journal_interval_temp = NULL;
+    char *retries_temp = NULL;
 
     /* Title of the DVD */
     char title_name[33]       = "";
@@ -2132,27 +6142,54 @@ main (int argc, char *argv[])
     /* Targer dir */
     char *targetdir = NULL;
 
-    /* Temp filename,dirname */
-    char        targetname[PATH_MAX];
-    struct stat fileinfo;
-
     /* The DVD main structure */
     dvd_reader_t *_dvd = NULL;
 
+    /* Its IFOs */
+    disc_info_t *disc = NULL;
+
     /*Todo do isdigit check */
 
-    while ((flags = getopt(argc, argv, "MFI?hi:v:a:o:n:s:e:t:T:")) != -1) {
+    static struct option long_options[] = {
+        {"direct-io", no_argument, NULL, OPT_DIRECT_IO},
+        {"sparse",    no_argument, NULL, OPT_SPARSE},
+        {"resume",    no_argument, NULL, OPT_RESUME},
+        {"incremental", no_argument, NULL, OPT_INCREMENTAL},
+        {"checksum",  required_argument, NULL, OPT_CHECKSUM},
+        {"recover",   no_argument, NULL, OPT_RECOVER},
+        {"retries",   required_argument, NULL, OPT_RETRIES},
+        {"rescue",    no_argument, NULL, OPT_RESCUE},
+        {"adaptive",  no_argument, NULL, OPT_ADAPTIVE},
+        {"stats",     required_argument, NULL, OPT_STATS},
+        {"progress",  required_argument, NULL, OPT_PROGRESS},
+        {"image",     no_argument,       NULL, OPT_IMAGE},
+        {"playable",  no_argument,       NULL, OPT_PLAYABLE},
+        {"dedup",     no_argument,       NULL, OPT_DEDUP},
+        {"no-clone",  no_argument,       NULL, OPT_NO_CLONE},
+        {"mmap",      no_argument,       NULL, OPT_MMAP},
+        {"journal-interval", required_argument, NULL, OPT_JOURNAL_INTERVAL},
+        {NULL, 0, NULL, 0}
+    };
+
+#ifdef __linux__
+    clone_source = 1;
+#endif
+
+    while ((flags = getopt_long(argc, argv, "MFIu?hi:v:a:o:n:s:e:t:T:r:b:j:w:",
+                                long_options, NULL)) != -1) {
         switch (flags) {
         case 'i':
             if(optarg[0]=='-') usage();
+            if (number_of_sources == MAX_SOURCES) usage();
             dvd = optarg;
+            sources[number_of_sources++] = optarg;
             break;
         case 'v':
             if(optarg[0]=='-') usage();
             verbose_temp = optarg;
             break;
         case 'o':
-            if(optarg[0]=='-') usage();
+            if(optarg[0]=='-' && strcmp(optarg, "-") != 0) usage();
             targetdir = optarg;
             break;
         case 'n':
@@ -2179,6 +6216,22 @@ main (int argc, char *argv[])
             if(optarg[0]=='-') usage();
             title_set_temp = optarg;
             break;
+        case 'r':
+            if(optarg[0]=='-') usage();
+            ring_depth_temp = optarg;
+            break;
+        case 'b':
+            if(optarg[0]=='-') usage();
+            buf_blocks_temp = optarg;
+            break;
+        case 'j':
+            if(optarg[0]=='-') usage();
+            mirror_jobs_temp = optarg;
+            break;
+        case 'w':
+            if(optarg[0]=='-') usage();
+            writers_temp = optarg;
+            break;
         case 'M':
             do_mirror = 1;
             break;
@@ -2188,6 +6241,69 @@ main (int argc, char *argv[])
         case 'I':
             do_info = 1;
             break;
+        case 'u':
+            use_uring = 1;
+            break;
+        case OPT_DIRECT_IO:
+            direct_io = 1;
+            break;
+        case OPT_SPARSE:
+            sparse = 1;
+            break;
+        case OPT_RESUME:
+            resume = 1;
+            break;
+        case OPT_INCREMENTAL:
+            incremental = 1;
+            break;
+        case OPT_RECOVER:
+            recover = 1;
+            break;
+        case OPT_STATS:
+            stats_file = optarg;
+            break;
+        case OPT_PROGRESS:
+            if(optarg[0]=='-') usage();
+            progress_interval = atoi(optarg);
+            if ( progress_interval < 1 ) {
+                usage();
+            }
+            break;
+        case OPT_ADAPTIVE:
+            adaptive = 1;
+            break;
+        case OPT_IMAGE:
+            image = 1;
+            break;
+        case OPT_PLAYABLE:
+            playable = 1;
+            break;
+        case OPT_DEDUP:
+            dedup = 1;
+            break;
+        case OPT_NO_CLONE:
+            clone_source = 0;
+            break;
+        case OPT_MMAP:
+            map_source = 1;
+            break;
+        case OPT_RESCUE:
+            rescue  = 1;
+            recover = 1;
+            break;
+        case OPT_RETRIES:
+            if(optarg[0]=='-') usage();
+            retries_temp = optarg;
+            break;
+        case OPT_CHECKSUM:
+            if ((checksum = ChecksumType(optarg)) == CHECKSUM_NONE) {
+                usage();
+            }
+            break;
+        case OPT_JOURNAL_INTERVAL:
+            if(optarg[0]=='-') usage();
+            journal_interval_temp = optarg;
+            break;
 
         case '?':
             usage();
@@ -2208,6 +6324,12 @@ main (int argc, char *argv[])
         usage();
     }
 
+    /* Titles come from the discs themselves in batch mode */
+    if (number_of_sources > 1
+        && (do_info || provided_title_name != NULL)) {
+        usage();
+    }
+
     if(verbose_temp == NULL) {
         verbose = 0;
     } else {
@@ -2225,13 +6347,103 @@ main (int argc, char *argv[])
         usage();
     }
 
-    if ( titles_temp != NULL) {
-        titles = atoi(titles_temp);
-        if ( titles < 1 ) {
+    if (ring_depth_temp == NULL) {
+        ring_depth = RING_DEPTH;
+    } else {
+        ring_depth = atoi(ring_depth_temp);
+        if ( ring_depth < 1 || ring_depth > MAX_RING_DEPTH ) {
+            usage();
+        }
+    }
+
+    if (mirror_jobs_temp == NULL) {
+        mirror_jobs = 1;
+    } else {
+        mirror_jobs = atoi(mirror_jobs_temp);
+        if ( mirror_jobs < 1 || mirror_jobs > MAX_MIRROR_JOBS ) {
+            usage();
+        }
+    }
+
+    if (journal_interval_temp == NULL) {
+        journal_interval = JOURNAL_INTERVAL;
+    } else {
+        journal_interval = atoi(journal_interval_temp);
+        if ( journal_interval < 0 ) {
+            usage();
+        }
+    }
+
+    if (retries_temp == NULL) {
+        read_retries = READ_RETRIES;
+    } else {
+        read_retries = atoi(retries_temp);
+        if ( read_retries < 0 ) {
+            usage();
+        }
+    }
+
+    if (writers_temp == NULL) {
+        writers = WRITERS;
+    } else {
+        writers = atoi(writers_temp);
+        if ( writers < 1 || writers > MAX_WRITERS ) {
+            usage();
+        }
+    }
+
+    /* The shared writers use write() */
+    if (use_uring && number_of_sources > 1) {
+        fprintf(stderr, "io_uring is not used in batch mode, using write()\n");
+        use_uring = 0;
+    }
+
+#ifndef HAVE_LIBURING
+    if (use_uring) {
+        fprintf(stderr, "dvdbackup was built without io_uring support, "
+                "using write()\n");
+        use_uring = 0;
+    }
+#endif
+
+    if (buf_blocks_temp == NULL) {
+        buf_blocks = READ_BUF_SIZE_IN_BLOCKS;
+    } else {
+        buf_blocks = atoi(buf_blocks_temp);
+        if ( buf_blocks < 1 || buf_blocks > MAX_BUF_SIZE_IN_BLOCKS ) {
             usage();
         }
     }
 
+    /* Keep every buffer but the last one of a copy aligned for O_DIRECT */
+    if (direct_io && buf_blocks % (DIRECT_IO_ALIGN / DVD_VIDEO_LB_LEN) != 0) {
+        buf_blocks = buf_blocks + DIRECT_IO_ALIGN / DVD_VIDEO_LB_LEN
+            - buf_blocks % (DIRECT_IO_ALIGN / DVD_VIDEO_LB_LEN);
+    }
+
+    if ( titles_temp != NULL) {
+        for ( next = titles_temp, number_of_titles = 1; *next != '\0'; next++ ) {
+            number_of_titles += (*next == ',');
+        }
+        if ((title_list = (int *)malloc(number_of_titles * sizeof(int))) == NULL) {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+        for ( i = 0, next = titles_temp; i < number_of_titles; i++ ) {
+            title_list[i] = strtol(next, &next, 10);
+            if ( title_list[i] < 1 || (*next != ',' && *next != '\0') ) {
+                usage();
+            }
+            for ( j = 0; j < i; j++ ) {
+                if ( title_list[j] == title_list[i] ) {
+                    usage();
+                }
+            }
+            next++;
+        }
+        titles = title_list[0];
+    }
+
     if ( start_chapter_temp !=NULL) {
         start_chapter = atoi(start_chapter_temp);
         if ( start_chapter < 1 || start_chapter > 99 ) {
@@ -2281,23 +6493,127 @@ main (int argc, char *argv[])
     } else if (do_info + do_titles + do_chapter + do_feature + do_title_set + do_mirror == 0) {
         usage();
     }
+
+    /* Only -M has a VMG for the image to be played from, and the image
+       is written from scratch, without the files the journal, the
+       manifest and the rescue maps are kept for */
+    if (image && (!do_mirror || resume || incremental || recover
+                  || checksum != CHECKSUM_NONE)) {
+        usage();
+    }
+
+    /* Titles of a list go to their own directories, the manifest only
+       knows files by name */
+    if (number_of_titles > 1 && (do_chapter || checksum != CHECKSUM_NONE)) {
+        usage();
+    }
+
+    /* The store sits next to the backups, a stream or an image has none */
+    if (dedup && (image || (targetdir != NULL && (strcmp(targetdir, "-") == 0
+                                                  || (stat(targetdir, &fileinfo) == 0
+                                                      && S_ISFIFO(fileinfo.st_mode)))))) {
+        usage();
+    }
+
+    /* -t and -s/-e only copy played cells anyway */
+    if (playable && !(do_mirror || do_feature || do_title_set)) {
+        usage();
+    }
+
+    /* A sector of the mapping that can't be read is a SIGBUS, not an
+       error --recover could zero fill */
+    if (map_source && recover) {
+        usage();
+    }
+
+    /* -o - or a named pipe streams the cells of -t and -s/-e. Nothing
+       but the cells goes there, in the order they come */
+    stream_fd = -1;
+    if (targetdir != NULL && (strcmp(targetdir, "-") == 0
+                              || (stat(targetdir, &fileinfo) == 0
+                                  && S_ISFIFO(fileinfo.st_mode)))) {
+        if (!(do_titles || do_chapter) || number_of_sources > 1 || sparse
+            || number_of_titles > 1 || resume || incremental || recover || checksum != CHECKSUM_NONE) {
+            usage();
+        }
+        if (strcmp(targetdir, "-") == 0) {
+            stream_fd = STDOUT_FILENO;
+        } else if ((stream_fd = open(targetdir, O_WRONLY)) == -1) {
+            fprintf(stderr, "Error opening %s\n", targetdir);
+            perror("");
+            exit(EXIT_FAILURE);
+        }
+        if (use_uring) {
+            fprintf(stderr, "io_uring is not used for a stream, using write()\n");
+            use_uring = 0;
+        }
+    }
 #ifdef DEBUG
     fprintf(stderr,"After args\n");
 #endif
 
+    mode.do_mirror     = do_mirror;
+    mode.do_title_set  = do_title_set;
+    mode.do_chapter    = do_chapter;
+    mode.do_titles     = do_titles;
+    mode.do_feature    = do_feature;
+    mode.title_set     = title_set;
+    mode.titles        = titles;
+    mode.start_chapter = start_chapter;
+    mode.end_chapter   = end_chapter;
+    mode.title_list       = title_list;
+    mode.number_of_titles = number_of_titles;
+
+    mode.targetdir     = targetdir;
+
+    DVDStatsStart();
+
+    if (number_of_sources > 1) {
+        if (DVDCreateDirectory(targetdir, "target") != 0) {
+            exit(-1);
+        }
+        if (dedup && (dedup_store = StoreOpen(targetdir)) == NULL) {
+            exit(-1);
+        }
+        return_code = DVDBatch(sources, number_of_sources, &mode);
+
+        if ( verbose > 0 ) {
+            fprintf(stderr, "Output: %lu write() calls\n", write_calls);
+            DVDReportCloned();
+            DVDReportIncremental();
+        }
+        DVDReportUnreadable();
+        if (dedup_store != NULL) {
+            StoreReport(dedup_store);
+            StoreClose(dedup_store);
+        }
+        DVDStatsStop();
+        exit(return_code);
+    }
+
     _dvd = DVDOpen(dvd);
     if(!_dvd) exit(-1);
 
+    disc = DVDOpenDiscInfo(_dvd);
+    if (!disc) {
+        DVDClose(_dvd);
+        exit(EXIT_FAILURE);
+    }
+
     if (do_info) {
-        DVDDisplayInfo(_dvd, dvd);
+        DVDDisplayInfo(disc, dvd);
+        DVDCloseDiscInfo(disc);
         DVDClose(_dvd);
         exit(EXIT_SUCCESS);
     }
 
-    if(provided_title_name == NULL) {
+    if(provided_title_name == NULL && stream_fd != -1) {
+        /* Nothing is named after the title */
+    } else if(provided_title_name == NULL) {
         if (DVDGetTitleName(dvd, title_name) != 0) {
             fprintf(stderr,"You must provide a title name when you "
                     "read your DVD-Video structure direct from the HD\n");
+            DVDCloseDiscInfo(disc);
             DVDClose(_dvd);
             exit(EXIT_FAILURE);
         }
@@ -2305,6 +6621,7 @@ main (int argc, char *argv[])
             fprintf(stderr,"The DVD-Video title on the disk is "
                     "DVD_VIDEO which is to generic please "
                     "provide a title with the -n switch\n");
+            DVDCloseDiscInfo(disc);
             DVDClose(_dvd);
             exit(2);
         }
@@ -2320,112 +6637,37 @@ main (int argc, char *argv[])
         }
     }
 
-    sprintf(targetname,"%s",targetdir);
-
-    if (stat(targetname, &fileinfo) == 0) {
-        if (! S_ISDIR(fileinfo.st_mode)) {
-            fprintf(stderr,"The target directory is not valid, "
-                    "it may be a ordinary file\n");
-        }
-    } else {
-        if (mkdir(targetname, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-            fprintf(stderr,"Failed creating target directory\n");
-            perror("");
-            DVDClose(_dvd);
-            exit(-1);
-        }
-    }
-
-    sprintf(targetname,"%s/%s",targetdir, title_name);
-
-    if (stat(targetname, &fileinfo) == 0) {
-        if (! S_ISDIR(fileinfo.st_mode)) {
-            fprintf(stderr,"The title directory is not valid, "
-                    "it may be a ordinary file\n");
-        }
-    } else {
-        if (mkdir(targetname, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-            fprintf(stderr,"Failed creating title directory\n");
-            perror("");
-            DVDClose(_dvd);
-            exit(-1);
-        }
-    }
-
-    sprintf(targetname,"%s/%s/VIDEO_TS",targetdir, title_name);
-
-    if (stat(targetname, &fileinfo) == 0) {
-        if (! S_ISDIR(fileinfo.st_mode)) {
-            fprintf(stderr,"The VIDEO_TS directory is not valid, "
-                    "it may be a ordinary file\n");
-        }
-    } else {
-        if (mkdir(targetname, S_IRUSR | S_IWUSR | S_IXUSR) != 0) {
-            fprintf(stderr,"Failed creating VIDEO_TS directory\n");
-            perror("");
-            DVDClose(_dvd);
-            exit(-1);
-        }
-    }
-
-#ifdef DEBUG
-    fprintf(stderr,"After dirs\n");
-#endif
-
-    if(do_mirror) {
-        if ( DVDMirror(_dvd, targetdir, title_name)  != 0 ) {
-            fprintf(stderr, "Mirror of DVD failed\n");
-            return_code = EXIT_FAILURE;
-        } else {
-            return_code = EXIT_SUCCESS;
-        }
+    if ((stream_fd == -1 && DVDCreateDirectory(targetdir, "target") != 0)
+        || (dedup && (dedup_store = StoreOpen(targetdir)) == NULL)) {
+        DVDCloseDiscInfo(disc);
+        DVDClose(_dvd);
+        exit(-1);
     }
-#ifdef DEBUG
-    fprintf(stderr,"After Mirror\n");
-#endif
 
-    if (do_title_set) {
-        if (DVDMirrorTitleSet(_dvd, targetdir, title_name, title_set) != 0) {
-            fprintf(stderr, "Mirror of title set %d failed\n", title_set);
-            return_code = EXIT_FAILURE;
-        } else {
-            return_code = EXIT_SUCCESS;
-        }
+    return_code = DVDBackup(disc, dvd, &mode, title_name);
 
+    if (stream_fd != -1 && close(stream_fd) != 0) {
+        fprintf(stderr, "Error closing %s\n", targetdir);
+        return_code = EXIT_FAILURE;
     }
-#ifdef DEBUG
-    fprintf(stderr,"After Title Set\n");
-#endif
 
-    if(do_feature) {
-        if ( DVDMirrorMainFeature(_dvd, targetdir, title_name)  != 0 ) {
-            fprintf(stderr, "Mirror of main feature film of DVD failed\n");
-            return_code = EXIT_FAILURE;
-        } else {
-            return_code = EXIT_SUCCESS;
-        }
-    }
+    DVDFreeCopyPool();
 
-    if(do_titles) {
-        if (DVDMirrorTitles(_dvd, targetdir, title_name, titles) != 0) {
-            fprintf(stderr, "Mirror of title  %d failed\n", titles);
-            return_code = EXIT_FAILURE;
-        } else {
-            return_code = EXIT_SUCCESS;
-        }
+    if ( verbose > 0 ) {
+        fprintf(stderr, "Output: %lu write() calls, %lu io_uring submissions, "
+                "%lu io_uring completions\n",
+                write_calls, uring_submissions, uring_completions);
+        DVDReportCloned();
+        DVDReportIncremental();
     }
-
-    if(do_chapter) {
-        if (DVDMirrorChapters(_dvd, targetdir, title_name,
-                              start_chapter, end_chapter, titles) != 0) {
-            fprintf(stderr, "Mirror of chapters %d to %d in title %d failed\n",
-                    start_chapter, end_chapter, titles);
-            return_code = EXIT_FAILURE;
-        } else {
-            return_code = EXIT_SUCCESS;
-        }
+    DVDReportUnreadable();
+    if (dedup_store != NULL) {
+        StoreReport(dedup_store);
+        StoreClose(dedup_store);
     }
+    DVDStatsStop();
 
+    DVDCloseDiscInfo(disc);
     DVDClose(_dvd);
     exit(return_code);
 }
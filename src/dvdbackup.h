@@ -19,6 +19,9 @@
 
 /* dvdbackup version 0.1 */
 
+/* O_DIRECT, fallocate() and copy_file_range() on Linux */
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -26,15 +29,36 @@
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <sys/ioctl.h>
+#include <linux/magic.h>
+#include <linux/fs.h>
+#else
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
 #include <fcntl.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <string.h>
 #include <limits.h>
 #include <sysexits.h>
+#include <pthread.h>
+#include <time.h>
+#include <ctype.h>
 #include <dvdread/dvd_reader.h>
 #include <dvdread/ifo_read.h>
 #include <dvdread/ifo_print.h>
 #include <dvdread/dvd_udf.h>
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include "checksum.h"
+#include "image.h"
+#include "store.h"
 
 #define MAXNAME 256
 
@@ -42,18 +66,213 @@
 #define READ_BUF_SIZE (1024 * 1024 * 4)
 #define READ_BUF_SIZE_IN_BLOCKS (READ_BUF_SIZE / DVD_VIDEO_LB_LEN)
 
+/* Number of buffers the reader thread may fill ahead of the writer */
+#define RING_DEPTH     2
+#define MAX_RING_DEPTH 64
+
+/* Upper limit for -b, 128 MB per buffer */
+#define MAX_BUF_SIZE_IN_BLOCKS 65536
+
+/* --adaptive starts every extent with ADAPT_START_BLOCKS sector reads
+   and doubles them, up to -b, while that pays ADAPT_GAIN more
+   throughput. Reads slower than ADAPT_MAX_LATENCY seconds are halved,
+   down to ADAPT_MIN_BLOCKS. Each size is judged on ADAPT_SAMPLES reads */
+#define ADAPT_START_BLOCKS 64
+#define ADAPT_MIN_BLOCKS   16
+#define ADAPT_GAIN         0.1
+#define ADAPT_MAX_LATENCY  0.5
+#define ADAPT_SAMPLES      2
+
+/* Latency histograms have power of two buckets of microseconds, the
+   last one takes everything slower. Phases are kept per name */
+#define LATENCY_BUCKETS 24
+#define MAX_PHASES      16
+
+/* Upper limit for -j */
+#define MAX_MIRROR_JOBS 64
+
+/* Upper limits for batch mode, sources given with -i and -w */
+#define MAX_SOURCES 32
+#define WRITERS     2
+#define MAX_WRITERS 64
+
+/* Weights of the main feature score. Playback time dominates, cells
+   (up to SCORE_MAX_CELLS), streams and the -a aspect ratio only decide
+   between titles of about the same length */
+#define SCORE_SECOND     10
+#define SCORE_CELL       5
+#define SCORE_MAX_CELLS  100
+#define SCORE_AUDIO      60
+#define SCORE_SUBPICTURE 30
+#define SCORE_CHANNEL    20
+#define SCORE_ASPECT     600
+
+/* Counters are bumped from several threads */
+#define COUNT(counter) __sync_fetch_and_add(&(counter), 1)
+
+/* Buffer address and write alignment for --direct-io */
+#define DIRECT_IO_ALIGN 4096
+
+/* Cloning an image or directory source. A VOBU is judged by the packs
+   right after its NAV pack, where there are no NAV packs sectors are
+   read and checked this many at a time. Reflinks share whole blocks */
+#define CLONE_VOBU_CHECK  2
+#define CLONE_MAX_VOBU    4096
+#define CLONE_SCAN_BLOCKS 64
+#define CLONE_BLOCK_LEN   4096
+
+/* Only Linux writes with O_DIRECT, elsewhere --direct-io writes through
+   the page cache. fdatasync() isn't everywhere, fsync() is */
+#ifdef __linux__
+#define DIRECT_IO_FLAG O_DIRECT
+#else
+#define DIRECT_IO_FLAG 0
+#define fdatasync(fd) fsync(fd)
+#endif
+
+/* Long only options */
+#define OPT_DIRECT_IO 256
+#define OPT_SPARSE    257
+#define OPT_RESUME    258
+#define OPT_JOURNAL_INTERVAL 259
+#define OPT_INCREMENTAL 260
+#define OPT_CHECKSUM    261
+#define OPT_RECOVER     262
+#define OPT_RETRIES     263
+#define OPT_RESCUE      264
+#define OPT_ADAPTIVE    265
+#define OPT_STATS       266
+#define OPT_PROGRESS    267
+#define OPT_IMAGE       268
+#define OPT_PLAYABLE    269
+#define OPT_DEDUP       270
+#define OPT_NO_CLONE    271
+#define OPT_MMAP        272
+
+/* Seconds between journal commits, and the journal's name next to
+   VIDEO_TS */
+#define JOURNAL_INTERVAL 10
+#define JOURNAL_NAME     "dvdbackup.journal"
+
+/* Sectors compared at a time by --incremental, a group that differs is
+   rewritten as a whole */
+#define COMPARE_GROUP_IN_BLOCKS 16
+
+/* The --checksum manifest next to VIDEO_TS, with a checksum for every
+   file and for every CHECKSUM_BLOCK_SIZE bytes of it */
+#define MANIFEST_NAME       "dvdbackup.manifest"
+#define CHECKSUM_BLOCK_SIZE (1024 * 1024)
+
+/* --recover retries an unreadable sector up to SECTOR_RETRIES times.
+   Those retries and the reads that narrow a failed block down to its
+   bad sectors are READ_RETRIES in all unless --retries says otherwise.
+   What stays unreadable is listed in BAD_MAP_NAME next to VIDEO_TS */
+#define SECTOR_RETRIES 3
+#define READ_RETRIES   256
+#define BAD_MAP_NAME   "dvdbackup.bad"
+
+/* Directory next to VIDEO_TS with a ddrescue map for every file that
+   isn't read in full yet */
+#define RESCUE_DIR     "rescue"
+
 /* Flag for verbose mode */
 int verbose;
 int aspect;
 
+/* Read/write pipeline settings */
+int ring_depth;
+int buf_blocks;
+int adaptive;
+
+/* Workers for -M when the source is an image or a directory */
+int mirror_jobs;
+
+/* Write backend, io_uring if -u is given and it is compiled in */
+int use_uring;
+
+/* Write VOBs with O_DIRECT to keep them out of the page cache */
+int direct_io;
+
+/* Write -t and -s/-e cells at their offsets in full size, sparse VOBs */
+int sparse;
+
+/* Skip what the journal of an interrupted backup says is done */
+int resume;
+int journal_interval;
+
+/* Only rewrite what differs from an existing backup */
+int incremental;
+
+/* Checksum for the manifest, CHECKSUM_NONE for none */
+int checksum;
+
+/* Zero fill unreadable sectors instead of giving up on the file, and
+   what is left of the retries for them */
+int recover;
+int read_retries;
+
+/* Only read what the rescue maps of an earlier --recover say is missing */
+int rescue;
+
+/* Only copy the VOB sectors some PGC plays, leaving holes for the rest */
+int playable;
+
+/* With --dedup every finished VOB goes in the store under -o */
+store_t *dedup_store;
+
+/* Copy unscrambled sectors of an image or directory source with
+   copy_file_range() instead of reading and writing them */
+int clone_source;
+
+/* Hand out the sectors of an image source straight from a mapping of it */
+int map_source;
+
+/* Writer threads shared by all sources in batch mode */
+int writers;
+
+/* Where --stats writes its JSON report, - for stderr, and seconds
+   between --progress lines */
+char *stats_file;
+int   progress_interval;
+
+/* Write a disc image for -M instead of a VIDEO_TS directory */
+int image;
+
+/* Where -t and -s/-e stream their cells in playback order when -o is
+   - or a named pipe, -1 when they write VOB files */
+int stream_fd;
+
+/* Output counters, reported in verbose mode */
+unsigned long write_calls;
+unsigned long uring_submissions;
+unsigned long uring_completions;
+unsigned long sectors_unchanged;
+unsigned long sectors_rewritten;
+unsigned long sectors_unreadable;
+unsigned long sectors_cloned;
+
 /* Structs to keep title set information in */
 
+/* Sectors start to end - 1 of a VOB domain */
+
+typedef struct {
+    int start;
+    int end;
+} sector_range_t;
+
 typedef struct {
     int size_ifo;
     int size_menu;
     int size_bup;
     int number_of_vob_files;
     int size_vob[10];
+
+    /* With --playable the sectors some PGC plays, sorted, NULL to copy
+       everything */
+    sector_range_t *menu_played;
+    int             menu_ranges;
+    sector_range_t *title_played;
+    int             title_ranges;
 } title_set_t;
 
 typedef struct {
@@ -79,6 +298,401 @@ typedef struct {
     titles_t *titles;
 } titles_info_t;
 
-void bsort_max_to_min(int sector[], int title[], int size);
+/* How a title fared in the main feature guess */
+
+typedef struct {
+    int  title;
+    int  title_set;
+    int  seconds;
+    int  pgcs;
+    int  cells;
+    int  audio_streams;
+    int  sub_pictures;
+    int  channels;
+    int  aspect_match;
+    long score;
+} feature_score_t;
+
+/* What the IFOs of a disc say, read once per DVDOpen and shared by
+   every mode. The VTS IFOs and the two info structs are filled in the
+   first time they are asked for */
+
+typedef struct {
+    dvd_reader_t      *dvd;
+    ifo_handle_t      *vmg_ifo;
+    ifo_handle_t     **vts_ifo;
+    int                number_of_title_sets;
+    title_set_info_t  *title_set_info;
+    titles_info_t     *titles_info;
+} disc_info_t;
+
+/* Checksums of the files of one backup */
+
+typedef struct {
+    pthread_mutex_t  lock;
+    FILE            *file;
+    char             path[PATH_MAX];
+} manifest_t;
+
+/* Instrumentation for --stats and --progress */
+
+typedef struct {
+    const char *name;
+    long        calls;
+    long long   bytes;
+    double      seconds;
+} phase_stat_t;
+
+typedef struct {
+    unsigned long count;
+    double        seconds;
+    unsigned long bucket[LATENCY_BUCKETS];
+} latency_stat_t;
+
+typedef struct {
+    char      name[PATH_MAX];
+    long long bytes;
+    double    first;
+    double    last;
+} file_stat_t;
+
+typedef struct {
+    pthread_mutex_t  lock;
+    pthread_cond_t   stop;
+    pthread_t        progress;
+    int              stopping;
+    double           started;
+    long long        bytes;
+    phase_stat_t     phase[MAX_PHASES];
+    int              phases;
+    latency_stat_t   read;
+    latency_stat_t   write;
+    file_stat_t    **file;
+    int              files;
+} stats_t;
+
+/* Time and bytes at the start of a phase */
+
+typedef struct {
+    double    started;
+    long long bytes;
+} phase_t;
+
+/* Sectors --recover couldn't read */
+
+typedef struct {
+    pthread_mutex_t  lock;
+    FILE            *file;
+    char             path[PATH_MAX];
+    int              runs;
+} bad_map_t;
+
+/* What is known about the sectors of one target file, kept as a
+   ddrescue map. Statuses are ddrescue's, '+' is read, '-' is bad and
+   '?' not tried yet */
+
+typedef struct {
+    int  start;
+    int  end;
+    char status;
+} rescue_range_t;
+
+typedef struct {
+    char            dir[PATH_MAX];
+    char            path[PATH_MAX + MAXNAME];
+    rescue_range_t *range;
+    int             ranges;
+
+    /* Found unreadable in this run */
+    rescue_range_t *bad;
+    int             bads;
+} rescue_map_t;
+
+/* Running checksums of one target file. Data is fed in file order as
+   it goes out, parts that weren't copied are read back from the file */
+
+typedef struct {
+    manifest_t *manifest;
+    char       *targetname;
+    off_t       fed;
+    int         unordered;
+    checksum_t  file;
+    checksum_t  block;
+    uint64_t   *blocks;
+    int         number_of_blocks;
+} file_sum_t;
+
+/* A run of sectors copied from one domain of a title set to a given
+   sector of a target file */
+
+typedef struct {
+    int                title_set;
+    dvd_read_domain_t  domain;
+    int                offset;
+    int                size;
+    int                streamout;
+    char              *targetname;
+    int                target_offset;
+    /* Where the target starts in an --image, 0 otherwise */
+    off_t              image_offset;
+
+    /* Filled in by DVDCopyExtents */
+    int                direct;
+    int                stream;
+    /* The next extent of another target with the same sectors, -1 if
+       none. Only the first of them is read, the rest are copies */
+    int                next_copy;
+    int                copy;
+    int                buffered;
+    int                compare;
+    file_sum_t        *sum;
+    store_feed_t      *feed;
+    rescue_map_t      *rescue;
+    file_stat_t       *stat;
+} copy_extent_t;
+
+/* The VOB files the cells of one title go to, and the extents that
+   copy them there */
+
+typedef struct {
+    char           targetname[10][PATH_MAX];
+    int            streamout[10];
+    copy_extent_t *extent;
+    int            extents;
+} cell_plan_t;
+
+/* An image source mapped for --mmap */
+
+typedef struct {
+    unsigned char *data;
+    off_t          size;
+} source_map_t;
+
+/* Ring of buffers shared between the reader thread and the writer */
+
+struct copy_ring_s;
+
+typedef struct ring_slot_s {
+    unsigned char *buffer;
+    unsigned char *data;
+    int            extent;
+    int            offset;
+    int            blocks;
+    off_t          position;
+    int            queued;
+    int            written;
+    int            failed;
+    /* Copied from the source file to the target, nothing to write */
+    int            cloned;
+    /* data points into the --mmap mapping of the source, not buffer */
+    int            mapped;
+    double         started;
+
+    /* Queue of the shared writers in batch mode */
+    struct copy_ring_s *ring;
+    struct ring_slot_s *next;
+} ring_slot_t;
+
+/* The buffers live for the whole run, and so does the io_uring they
+   are registered with */
+
+typedef struct {
+    ring_slot_t     *slot;
+    int              depth;
+#ifdef HAVE_LIBURING
+    struct io_uring  uring;
+    int              uring_ready;
+    int              uring_fd;
+#endif
+} copy_pool_t;
+
+/* Sectors of a file under VIDEO_TS known to be on disk */
+
+typedef struct {
+    char name[16];
+    int  start;
+    int  end;
+} journal_range_t;
+
+typedef struct {
+    pthread_mutex_t  lock;
+    int              fd;
+    char             path[PATH_MAX];
+    journal_range_t *range;
+    int              ranges;
+    time_t           synced;
+} journal_t;
+
+/* One source of a batch run */
+
+typedef struct batch_job_s batch_job_t;
+
+typedef struct copy_ring_s {
+    pthread_mutex_t lock;
+    pthread_cond_t  filled;
+    pthread_cond_t  emptied;
+
+    copy_pool_t *pool;
+    batch_job_t *job;
+
+    /* Written but not yet committed to the journal */
+    journal_t   *journal;
+    int          mark_extent;
+    int          mark_start;
+    int          mark_end;
+
+    /* Unreadable sectors not yet in the bad sector map */
+    bad_map_t   *bad_map;
+    int          bad_extent;
+    int          bad_start;
+    int          bad_end;
+
+    ring_slot_t *slot;
+    int          depth;
+    int          head;
+    int          tail;
+    int          count;
+    int          done;
+    int          error;
+
+    /* Reader side */
+    dvd_reader_t      *dvd;
+    dvd_file_t        *dvd_file;
+    int                title_set;
+    dvd_read_domain_t  domain;
+    copy_extent_t     *extent;
+    int                extents;
+    int                next_extent;
+    int                next_offset;
+
+    /* The VOB files of the domain in an image or directory source, for
+       chunks that can be cloned. An image has a single part */
+    const char        *source;
+    int                source_fd[10];
+    off_t              source_start[10];
+    int                source_size[10];
+    int                source_parts;
+    int                clone;
+    int                reflink;
+    /* The runs of the last extent scanned that were cloned, its slots
+       inside them are done */
+    int                clone_extent;
+    sector_range_t    *cloned;
+    int                clones;
+    source_map_t      *map;
+
+    /* Read size of --adaptive for the current extent */
+    int                read_blocks;
+    int                read_settled;
+    double             read_rate;
+    int                sample_reads;
+    int                sample_blocks;
+    double             sample_seconds;
+} copy_ring_t;
+
+/* Slots handed to the writers shared by all sources of a batch */
+
+typedef struct {
+    pthread_mutex_t  lock;
+    pthread_cond_t   queued;
+    ring_slot_t     *first;
+    ring_slot_t     *last;
+    pthread_t       *writer;
+    int              writers;
+    int              stop;
+} write_pool_t;
+
+/* One file of a title set for the mirror to copy, a title VOB or one
+   of the MIRROR_* files. Jobs are done in order of where the files
+   start on the disc, or biggest first by parallel workers */
+
+#define MIRROR_MENU 0
+#define MIRROR_IFO  -1
+#define MIRROR_BUP  -2
+
+typedef struct {
+    int      title_set;
+    int      vob;
+    int      size;
+    uint32_t sector;
+    int      order;
+} mirror_job_t;
+
+typedef struct {
+    pthread_mutex_t   lock;
+    mirror_job_t     *job;
+    int               jobs;
+    int               next;
+    int               error;
+    char             *dvd;
+    title_set_info_t *title_set_info;
+    char             *targetdir;
+    char             *title_name;
+    batch_job_t      *owner;
+    journal_t        *journal;
+    manifest_t       *manifest;
+    bad_map_t        *bad_map;
+    image_t          *image;
+    const char       *source;
+    source_map_t     *map;
+} mirror_pool_t;
+
+/* What to back up, the same for every source */
+
+typedef struct {
+    int   do_mirror;
+    int   do_title_set;
+    int   do_chapter;
+    int   do_titles;
+    int   do_feature;
+    int   title_set;
+    int   titles;
+    int   start_chapter;
+    int   end_chapter;
+    char *targetdir;
+
+    /* All the titles of -t 1,3,5, titles is the first of them */
+    int  *title_list;
+    int   number_of_titles;
+} backup_mode_t;
+
+struct batch_job_s {
+    pthread_mutex_t *lock;
+    batch_job_t     *batch;
+    int              jobs;
+    char            *dvd;
+    char             title_name[MAXNAME];
+    backup_mode_t   *mode;
+    int              result;
+    long long        bytes;
+    double           seconds;
+};
+
+void DVDSetDirectIO(int streamout, char *targetname);
+int DVDCopyExtents(dvd_reader_t *dvd, copy_extent_t extent[], int extents);
+void DVDFreeCopyPool(void);
+int DVDStartWritePool(int writers);
+
+disc_info_t *DVDOpenDiscInfo(dvd_reader_t *dvd);
+void DVDCloseDiscInfo(disc_info_t *disc);
+void DVDFreeTitleSetInfo(title_set_info_t *title_set_info);
+void DVDFreeTitlesInfo(titles_info_t *titles_info);
+ifo_handle_t *DVDGetVTSInfo(disc_info_t *disc, int title_set);
+title_set_info_t *DVDGetTitleSetInfo(disc_info_t *disc);
+titles_info_t *DVDGetTitlesInfo(disc_info_t *disc);
+void DVDStopWritePool(void);
+journal_t *DVDJournalOpen(char *targetdir, char *title_name);
+void DVDJournalClose(journal_t *journal, int complete);
+manifest_t *DVDManifestOpen(char *targetdir, char *title_name);
+void DVDManifestClose(manifest_t *manifest);
+bad_map_t *DVDBadMapOpen(char *targetdir, char *title_name);
+void DVDBadMapClose(bad_map_t *bad_map);
+
+int DVDCopyIfoBup(dvd_reader_t *dvd, title_set_info_t *title_set_info,
+                  int title_set, char *targetdir, char *title_name);
+int DVDCopyMenu(dvd_reader_t *dvd, title_set_info_t *title_set_info,
+                int title_set, char *targetdir, char *title_name);
+int DVDCopyTileVobX(dvd_reader_t *dvd, title_set_info_t *title_set_info,
+                    int title_set, int vob, char *targetdir, char *title_name);
 
 void usage() __attribute__ ((noreturn));
@@ -0,0 +1,692 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* DVD-Video images the way mkisofs -dvd-video lays them out: ISO 9660
+   and UDF 1.02 describing the same files, VIDEO_TS and AUDIO_TS in the
+   root, every file in one extent. libdvdread only reads the UDF side,
+   the ISO 9660 side is for players and operating systems that want it */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+
+#include "image.h"
+
+/* Sectors of the image */
+#define ISO_PVD          16
+#define ISO_TERMINATOR   17
+#define VOLUME_RECOGNITION 18
+#define MAIN_VDS         32
+#define RESERVE_VDS      48
+#define INTEGRITY        64
+#define ANCHOR           256
+#define PARTITION_START  257
+
+/* Blocks of the UDF partition */
+#define FILE_SET         0
+#define ROOT_FE          2
+#define ROOT_DIR         3
+#define AUDIO_FE         4
+#define AUDIO_DIR        5
+#define VIDEO_FE         6
+#define VIDEO_DIR        7
+
+/* Unique ids of the file entries, 0 is the root */
+#define FIRST_UNIQUE_ID  16
+
+#define BLOCK IMAGE_BLOCK_LEN
+
+static uint32_t
+Sectors (uint32_t bytes)
+{
+    return((bytes + BLOCK - 1) / BLOCK);
+}
+
+static void
+Le16 (unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+static void
+Le32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void
+Be16 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+Be32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+/* ISO 9660 "both byte orders" fields */
+static void
+Both16 (unsigned char *p, uint32_t v)
+{
+    Le16(p, v);
+    Be16(p + 2, v);
+}
+
+static void
+Both32 (unsigned char *p, uint32_t v)
+{
+    Le32(p, v);
+    Be32(p + 4, v);
+}
+
+void
+ImageInit (image_t *image, const char *path, const char *volume)
+{
+    memset(image, 0, sizeof(image_t));
+    snprintf(image->path, sizeof(image->path), "%s", path);
+    snprintf(image->volume, sizeof(image->volume), "%s", volume);
+    image->created = time(NULL);
+}
+
+int
+ImageAddFile (image_t *image, const char *name, uint32_t size)
+{
+    image_file_t *file;
+
+    file = (image_file_t *)realloc(image->file, (image->files + 1) * sizeof(image_file_t));
+    if (file == NULL) {
+        return(1);
+    }
+    image->file = file;
+    file = &image->file[image->files++];
+    snprintf(file->name, sizeof(file->name), "%s", name);
+    file->size   = size;
+    file->sector = 0;
+    return(0);
+}
+
+image_file_t*
+ImageFindFile (image_t *image, const char *name)
+{
+    /* Loop variable */
+    int i;
+
+    for ( i = 0; i < image->files; i++ ) {
+        if (strcmp(image->file[i].name, name) == 0) {
+            return(&image->file[i]);
+        }
+    }
+    return(NULL);
+}
+
+void
+ImageFree (image_t *image)
+{
+    free(image->file);
+    image->file  = NULL;
+    image->files = 0;
+}
+
+/* UDF File Identifier Descriptors and ISO 9660 directory records are
+   padded to 4 and 2 bytes */
+static uint32_t
+FileIdLength (const char *name)
+{
+    return((38 + (name != NULL ? strlen(name) + 1 : 0) + 3) & ~3);
+}
+
+static uint32_t
+IsoRecordLength (int name_length)
+{
+    return((33 + name_length + 1) & ~1);
+}
+
+static int
+CompareFiles (const void *a, const void *b)
+{
+    return(strcmp((*(image_file_t * const *)a)->name, (*(image_file_t * const *)b)->name));
+}
+
+/* ISO 9660 directory records don't cross sectors */
+static uint32_t
+IsoVideoLength (image_t *image)
+{
+    /* Loop variable */
+    int i;
+
+    uint32_t used = 2 * IsoRecordLength(1);
+    uint32_t length;
+
+    for ( i = 0; i < image->files; i++ ) {
+        length = IsoRecordLength(strlen(image->file[i].name) + 2);
+        if (used % BLOCK + length > BLOCK) {
+            used = used + BLOCK - used % BLOCK;
+        }
+        used = used + length;
+    }
+    return(used);
+}
+
+/* The partition holds the UDF file set and directories, a File Entry
+   per file, the ISO 9660 path tables and directories, then the files
+   in the order they were added. An anchor closes the image */
+void
+ImageLayout (image_t *image)
+{
+    /* Loop variable */
+    int i;
+
+    uint32_t block;
+
+    image->video_dir         = VIDEO_DIR;
+    image->video_dir_length  = FileIdLength(NULL);
+    for ( i = 0; i < image->files; i++ ) {
+        image->video_dir_length = image->video_dir_length + FileIdLength(image->file[i].name);
+    }
+    image->file_entries      = VIDEO_DIR + Sectors(image->video_dir_length);
+    image->iso_tables        = image->file_entries + image->files;
+    image->iso_video_sectors = Sectors(IsoVideoLength(image));
+    image->data              = image->iso_tables + 4 + image->iso_video_sectors;
+
+    block = image->data;
+    for ( i = 0; i < image->files; i++ ) {
+        image->file[i].sector = PARTITION_START + block;
+        block = block + Sectors(image->file[i].size);
+    }
+    image->sectors = PARTITION_START + block + 1;
+}
+
+/* UDF */
+
+static uint16_t
+Crc16 (const unsigned char *p, size_t length)
+{
+    /* Loop variable */
+    int j;
+
+    uint16_t crc = 0;
+
+    while ( length-- > 0 ) {
+        crc = crc ^ (*p++ << 8);
+        for ( j = 0; j < 8; j++ ) {
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return(crc);
+}
+
+static void
+UDFTag (unsigned char *p, int id, uint32_t location, size_t length)
+{
+    /* Loop variable */
+    int i;
+
+    unsigned char sum = 0;
+
+    Le16(p, id);
+    Le16(p + 2, 2);
+    Le16(p + 8, Crc16(p + 16, length - 16));
+    Le16(p + 10, length - 16);
+    Le32(p + 12, location);
+    for ( i = 0; i < 16; i++ ) {
+        if (i != 4) {
+            sum = sum + p[i];
+        }
+    }
+    p[4] = sum;
+}
+
+/* OSTA compressed unicode, 8 bit */
+static void
+UDFString (unsigned char *p, int size, const char *s)
+{
+    int length = strlen(s);
+
+    if (length > size - 2) {
+        length = size - 2;
+    }
+    p[0] = 8;
+    memcpy(p + 1, s, length);
+    p[size - 1] = length + 1;
+}
+
+static void
+UDFCharset (unsigned char *p)
+{
+    memcpy(p + 1, "OSTA Compressed Unicode", 23);
+}
+
+static void
+UDFRegid (unsigned char *p, const char *id)
+{
+    memcpy(p + 1, id, strlen(id));
+}
+
+static void
+UDFDomain (unsigned char *p)
+{
+    UDFRegid(p, "*OSTA UDF Compliant");
+    Le16(p + 24, 0x0102);
+}
+
+static void
+UDFTimestamp (unsigned char *p, const struct tm *tm)
+{
+    Le16(p, 0x1000);
+    Le16(p + 2, tm->tm_year + 1900);
+    p[4] = tm->tm_mon + 1;
+    p[5] = tm->tm_mday;
+    p[6] = tm->tm_hour;
+    p[7] = tm->tm_min;
+    p[8] = tm->tm_sec;
+}
+
+static void
+UDFLongAD (unsigned char *p, uint32_t length, uint32_t block)
+{
+    Le32(p, length);
+    Le32(p + 4, block);
+}
+
+/* File Entry with one short allocation descriptor */
+static void
+UDFFileEntry (unsigned char *p, uint32_t block, int links, uint32_t size,
+              uint32_t data, uint32_t unique, const struct tm *tm)
+{
+    Le16(p + 20, 4);
+    Le16(p + 24, 1);
+    p[27] = links > 0 ? 4 : 5;
+    Le32(p + 36, 0xFFFFFFFF);
+    Le32(p + 40, 0xFFFFFFFF);
+    /* Read for everyone, and search on directories */
+    Le32(p + 44, links > 0 ? 0x4631 : 0x4210);
+    Le16(p + 48, links > 0 ? links : 1);
+    Le32(p + 56, size);
+    Le32(p + 64, Sectors(size));
+    UDFTimestamp(p + 72, tm);
+    UDFTimestamp(p + 84, tm);
+    UDFTimestamp(p + 96, tm);
+    Le32(p + 108, 1);
+    UDFRegid(p + 128, "*dvdbackup");
+    Le32(p + 160, unique);
+    Le32(p + 172, 8);
+    Le32(p + 176, size);
+    Le32(p + 180, data);
+    UDFTag(p, 261, block, 184);
+}
+
+/* Appends a File Identifier Descriptor to the directory at block */
+static void
+UDFFileId (unsigned char *partition, uint32_t block, uint32_t *used,
+           const char *name, int characteristics, uint32_t icb)
+{
+    unsigned char *p      = partition + block * BLOCK + *used;
+    uint32_t       length = FileIdLength(name);
+
+    Le16(p + 16, 1);
+    p[18] = characteristics;
+    UDFLongAD(p + 20, BLOCK, icb);
+    if (name != NULL) {
+        p[19] = strlen(name) + 1;
+        p[38] = 8;
+        memcpy(p + 39, name, strlen(name));
+    }
+    UDFTag(p, 257, block + *used / BLOCK, length);
+    *used = *used + length;
+}
+
+static void
+UDFVolume (image_t *image, unsigned char *meta, const struct tm *tm)
+{
+    /* Loop variable */
+    int i;
+
+    unsigned char *p;
+    uint32_t       first;
+    uint32_t       partition_length = image->sectors - 1 - PARTITION_START;
+
+    memcpy(meta + VOLUME_RECOGNITION * BLOCK + 1, "BEA01", 5);
+    meta[VOLUME_RECOGNITION * BLOCK + 6] = 1;
+    memcpy(meta + (VOLUME_RECOGNITION + 1) * BLOCK + 1, "NSR02", 5);
+    meta[(VOLUME_RECOGNITION + 1) * BLOCK + 6] = 1;
+    memcpy(meta + (VOLUME_RECOGNITION + 2) * BLOCK + 1, "TEA01", 5);
+    meta[(VOLUME_RECOGNITION + 2) * BLOCK + 6] = 1;
+
+    for ( i = 0; i < 2; i++ ) {
+        first = (i == 0 ? MAIN_VDS : RESERVE_VDS);
+
+        /* Primary Volume Descriptor */
+        p = meta + first * BLOCK;
+        UDFString(p + 24, 32, image->volume);
+        Le16(p + 56, 1);
+        Le16(p + 58, 1);
+        Le16(p + 60, 2);
+        Le16(p + 62, 2);
+        Le32(p + 64, 1);
+        Le32(p + 68, 1);
+        UDFString(p + 72, 128, image->volume);
+        UDFCharset(p + 200);
+        UDFCharset(p + 264);
+        UDFTimestamp(p + 376, tm);
+        UDFRegid(p + 388, "*dvdbackup");
+        UDFTag(p, 1, first, 512);
+
+        /* Partition Descriptor */
+        p = p + BLOCK;
+        Le32(p + 16, 1);
+        Le16(p + 20, 1);
+        UDFRegid(p + 24, "+NSR02");
+        Le32(p + 184, 1);
+        Le32(p + 188, PARTITION_START);
+        Le32(p + 192, partition_length);
+        UDFRegid(p + 196, "*dvdbackup");
+        UDFTag(p, 5, first + 1, 512);
+
+        /* Logical Volume Descriptor with one type 1 partition map */
+        p = p + BLOCK;
+        Le32(p + 16, 2);
+        UDFCharset(p + 20);
+        UDFString(p + 84, 128, image->volume);
+        Le32(p + 212, BLOCK);
+        UDFDomain(p + 216);
+        UDFLongAD(p + 248, BLOCK, FILE_SET);
+        Le32(p + 264, 6);
+        Le32(p + 268, 1);
+        UDFRegid(p + 272, "*dvdbackup");
+        Le32(p + 432, 2 * BLOCK);
+        Le32(p + 436, INTEGRITY);
+        p[440] = 1;
+        p[441] = 6;
+        Le16(p + 442, 1);
+        UDFTag(p, 6, first + 2, 446);
+
+        /* Unallocated Space Descriptor, there is none */
+        p = p + BLOCK;
+        Le32(p + 16, 3);
+        UDFTag(p, 7, first + 3, 24);
+
+        /* Terminating Descriptor */
+        p = p + BLOCK;
+        UDFTag(p, 8, first + 4, 512);
+    }
+
+    /* Logical Volume Integrity Descriptor, closed */
+    p = meta + INTEGRITY * BLOCK;
+    UDFTimestamp(p + 16, tm);
+    Le32(p + 28, 1);
+    Le32(p + 40, FIRST_UNIQUE_ID + 2 + image->files);
+    Le32(p + 72, 1);
+    Le32(p + 76, 46);
+    Le32(p + 84, partition_length);
+    UDFRegid(p + 88, "*dvdbackup");
+    Le32(p + 120, image->files);
+    Le32(p + 124, 3);
+    Le16(p + 128, 0x0102);
+    Le16(p + 130, 0x0102);
+    Le16(p + 132, 0x0102);
+    UDFTag(p, 9, INTEGRITY, 134);
+    UDFTag(p + BLOCK, 8, INTEGRITY + 1, 512);
+
+    /* Anchor Volume Descriptor Pointer, the one at the end is written
+       separately */
+    p = meta + ANCHOR * BLOCK;
+    Le32(p + 16, 16 * BLOCK);
+    Le32(p + 20, MAIN_VDS);
+    Le32(p + 24, 16 * BLOCK);
+    Le32(p + 28, RESERVE_VDS);
+    UDFTag(p, 2, ANCHOR, 512);
+}
+
+static void
+UDFFiles (image_t *image, unsigned char *partition, const struct tm *tm)
+{
+    /* Loop variable */
+    int i;
+
+    uint32_t used;
+
+    /* File Set Descriptor and its terminator */
+    UDFTimestamp(partition + 16, tm);
+    Le16(partition + 28, 3);
+    Le16(partition + 30, 3);
+    Le32(partition + 32, 1);
+    Le32(partition + 36, 1);
+    UDFCharset(partition + 48);
+    UDFString(partition + 112, 128, image->volume);
+    UDFCharset(partition + 240);
+    UDFString(partition + 304, 32, image->volume);
+    UDFLongAD(partition + 400, BLOCK, ROOT_FE);
+    UDFDomain(partition + 416);
+    UDFTag(partition, 256, FILE_SET, 512);
+    UDFTag(partition + BLOCK, 8, FILE_SET + 1, 512);
+
+    used = 0;
+    UDFFileId(partition, ROOT_DIR, &used, NULL, 0x0a, ROOT_FE);
+    UDFFileId(partition, ROOT_DIR, &used, "AUDIO_TS", 0x02, AUDIO_FE);
+    UDFFileId(partition, ROOT_DIR, &used, "VIDEO_TS", 0x02, VIDEO_FE);
+    UDFFileEntry(partition + ROOT_FE * BLOCK, ROOT_FE, 3, used, ROOT_DIR, 0, tm);
+
+    used = 0;
+    UDFFileId(partition, AUDIO_DIR, &used, NULL, 0x0a, ROOT_FE);
+    UDFFileEntry(partition + AUDIO_FE * BLOCK, AUDIO_FE, 1, used, AUDIO_DIR,
+                 FIRST_UNIQUE_ID, tm);
+
+    used = 0;
+    UDFFileId(partition, VIDEO_DIR, &used, NULL, 0x0a, ROOT_FE);
+    for ( i = 0; i < image->files; i++ ) {
+        UDFFileId(partition, VIDEO_DIR, &used, image->file[i].name, 0,
+                  image->file_entries + i);
+        UDFFileEntry(partition + (image->file_entries + i) * BLOCK,
+                     image->file_entries + i, 0, image->file[i].size,
+                     image->file[i].sector - PARTITION_START,
+                     FIRST_UNIQUE_ID + 2 + i, tm);
+    }
+    UDFFileEntry(partition + VIDEO_FE * BLOCK, VIDEO_FE, 1, used, VIDEO_DIR,
+                 FIRST_UNIQUE_ID + 1, tm);
+}
+
+/* ISO 9660 */
+
+static void
+IsoDate (unsigned char *p, const struct tm *tm)
+{
+    p[0] = tm->tm_year;
+    p[1] = tm->tm_mon + 1;
+    p[2] = tm->tm_mday;
+    p[3] = tm->tm_hour;
+    p[4] = tm->tm_min;
+    p[5] = tm->tm_sec;
+}
+
+static uint32_t
+IsoRecord (unsigned char *p, const char *name, int name_length,
+           uint32_t extent, uint32_t size, int directory, const struct tm *tm)
+{
+    uint32_t length = IsoRecordLength(name_length);
+
+    p[0] = length;
+    Both32(p + 2, extent);
+    Both32(p + 10, size);
+    IsoDate(p + 18, tm);
+    p[25] = directory ? 0x02 : 0;
+    Both16(p + 28, 1);
+    p[32] = name_length;
+    memcpy(p + 33, name, name_length);
+    return(length);
+}
+
+/* A path table entry, in either byte order */
+static uint32_t
+IsoPath (unsigned char *p, const char *name, int name_length, uint32_t extent,
+         int parent, int big_endian)
+{
+    p[0] = name_length;
+    if (big_endian) {
+        Be32(p + 2, extent);
+        Be16(p + 6, parent);
+    } else {
+        Le32(p + 2, extent);
+        Le16(p + 6, parent);
+    }
+    memcpy(p + 8, name, name_length);
+    return((8 + name_length + 1) & ~1);
+}
+
+static void
+IsoVolume (image_t *image, unsigned char *meta, const struct tm *tm)
+{
+    /* Loop variable */
+    int i;
+
+    unsigned char  *p;
+    image_file_t  **sorted;
+    char            name[80];
+    uint32_t        root   = PARTITION_START + image->iso_tables + 2;
+    uint32_t        audio  = root + 1;
+    uint32_t        video  = root + 2;
+    uint32_t        length, used, path_table = 0;
+    int             big_endian;
+
+    /* Path tables */
+    for ( big_endian = 0; big_endian < 2; big_endian++ ) {
+        p = meta + (PARTITION_START + image->iso_tables + big_endian) * BLOCK;
+        used = IsoPath(p, "\0", 1, root, 1, big_endian);
+        used = used + IsoPath(p + used, "AUDIO_TS", 8, audio, 1, big_endian);
+        used = used + IsoPath(p + used, "VIDEO_TS", 8, video, 1, big_endian);
+        path_table = used;
+    }
+
+    /* Root and AUDIO_TS */
+    p = meta + root * BLOCK;
+    used = IsoRecord(p, "\0", 1, root, BLOCK, 1, tm);
+    used = used + IsoRecord(p + used, "\1", 1, root, BLOCK, 1, tm);
+    used = used + IsoRecord(p + used, "AUDIO_TS", 8, audio, BLOCK, 1, tm);
+    IsoRecord(p + used, "VIDEO_TS", 8, video, image->iso_video_sectors * BLOCK, 1, tm);
+
+    p = meta + audio * BLOCK;
+    used = IsoRecord(p, "\0", 1, audio, BLOCK, 1, tm);
+    IsoRecord(p + used, "\1", 1, root, BLOCK, 1, tm);
+
+    /* VIDEO_TS, sorted by name */
+    p = meta + video * BLOCK;
+    used = IsoRecord(p, "\0", 1, video, image->iso_video_sectors * BLOCK, 1, tm);
+    used = used + IsoRecord(p + used, "\1", 1, root, BLOCK, 1, tm);
+    if ((sorted = (image_file_t **)malloc(image->files * sizeof(image_file_t *) + 1)) != NULL) {
+        for ( i = 0; i < image->files; i++ ) {
+            sorted[i] = &image->file[i];
+        }
+        qsort(sorted, image->files, sizeof(image_file_t *), CompareFiles);
+        for ( i = 0; i < image->files; i++ ) {
+            snprintf(name, sizeof(name), "%s;1", sorted[i]->name);
+            length = IsoRecordLength(strlen(name));
+            if (used % BLOCK + length > BLOCK) {
+                used = used + BLOCK - used % BLOCK;
+            }
+            used = used + IsoRecord(p + used, name, strlen(name), sorted[i]->sector,
+                                    sorted[i]->size, 0, tm);
+        }
+        free(sorted);
+    }
+
+    /* Primary Volume Descriptor. The volume name is made of d-characters */
+    p = meta + ISO_PVD * BLOCK;
+    p[0] = 1;
+    memcpy(p + 1, "CD001", 5);
+    p[6] = 1;
+    memset(p + 8, ' ', 64);
+    for ( i = 0; image->volume[i] != '\0' && i < 32; i++ ) {
+        p[40 + i] = isalnum((unsigned char)image->volume[i])
+            ? toupper((unsigned char)image->volume[i]) : '_';
+    }
+    Both32(p + 80, image->sectors);
+    Both16(p + 120, 1);
+    Both16(p + 124, 1);
+    Both16(p + 128, BLOCK);
+    Both32(p + 132, path_table);
+    Le32(p + 140, PARTITION_START + image->iso_tables);
+    Be32(p + 148, PARTITION_START + image->iso_tables + 1);
+    IsoRecord(p + 156, "\0", 1, root, BLOCK, 1, tm);
+    memset(p + 190, ' ', 623);
+    memcpy(p + 574, "DVDBACKUP", 9);
+    snprintf(name, sizeof(name), "%04d%02d%02d%02d%02d%02d00",
+             tm->tm_year + 1900, tm->tm_mon + 1, tm->tm_mday,
+             tm->tm_hour, tm->tm_min, tm->tm_sec);
+    memcpy(p + 813, name, 16);
+    p[829] = 0;
+    memcpy(p + 830, name, 16);
+    p[846] = 0;
+    memset(p + 847, '0', 16);
+    p[863] = 0;
+    memset(p + 864, '0', 16);
+    p[880] = 0;
+    p[881] = 1;
+
+    p = meta + ISO_TERMINATOR * BLOCK;
+    p[0] = 255;
+    memcpy(p + 1, "CD001", 5);
+    p[6] = 1;
+}
+
+/* Write everything but the files, and the anchor that ends the image.
+   The files go to image->file[i].sector */
+int
+ImageWriteHeader (image_t *image, int fd)
+{
+    unsigned char *meta;
+    size_t         size = (size_t)(PARTITION_START + image->data) * BLOCK;
+    struct tm      tm;
+    int            result = 0;
+
+    if ((meta = (unsigned char *)calloc(size + BLOCK, 1)) == NULL) {
+        fprintf(stderr, "Out of memory laying out %s\n", image->path);
+        return(1);
+    }
+    gmtime_r(&image->created, &tm);
+
+    IsoVolume(image, meta, &tm);
+    UDFVolume(image, meta, &tm);
+    UDFFiles(image, meta + PARTITION_START * BLOCK, &tm);
+
+    if (pwrite(fd, meta, size, 0) != (ssize_t)size) {
+        result = 1;
+    }
+
+    memcpy(meta + size, meta + ANCHOR * BLOCK, BLOCK);
+    UDFTag(meta + size, 2, image->sectors - 1, 512);
+    if (pwrite(fd, meta + size, BLOCK, (off_t)(image->sectors - 1) * BLOCK) != BLOCK) {
+        result = 1;
+    }
+
+    if (result != 0) {
+        fprintf(stderr, "Error writing %s\n", image->path);
+        perror("");
+    }
+    free(meta);
+    return(result);
+}
@@ -0,0 +1,63 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+#define IMAGE_BLOCK_LEN 2048
+
+/* A file under VIDEO_TS and the sector it starts at in the image */
+
+typedef struct {
+    char     name[16];
+    uint32_t size;
+    uint32_t sector;
+} image_file_t;
+
+/* A UDF 1.02 and ISO 9660 bridge image of a VIDEO_TS directory. Files
+   are added in disc order, ImageLayout then gives each its sector and
+   ImageWriteHeader writes everything but the files themselves */
+
+typedef struct {
+    char          path[PATH_MAX];
+    char          volume[33];
+    time_t        created;
+    image_file_t *file;
+    int           files;
+    uint32_t      sectors;
+
+    /* Filled in by ImageLayout, blocks in the UDF partition */
+    uint32_t      video_dir;
+    uint32_t      video_dir_length;
+    uint32_t      file_entries;
+    uint32_t      iso_tables;
+    uint32_t      iso_video_sectors;
+    uint32_t      data;
+} image_t;
+
+void ImageInit(image_t *image, const char *path, const char *volume);
+int ImageAddFile(image_t *image, const char *name, uint32_t size);
+void ImageLayout(image_t *image);
+image_file_t *ImageFindFile(image_t *image, const char *name);
+int ImageWriteHeader(image_t *image, int fd);
+void ImageFree(image_t *image);
+
+#endif
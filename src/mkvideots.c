@@ -0,0 +1,796 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* mkvideots writes a synthetic DVD-Video, as a VIDEO_TS directory or
+   as a UDF and ISO 9660 image, for running dvdbackup without a disc. The IFOs hold
+   everything libdvdread checks and dvdbackup reads: one PGC per title
+   with its cells, chapters and playback time, the cell address table
+   and the title set attributes. The VOBs are filled with a pattern
+   that only depends on the title set and the sector, so a backup can
+   be compared with a directory written with the same options */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "image.h"
+
+#define BLOCK_LEN        2048
+#define MAX_SETS         99
+#define MAX_PARTS        9
+#define MAX_CHAPTERS     99
+#define MAX_CELLS        255
+/* VOB parts stay below 1 GB, like the ones on a disc */
+#define MAX_PART_SECTORS (1024 * 1024 * 1024 / BLOCK_LEN - 1)
+/* About 4 Mbit/s, for the playback times */
+#define SECTORS_PER_SECOND 256
+#define WRITE_SECTORS    512
+
+#define FILE_IFO   0
+#define FILE_MENU  1
+#define FILE_TITLE 2
+
+typedef struct {
+    char           name[32];
+    int            set;
+    int            kind;
+    uint32_t       size;
+    uint32_t       sectors;
+    uint32_t       sector;
+    /* First sector in its VOB set, so parts continue the pattern */
+    uint32_t       first;
+    unsigned char *data;
+} file_t;
+
+typedef struct {
+    unsigned char *data;
+    uint32_t       sectors;
+} ifo_t;
+
+/* Options */
+static int      sets              = 3;
+static int      titles            = 2;
+static int      parts[MAX_SETS];
+static uint32_t part_sectors      = 64 * 1024 * 1024 / BLOCK_LEN;
+static int      cells             = 8;
+static int      cells_per_chapter = 2;
+static uint32_t gap               = 16;
+static uint32_t menu_sectors      = 256 * 1024 / BLOCK_LEN;
+static char    *volume            = "SYNTHETIC_DVD";
+
+static file_t  *files;
+static int      number_of_files;
+static image_t  disc;
+
+void usage()
+{
+    fprintf(stderr,
+            "\nUsage: mkvideots [options] -o target\n"
+            "\t-o target\twrite target/VIDEO_TS, or with -u an image "
+            "named target\n"
+            "\t-u\t\twrite a UDF and ISO 9660 image that libdvdread can "
+            "open\n"
+            "\t-n name\t\tvolume name, dvdbackup's title "
+            "(default SYNTHETIC_DVD)\n"
+            "\t-T X\t\tX title sets (default 3)\n"
+            "\t-t X\t\tX titles in every title set (default 2)\n"
+            "\t-p X[,Y...]\tVOB parts of title set 1, 2 ..., the last "
+            "one repeats\n\t\t\t(default 2,1)\n"
+            "\t-S X\t\tX MB in every VOB part (default 64)\n"
+            "\t-c X\t\tX cells in every title (default 8)\n"
+            "\t-C X\t\tX cells in every chapter (default 2)\n"
+            "\t-g X\t\tleave X sectors between cells that no title "
+            "plays (default 16)\n"
+            "\t-m X\t\tX KB in every menu VOB, 0 for none (default 256)\n"
+            "\t-h\t\tprint a brief usage message\n\n");
+}
+
+/* IFOs are big endian */
+
+static void
+Put16 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static void
+Put32 (unsigned char *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static uint32_t
+Sectors (uint32_t bytes)
+{
+    return((bytes + BLOCK_LEN - 1) / BLOCK_LEN);
+}
+
+static int
+BCD (int v)
+{
+    return(((v / 10) << 4) | (v % 10));
+}
+
+/* dvd_time_t at 25 frames per second */
+static void
+PutTime (unsigned char *p, uint32_t seconds)
+{
+    p[0] = BCD(seconds / 3600 % 100);
+    p[1] = BCD(seconds / 60 % 60);
+    p[2] = BCD(seconds % 60);
+    p[3] = 0x40;
+}
+
+/* Append a zeroed table of length bytes to an IFO, starting on a
+   sector of its own. Returns its sector, the table is at
+   ifo->data + sector * BLOCK_LEN */
+static uint32_t
+IfoTable (ifo_t *ifo, uint32_t length)
+{
+    uint32_t sector = ifo->sectors;
+    uint32_t count  = Sectors(length);
+
+    ifo->data = (unsigned char *)realloc(ifo->data, (size_t)(sector + count) * BLOCK_LEN);
+    if (ifo->data == NULL) {
+        fprintf(stderr, "Out of memory building an IFO\n");
+        exit(1);
+    }
+    memset(ifo->data + (size_t)sector * BLOCK_LEN, 0, (size_t)count * BLOCK_LEN);
+    ifo->sectors = sector + count;
+    return(sector);
+}
+
+/* Sectors of the title VOBs of a title set */
+static uint32_t
+TitleSectors (int set)
+{
+    return(parts[set - 1] * part_sectors);
+}
+
+static int
+Chapters (void)
+{
+    return((cells + cells_per_chapter - 1) / cells_per_chapter);
+}
+
+/* First and last sector of a cell, relative to VTS_XX_1.VOB. Every
+   title gets an equal share of the title VOBs, its cells are spread
+   over it with gap sectors in between */
+static void
+CellSectors (int set, int title, int cell, uint32_t *first, uint32_t *last)
+{
+    uint32_t share = TitleSectors(set) / titles;
+    uint32_t start = share * title;
+    uint32_t length;
+
+    if (title == titles - 1) {
+        share = TitleSectors(set) - start;
+    }
+    length = (share - (cells - 1) * gap) / cells;
+
+    *first = start + cell * (length + gap);
+    *last  = cell == cells - 1 ? start + share - 1 : *first + length - 1;
+}
+
+/* A PGC playing a whole title, one program per chapter */
+static uint32_t
+PgcLength (void)
+{
+    return(236 + ((Chapters() + 1) & ~1) + cells * 24 + cells * 4);
+}
+
+static void
+BuildPgc (unsigned char *pgc, int set, int title)
+{
+    /* Loop variables */
+    int i;
+
+    unsigned char *cell_playback;
+    unsigned char *cell_position;
+    uint32_t       first, last, seconds, total = 0;
+    int            program_map   = 236;
+    int            playback      = program_map + ((Chapters() + 1) & ~1);
+    int            position      = playback + cells * 24;
+
+    pgc[2] = Chapters();
+    pgc[3] = cells;
+    Put16(pgc + 230, program_map);
+    Put16(pgc + 232, playback);
+    Put16(pgc + 234, position);
+
+    for ( i = 0; i < Chapters(); i++ ) {
+        pgc[program_map + i] = i * cells_per_chapter + 1;
+    }
+
+    for ( i = 0; i < cells; i++ ) {
+        CellSectors(set, title, i, &first, &last);
+        seconds = (last - first + 1) / SECTORS_PER_SECOND;
+        if (seconds == 0) {
+            seconds = 1;
+        }
+        total = total + seconds;
+
+        cell_playback = pgc + playback + i * 24;
+        PutTime(cell_playback + 4, seconds);
+        Put32(cell_playback + 8, first);
+        /* One VOBU per cell */
+        Put32(cell_playback + 16, first);
+        Put32(cell_playback + 20, last);
+
+        cell_position = pgc + position + i * 4;
+        Put16(cell_position, title + 1);
+        cell_position[3] = i + 1;
+    }
+
+    PutTime(pgc + 4, total);
+}
+
+static void
+PutVideoAudio (unsigned char *video, unsigned char *audio_streams)
+{
+    /* MPEG-2, PAL, 16:9 */
+    video[0] = 0x5c;
+    /* One AC-3 stereo stream in English */
+    audio_streams[0] = 1;
+    audio_streams[1] = 0x04;
+    audio_streams[2] = 0x01;
+    audio_streams[3] = 'e';
+    audio_streams[4] = 'n';
+}
+
+static void
+BuildVTS (ifo_t *ifo, int set)
+{
+    /* Loop variables */
+    int i, j;
+
+    unsigned char *mat, *table;
+    uint32_t       sector, offset, first, last;
+    uint32_t       menu, vobs;
+    int            chapters = Chapters();
+
+    ifo->data    = NULL;
+    ifo->sectors = 0;
+    IfoTable(ifo, BLOCK_LEN);
+
+    /* VTS_PTT_SRPT, every chapter starts a program of its title's PGC */
+    sector = IfoTable(ifo, 8 + titles * 4 + titles * chapters * 4);
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, titles);
+    Put32(table + 4, 8 + titles * 4 + titles * chapters * 4 - 1);
+    for ( i = 0; i < titles; i++ ) {
+        offset = 8 + titles * 4 + i * chapters * 4;
+        Put32(table + 8 + i * 4, offset);
+        for ( j = 0; j < chapters; j++ ) {
+            Put16(table + offset + j * 4, i + 1);
+            Put16(table + offset + j * 4 + 2, j + 1);
+        }
+    }
+    Put32(ifo->data + 200, sector);
+
+    /* VTS_PGCIT */
+    sector = IfoTable(ifo, 8 + titles * 8 + titles * PgcLength());
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, titles);
+    Put32(table + 4, 8 + titles * 8 + titles * PgcLength() - 1);
+    for ( i = 0; i < titles; i++ ) {
+        offset = 8 + titles * 8 + i * PgcLength();
+        table[8 + i * 8] = 0x80 | (i + 1);
+        Put32(table + 8 + i * 8 + 4, offset);
+        BuildPgc(table + offset, set, i);
+    }
+    Put32(ifo->data + 204, sector);
+
+    /* VTS_TMAPT, empty maps keep libdvdread from complaining */
+    sector = IfoTable(ifo, 8 + titles * 8);
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, titles);
+    Put32(table + 4, 8 + titles * 8 - 1);
+    for ( i = 0; i < titles; i++ ) {
+        Put32(table + 8 + i * 4, 8 + titles * 4 + i * 4);
+        table[8 + titles * 4 + i * 4] = 1;
+    }
+    Put32(ifo->data + 212, sector);
+
+    /* VTS_C_ADT, one VOB per title */
+    sector = IfoTable(ifo, 8 + titles * cells * 12);
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, titles);
+    Put32(table + 4, 8 + titles * cells * 12 - 1);
+    for ( i = 0; i < titles; i++ ) {
+        for ( j = 0; j < cells; j++ ) {
+            offset = 8 + (i * cells + j) * 12;
+            CellSectors(set, i, j, &first, &last);
+            Put16(table + offset, i + 1);
+            table[offset + 2] = j + 1;
+            Put32(table + offset + 4, first);
+            Put32(table + offset + 8, last);
+        }
+    }
+    Put32(ifo->data + 224, sector);
+
+    /* VTS_VOBU_ADMAP */
+    sector = IfoTable(ifo, 4 + titles * cells * 4);
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put32(table, 4 + titles * cells * 4 - 1);
+    for ( i = 0; i < titles; i++ ) {
+        for ( j = 0; j < cells; j++ ) {
+            CellSectors(set, i, j, &first, &last);
+            Put32(table + 4 + (i * cells + j) * 4, first);
+        }
+    }
+    Put32(ifo->data + 228, sector);
+
+    /* VTSI_MAT */
+    mat  = ifo->data;
+    menu = menu_sectors;
+    vobs = TitleSectors(set);
+    memcpy(mat, "DVDVIDEO-VTS", 12);
+    Put32(mat + 12, ifo->sectors * 2 + menu + vobs - 1);
+    Put32(mat + 28, ifo->sectors - 1);
+    mat[33] = 0x11;
+    Put32(mat + 128, 983);
+    Put32(mat + 192, menu > 0 ? ifo->sectors : 0);
+    Put32(mat + 196, ifo->sectors + menu);
+    PutVideoAudio(mat + 512, mat + 515);
+}
+
+static uint32_t
+VMGAttributesLength (void)
+{
+    return(8 + sets * 4 + sets * 542);
+}
+
+static void
+BuildVMG (ifo_t *ifo)
+{
+    /* Loop variables */
+    int i, j;
+
+    unsigned char *mat, *table;
+    uint32_t       sector, offset, vts_ifo = 0;
+
+    ifo->data    = NULL;
+    ifo->sectors = 0;
+    IfoTable(ifo, BLOCK_LEN);
+
+    /* TT_SRPT */
+    sector = IfoTable(ifo, 8 + sets * titles * 12);
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, sets * titles);
+    Put32(table + 4, 8 + sets * titles * 12 - 1);
+    for ( i = 0; i < sets; i++ ) {
+        for ( j = 0; j < number_of_files; j++ ) {
+            if (files[j].set == i + 1 && files[j].kind == FILE_IFO) {
+                vts_ifo = files[j].sector;
+                break;
+            }
+        }
+        for ( j = 0; j < titles; j++ ) {
+            offset = 8 + (i * titles + j) * 12;
+            table[offset + 1] = 1;
+            Put16(table + offset + 2, Chapters());
+            table[offset + 6] = i + 1;
+            table[offset + 7] = j + 1;
+            Put32(table + offset + 8, vts_ifo);
+        }
+    }
+    Put32(ifo->data + 196, sector);
+
+    /* VTS_ATRT */
+    sector = IfoTable(ifo, VMGAttributesLength());
+    table  = ifo->data + sector * BLOCK_LEN;
+    Put16(table, sets);
+    Put32(table + 4, VMGAttributesLength() - 1);
+    for ( i = 0; i < sets; i++ ) {
+        offset = 8 + sets * 4 + i * 542;
+        Put32(table + 8 + i * 4, offset);
+        Put32(table + offset, 541);
+        PutVideoAudio(table + offset + 264, table + offset + 267);
+    }
+    Put32(ifo->data + 208, sector);
+
+    /* VMGI_MAT, with an empty first play PGC behind it */
+    mat = ifo->data;
+    memcpy(mat, "DVDVIDEO-VMG", 12);
+    Put32(mat + 12, ifo->sectors * 2 + menu_sectors - 1);
+    Put32(mat + 28, ifo->sectors - 1);
+    mat[33] = 0x11;
+    Put16(mat + 38, 1);
+    Put16(mat + 40, 1);
+    mat[42] = 1;
+    Put16(mat + 62, sets);
+    memcpy(mat + 64, "dvdbackup mkvideots", 19);
+    Put32(mat + 128, 0x400 + 236 - 1);
+    Put32(mat + 132, 0x400);
+    Put32(mat + 192, menu_sectors > 0 ? ifo->sectors : 0);
+}
+
+static void
+AddFile (const char *name, int set, int kind, uint32_t size, uint32_t first)
+{
+    file_t *file = &files[number_of_files++];
+
+    snprintf(file->name, sizeof(file->name), "%s", name);
+    file->set     = set;
+    file->kind    = kind;
+    file->size    = size;
+    file->sectors = Sectors(size);
+    file->first   = first;
+    file->data    = NULL;
+}
+
+/* The files in disc order: VIDEO_TS.IFO, .VOB and .BUP, then for
+   every title set its IFO, menu VOB, title VOBs and BUP */
+static void
+ListFiles (ifo_t *vmg, ifo_t *vts)
+{
+    /* Loop variables */
+    int i, j;
+
+    char name[32];
+
+    files = (file_t *)calloc(3 + sets * (3 + MAX_PARTS), sizeof(file_t));
+    if (files == NULL) {
+        fprintf(stderr, "Out of memory listing the files\n");
+        exit(1);
+    }
+
+    AddFile("VIDEO_TS.IFO", 0, FILE_IFO, vmg->sectors * BLOCK_LEN, 0);
+    if (menu_sectors > 0) {
+        AddFile("VIDEO_TS.VOB", 0, FILE_MENU, menu_sectors * BLOCK_LEN, 0);
+    }
+    AddFile("VIDEO_TS.BUP", 0, FILE_IFO, vmg->sectors * BLOCK_LEN, 0);
+
+    for ( i = 1; i <= sets; i++ ) {
+        snprintf(name, sizeof(name), "VTS_%02d_0.IFO", i);
+        AddFile(name, i, FILE_IFO, vts[i - 1].sectors * BLOCK_LEN, 0);
+        if (menu_sectors > 0) {
+            snprintf(name, sizeof(name), "VTS_%02d_0.VOB", i);
+            AddFile(name, i, FILE_MENU, menu_sectors * BLOCK_LEN, 0);
+        }
+        for ( j = 1; j <= parts[i - 1]; j++ ) {
+            snprintf(name, sizeof(name), "VTS_%02d_%d.VOB", i, j);
+            AddFile(name, i, FILE_TITLE, part_sectors * BLOCK_LEN, (j - 1) * part_sectors);
+        }
+        snprintf(name, sizeof(name), "VTS_%02d_0.BUP", i);
+        AddFile(name, i, FILE_IFO, vts[i - 1].sectors * BLOCK_LEN, 0);
+    }
+}
+
+/* Every sector starts with an MPEG-2 pack header, the rest is noise
+   seeded by the title set, the kind of VOB and the sector */
+static void
+FillSectors (unsigned char *buffer, const file_t *file, uint32_t sector, uint32_t count)
+{
+    /* Loop variables */
+    uint32_t i;
+    int      j;
+
+    uint64_t       x;
+    unsigned char *p;
+
+    for ( i = 0; i < count; i++ ) {
+        p = buffer + (size_t)i * BLOCK_LEN;
+        x = ((uint64_t)file->set << 40) ^ ((uint64_t)file->kind << 32) ^ (file->first + sector + i);
+        x = (x + 0x9E3779B97F4A7C15ULL) * 0xBF58476D1CE4E5B9ULL;
+        x = x ^ (x >> 31);
+        for ( j = 0; j < BLOCK_LEN; j = j + 8 ) {
+            x = x ^ (x << 13);
+            x = x ^ (x >> 7);
+            x = x ^ (x << 17);
+            memcpy(p + j, &x, 8);
+        }
+        p[0] = 0x00;
+        p[1] = 0x00;
+        p[2] = 0x01;
+        p[3] = 0xba;
+    }
+}
+
+static int
+WriteAll (int fd, const unsigned char *buffer, size_t size, const char *name)
+{
+    ssize_t written;
+
+    while ( size > 0 ) {
+        written = write(fd, buffer, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Error writing %s: %s\n", name, strerror(errno));
+            return(1);
+        }
+        buffer = buffer + written;
+        size = size - written;
+    }
+    return(0);
+}
+
+static int
+WriteFile (int fd, const file_t *file, unsigned char *buffer, const char *name)
+{
+    uint32_t sector, count;
+
+    if (file->data != NULL) {
+        return(WriteAll(fd, file->data, file->size, name));
+    }
+
+    for ( sector = 0; sector < file->sectors; sector = sector + count ) {
+        count = file->sectors - sector;
+        if (count > WRITE_SECTORS) {
+            count = WRITE_SECTORS;
+        }
+        FillSectors(buffer, file, sector, count);
+        if (WriteAll(fd, buffer, (size_t)count * BLOCK_LEN, name) != 0) {
+            return(1);
+        }
+    }
+    return(0);
+}
+
+static int
+WriteDirectory (const char *target, unsigned char *buffer)
+{
+    /* Loop variables */
+    int i;
+
+    char path[PATH_MAX];
+    int  fd;
+
+    snprintf(path, sizeof(path), "%s/VIDEO_TS", target);
+    if ((mkdir(target, 0777) != 0 && errno != EEXIST)
+        || (mkdir(path, 0777) != 0 && errno != EEXIST)) {
+        fprintf(stderr, "Can't create %s: %s\n", path, strerror(errno));
+        return(1);
+    }
+
+    for ( i = 0; i < number_of_files; i++ ) {
+        snprintf(path, sizeof(path), "%s/VIDEO_TS/%s", target, files[i].name);
+        if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+            fprintf(stderr, "Can't create %s: %s\n", path, strerror(errno));
+            return(1);
+        }
+        if (WriteFile(fd, &files[i], buffer, path) != 0) {
+            close(fd);
+            return(1);
+        }
+        close(fd);
+    }
+    return(0);
+}
+
+/* Where everything goes: the image keeps the file system up front and
+   the files behind it in disc order. A VIDEO_TS directory gets the same
+   layout, so the title set sectors in its TT_SRPT are the ones an image
+   would have */
+static void
+Layout (const char *target)
+{
+    /* Loop variables */
+    int i;
+
+    ImageInit(&disc, target, volume);
+    /* Fixed, so the same options give the same image */
+    disc.created = 1009843200;
+    for ( i = 0; i < number_of_files; i++ ) {
+        if (ImageAddFile(&disc, files[i].name, files[i].size) != 0) {
+            fprintf(stderr, "Out of memory laying out the files\n");
+            exit(1);
+        }
+    }
+    ImageLayout(&disc);
+    for ( i = 0; i < number_of_files; i++ ) {
+        files[i].sector = disc.file[i].sector;
+    }
+}
+
+static int
+WriteImage (const char *target, unsigned char *buffer)
+{
+    /* Loop variables */
+    int i;
+
+    int fd;
+
+    if ((fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0666)) == -1) {
+        fprintf(stderr, "Can't create %s: %s\n", target, strerror(errno));
+        return(1);
+    }
+    if (ImageWriteHeader(&disc, fd) != 0) {
+        close(fd);
+        return(1);
+    }
+
+    for ( i = 0; i < number_of_files; i++ ) {
+        if (lseek(fd, (off_t)files[i].sector * BLOCK_LEN, SEEK_SET) == -1
+            || WriteFile(fd, &files[i], buffer, target) != 0) {
+            close(fd);
+            return(1);
+        }
+    }
+    close(fd);
+    return(0);
+}
+
+/* "2,1" sets the parts of title sets 1 and 2, the last one repeats */
+static int
+ParseParts (const char *list)
+{
+    /* Loop variables */
+    int i;
+
+    char *end;
+    long  value = 0;
+
+    for ( i = 0; i < MAX_SETS; i++ ) {
+        if (*list != '\0') {
+            value = strtol(list, &end, 10);
+            if (end == list || (*end != ',' && *end != '\0')
+                || value < 1 || value > MAX_PARTS) {
+                return(1);
+            }
+            list = *end == ',' ? end + 1 : end;
+        }
+        parts[i] = value;
+    }
+    return(0);
+}
+
+int
+main (int argc, char *argv[])
+{
+    /* Loop variables */
+    int i;
+
+    ifo_t          vmg, *vts;
+    unsigned char *buffer;
+    char          *target = NULL;
+    int            image  = 0;
+    int            opt, result;
+    uint32_t       share;
+
+    ParseParts("2,1");
+
+    while ((opt = getopt(argc, argv, "o:un:T:t:p:S:c:C:g:m:h?")) != EOF) {
+        switch (opt) {
+        case 'o':
+            target = optarg;
+            break;
+        case 'u':
+            image = 1;
+            break;
+        case 'n':
+            volume = optarg;
+            break;
+        case 'T':
+            sets = atoi(optarg);
+            break;
+        case 't':
+            titles = atoi(optarg);
+            break;
+        case 'p':
+            if (ParseParts(optarg) != 0) {
+                fprintf(stderr, "-p wants 1 to %d parts per title set\n", MAX_PARTS);
+                return(1);
+            }
+            break;
+        case 'S':
+            part_sectors = atoi(optarg) * (1024 * 1024 / BLOCK_LEN);
+            break;
+        case 'c':
+            cells = atoi(optarg);
+            break;
+        case 'C':
+            cells_per_chapter = atoi(optarg);
+            break;
+        case 'g':
+            gap = atoi(optarg);
+            break;
+        case 'm':
+            menu_sectors = Sectors(atoi(optarg) * 1024);
+            break;
+        case 'h':
+        case '?':
+        default:
+            usage();
+            return(1);
+        }
+    }
+
+    if (target == NULL) {
+        usage();
+        return(1);
+    }
+    if (sets < 1 || sets > MAX_SETS || titles < 1 || sets * titles > 99) {
+        fprintf(stderr, "There can be 1 to %d title sets and 99 titles in all\n", MAX_SETS);
+        return(1);
+    }
+    if (part_sectors == 0 || part_sectors > MAX_PART_SECTORS) {
+        fprintf(stderr, "-S wants 1 to 1023 MB per VOB part\n");
+        return(1);
+    }
+    if (cells < 1 || cells > MAX_CELLS || cells_per_chapter < 1
+        || Chapters() > MAX_CHAPTERS) {
+        fprintf(stderr, "A title can have 1 to %d cells and %d chapters\n",
+                MAX_CELLS, MAX_CHAPTERS);
+        return(1);
+    }
+    for ( i = 1; i <= sets; i++ ) {
+        share = TitleSectors(i) / titles;
+        if (share < (uint32_t)(cells - 1) * gap + cells * 2) {
+            fprintf(stderr, "Title set %d is too small for %d titles of %d cells "
+                    "with %u sector gaps\n", i, titles, cells, gap);
+            return(1);
+        }
+    }
+
+    vts = (ifo_t *)calloc(sets, sizeof(ifo_t));
+    buffer = (unsigned char *)malloc(WRITE_SECTORS * BLOCK_LEN);
+    if (vts == NULL || buffer == NULL) {
+        fprintf(stderr, "Out of memory\n");
+        return(1);
+    }
+    for ( i = 1; i <= sets; i++ ) {
+        BuildVTS(&vts[i - 1], i);
+    }
+
+    /* The VMG points at the title set IFOs, so it is built once for
+       its size and again when the layout is known */
+    BuildVMG(&vmg);
+    ListFiles(&vmg, vts);
+    Layout(target);
+    free(vmg.data);
+    BuildVMG(&vmg);
+    for ( i = 0; i < number_of_files; i++ ) {
+        if (files[i].kind == FILE_IFO) {
+            files[i].data = files[i].set == 0 ? vmg.data : vts[files[i].set - 1].data;
+        }
+    }
+
+    if (image) {
+        result = WriteImage(target, buffer);
+    } else {
+        result = WriteDirectory(target, buffer);
+    }
+    if (result == 0) {
+        fprintf(stderr, "Wrote %d title sets, %d files, %.1f MB to %s\n", sets,
+                number_of_files, (double)disc.sectors * BLOCK_LEN / (1024 * 1024), target);
+    }
+
+    for ( i = 0; i < sets; i++ ) {
+        free(vts[i].data);
+    }
+    free(vts);
+    free(vmg.data);
+    free(files);
+    ImageFree(&disc);
+    free(buffer);
+    return(result);
+}
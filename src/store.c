@@ -0,0 +1,635 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/* A content addressed store of VOB data, shared by every backup under
+   one -o. A VOB is cut into chunks where its NAV packs start a new
+   cell, each chunk is hashed as the VOB is written and looked up in an
+   index held in memory.
+   A chunk the store has is shared with the backup, a new one is cloned
+   into the store, both with reflinks so nothing is written twice and
+   the kernel checks the contents really match. On filesystems without
+   reflinks identical VOBs are hard linked as a whole instead */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
+
+#include "checksum.h"
+#include "store.h"
+
+#define SECTOR_LEN         2048
+/* Sectors read at a time while hashing a VOB read back */
+#define STORE_READ_SECTORS 512
+/* Paths in the store, its directory and a chunk name */
+#define STORE_PATH_MAX     (PATH_MAX + 64)
+/* Most a single FIDEDUPERANGE call is sure to share */
+#define STORE_DEDUPE_LEN   (16 * 1024 * 1024)
+
+/* The cell a NAV pack starts, from the vob and cell ids in its DSI.
+   Returns 0 if the sector isn't a NAV pack */
+static int
+StoreNavCell (const unsigned char *sector, uint32_t *cell)
+{
+    if ( sector[0] != 0x00 || sector[1] != 0x00 || sector[2] != 0x01
+         || sector[3] != 0xba ) {
+        return(0);
+    }
+    /* Private stream 2 holding the DSI, right after the PCI */
+    if ( sector[1024] != 0x00 || sector[1025] != 0x00 || sector[1026] != 0x01
+         || sector[1027] != 0xbf || sector[1030] != 0x01 ) {
+        return(0);
+    }
+    *cell = ((uint32_t)sector[1055] << 16) | ((uint32_t)sector[1056] << 8)
+            | sector[1058];
+    return(1);
+}
+
+static uint32_t
+StoreSlot (store_t *store, const store_key_t *key)
+{
+    uint32_t slot = (uint32_t)(key->hash ^ (key->hash >> 32)) & (store->keys - 1);
+
+    while ( store->key[slot].hash != 0
+            && (store->key[slot].hash != key->hash
+                || store->key[slot].sectors != key->sectors
+                || store->key[slot].phase != key->phase) ) {
+        slot = (slot + 1) & (store->keys - 1);
+    }
+    return(slot);
+}
+
+static int
+StoreFind (store_t *store, const store_key_t *key)
+{
+    return(store->key[StoreSlot(store, key)].hash != 0);
+}
+
+/* The index is kept at most half full so lookups stay short. Returns 1
+   if out of memory */
+static int
+StoreInsert (store_t *store, const store_key_t *key)
+{
+    /* Loop variable */
+    uint32_t i;
+
+    store_key_t *old  = store->key;
+    uint32_t     keys = store->keys;
+
+    if ( (store->used + 1) * 2 > store->keys ) {
+        if ((store->key = (store_key_t *)calloc(keys * 2, sizeof(store_key_t))) == NULL) {
+            store->key = old;
+            return(1);
+        }
+        store->keys = keys * 2;
+        for ( i = 0; i < keys; i++ ) {
+            if ( old[i].hash != 0 ) {
+                store->key[StoreSlot(store, &old[i])] = old[i];
+            }
+        }
+        free(old);
+    }
+    store->key[StoreSlot(store, key)] = *key;
+    store->used++;
+    return(0);
+}
+
+static void
+StorePath (store_t *store, const store_key_t *key, char *path, int make_dir)
+{
+    snprintf(path, STORE_PATH_MAX, "%s/%02x", store->dir, (unsigned)(key->hash >> 56));
+    if ( make_dir ) {
+        mkdir(path, 0755);
+    }
+    snprintf(path, STORE_PATH_MAX, "%s/%02x/%016llx-%u-%u", store->dir,
+             (unsigned)(key->hash >> 56), (unsigned long long)key->hash,
+             key->sectors, key->phase);
+}
+
+/* Whether the filesystem can share blocks between two files, tried
+   on two scratch files in the store */
+static int
+StoreCanReflink (store_t *store)
+{
+#ifdef __linux__
+    char          source[STORE_PATH_MAX];
+    char          target[STORE_PATH_MAX];
+    unsigned char block[STORE_BLOCK_LEN];
+    int           from, to;
+    int           result = 0;
+
+    snprintf(source, sizeof(source), "%s/.reflink-source", store->dir);
+    snprintf(target, sizeof(target), "%s/.reflink-target", store->dir);
+    memset(block, 0x5a, sizeof(block));
+
+    if ((from = open(source, O_RDWR | O_CREAT | O_TRUNC, 0644)) != -1) {
+        if ((to = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644)) != -1) {
+            result = (write(from, block, sizeof(block)) == sizeof(block)
+                      && ioctl(to, FICLONE, from) == 0);
+            close(to);
+            unlink(target);
+        }
+        close(from);
+        unlink(source);
+    }
+    return(result);
+#else
+    /* Only Linux clones files, elsewhere whole VOBs are hard linked */
+    (void)store;
+    return(0);
+#endif
+}
+
+store_t*
+StoreOpen (const char *targetdir)
+{
+    store_t            *store;
+    char                path[STORE_PATH_MAX];
+    unsigned long long  hash;
+    unsigned int        sectors, phase;
+    store_key_t         key;
+
+    if ((store = (store_t *)calloc(1, sizeof(store_t))) == NULL) {
+        fprintf(stderr, "Out of memory opening the store\n");
+        return(NULL);
+    }
+    pthread_mutex_init(&store->lock, NULL);
+    snprintf(store->dir, sizeof(store->dir), "%s/%s", targetdir, STORE_NAME);
+    if ( mkdir(store->dir, 0755) != 0 && errno != EEXIST ) {
+        fprintf(stderr, "Failed creating the store %s\n", store->dir);
+        perror("");
+        StoreClose(store);
+        return(NULL);
+    }
+
+    store->keys = 1024;
+    if ((store->key = (store_key_t *)calloc(store->keys, sizeof(store_key_t))) == NULL) {
+        fprintf(stderr, "Out of memory opening the store\n");
+        StoreClose(store);
+        return(NULL);
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", store->dir, STORE_INDEX);
+    if ((store->index = fopen(path, "a+")) == NULL) {
+        fprintf(stderr, "Can't open the store index %s\n", path);
+        StoreClose(store);
+        return(NULL);
+    }
+    rewind(store->index);
+    while ( fscanf(store->index, "%llx %u %u", &hash, &sectors, &phase) == 3 ) {
+        key.hash    = hash;
+        key.sectors = sectors;
+        key.phase   = phase;
+        if ( key.hash != 0 && !StoreFind(store, &key) && StoreInsert(store, &key) != 0 ) {
+            fprintf(stderr, "Out of memory reading the store index\n");
+            StoreClose(store);
+            return(NULL);
+        }
+    }
+
+    store->reflink = StoreCanReflink(store);
+    if ( !store->reflink ) {
+        fprintf(stderr, "%s has no reflinks, only whole VOBs are shared\n",
+                store->dir);
+    }
+
+    return(store);
+}
+
+static int
+StoreRemember (store_t *store, const store_key_t *key)
+{
+    if ( StoreInsert(store, key) != 0 ) {
+        return(1);
+    }
+    fprintf(store->index, "%016llx %u %u\n", (unsigned long long)key->hash,
+            key->sectors, key->phase);
+    return(fflush(store->index) != 0);
+}
+
+#ifdef __linux__
+/* Share the whole blocks from to to - 1 of the backup with the chunk
+   file, which holds the backup from chunk_start on */
+static int
+StoreDedupe (int chunk, off_t chunk_start, int fd, off_t from, off_t to)
+{
+    struct file_dedupe_range *range;
+    int                       result = 0;
+
+    range = (struct file_dedupe_range *)calloc(1, sizeof(struct file_dedupe_range)
+                                               + sizeof(struct file_dedupe_range_info));
+    if (range == NULL) {
+        return(1);
+    }
+
+    while ( from < to && result == 0 ) {
+        range->src_offset  = from - chunk_start;
+        range->src_length  = (to - from < STORE_DEDUPE_LEN ? to - from : STORE_DEDUPE_LEN);
+        range->dest_count  = 1;
+        range->info[0].dest_fd     = fd;
+        range->info[0].dest_offset = from;
+
+        if ( ioctl(chunk, FIDEDUPERANGE, range) != 0
+             || range->info[0].status != FILE_DEDUPE_RANGE_SAME
+             || range->info[0].bytes_deduped == 0 ) {
+            /* Another chunk with the same hash, or no sharing here */
+            result = 1;
+        }
+        from = from + range->info[0].bytes_deduped;
+    }
+    free(range);
+    return(result);
+}
+
+static int
+StoreCopy (int from, off_t from_offset, int to, off_t to_offset, size_t length)
+{
+    ssize_t copied;
+
+    while ( length > 0 ) {
+        if ((copied = copy_file_range(from, &from_offset, to, &to_offset,
+                                      length, 0)) <= 0) {
+            return(1);
+        }
+        length = length - copied;
+    }
+    return(0);
+}
+
+/* Put sectors start to start + sectors - 1 of the backup in the store,
+   or share them with the copy already there. Returns 1 on errors */
+static int
+StoreChunk (store_t *store, int fd, uint32_t start, uint32_t sectors, uint64_t hash)
+{
+    store_key_t                 key;
+    struct file_clone_range     clone;
+    char                        path[STORE_PATH_MAX];
+    off_t                       first = (off_t)start * SECTOR_LEN;
+    off_t                       end   = (off_t)(start + sectors) * SECTOR_LEN;
+    off_t                       from, to, chunk_start;
+    int                         chunk;
+    int                         result = 0;
+
+    key.hash    = (hash != 0 ? hash : 1);
+    key.sectors = sectors;
+    key.phase   = (first % STORE_BLOCK_LEN) / SECTOR_LEN;
+
+    /* The whole blocks of the chunk, the only part that can be shared */
+    from = (first + STORE_BLOCK_LEN - 1) / STORE_BLOCK_LEN * STORE_BLOCK_LEN;
+    to   = end / STORE_BLOCK_LEN * STORE_BLOCK_LEN;
+    if ( to <= from ) {
+        return(0);
+    }
+
+    /* In the chunk file the data starts at its phase, so its blocks
+       line up with the ones of the backup */
+    chunk_start = first - (off_t)key.phase * SECTOR_LEN;
+
+    pthread_mutex_lock(&store->lock);
+    StorePath(store, &key, path, 1);
+
+    if ( StoreFind(store, &key) && (chunk = open(path, O_RDONLY)) != -1 ) {
+        if ( StoreDedupe(chunk, chunk_start, fd, from, to) == 0 ) {
+            store->shared = store->shared + sectors;
+        }
+        close(chunk);
+        pthread_mutex_unlock(&store->lock);
+        return(0);
+    }
+
+    if ((chunk = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        pthread_mutex_unlock(&store->lock);
+        return(1);
+    }
+    clone.src_fd      = fd;
+    clone.src_offset  = from;
+    clone.src_length  = to - from;
+    clone.dest_offset = from - chunk_start;
+    if ( ftruncate(chunk, end - chunk_start) != 0
+         || ioctl(chunk, FICLONERANGE, &clone) != 0
+         || StoreCopy(fd, first, chunk, first - chunk_start, from - first) != 0
+         || StoreCopy(fd, to, chunk, to - chunk_start, end - to) != 0 ) {
+        unlink(path);
+        result = 1;
+    } else if ( !StoreFind(store, &key) ) {
+        result = StoreRemember(store, &key);
+    }
+    if ( result == 0 ) {
+        store->added = store->added + sectors;
+    }
+    close(chunk);
+
+    pthread_mutex_unlock(&store->lock);
+    return(result);
+}
+
+#else
+/* Never called, without reflinks the store takes whole files */
+static int
+StoreChunk (store_t *store, int fd, uint32_t start, uint32_t sectors, uint64_t hash)
+{
+    (void)store;
+    (void)fd;
+    (void)start;
+    (void)sectors;
+    (void)hash;
+    return(1);
+}
+#endif
+
+/* Whether two files hold the same data */
+static int
+StoreSame (int a, int b, off_t size)
+{
+    unsigned char *buffer;
+    off_t          offset;
+    size_t         n;
+    int            same = 1;
+
+    if ((buffer = (unsigned char *)malloc(2 * STORE_READ_SECTORS * SECTOR_LEN)) == NULL) {
+        return(0);
+    }
+    for ( offset = 0; offset < size && same; offset = offset + n ) {
+        n = STORE_READ_SECTORS * SECTOR_LEN;
+        if ( (off_t)n > size - offset ) {
+            n = size - offset;
+        }
+        same = (pread(a, buffer, n, offset) == (ssize_t)n
+                && pread(b, buffer + n, n, offset) == (ssize_t)n
+                && memcmp(buffer, buffer + n, n) == 0);
+    }
+    free(buffer);
+    return(same);
+}
+
+/* Without reflinks a VOB is shared as a whole: the first backup of it
+   goes in the store as a hard link, later ones are replaced by a link
+   to it */
+static int
+StoreWholeFile (store_t *store, int fd, const char *path, uint32_t sectors,
+                uint64_t hash)
+{
+    store_key_t key;
+    struct stat fileinfo;
+    char        chunk_path[STORE_PATH_MAX];
+    char        temp_path[STORE_PATH_MAX];
+    int         chunk;
+    int         result = 0;
+
+    key.hash    = (hash != 0 ? hash : 1);
+    key.sectors = sectors;
+    key.phase   = STORE_WHOLE_FILE;
+
+    pthread_mutex_lock(&store->lock);
+    StorePath(store, &key, chunk_path, 1);
+
+    if ( StoreFind(store, &key) && (chunk = open(chunk_path, O_RDONLY)) != -1 ) {
+        snprintf(temp_path, sizeof(temp_path), "%s.store", path);
+        if ( fstat(chunk, &fileinfo) == 0 && fileinfo.st_size == (off_t)sectors * SECTOR_LEN
+             && StoreSame(chunk, fd, fileinfo.st_size) ) {
+            unlink(temp_path);
+            if ( link(chunk_path, temp_path) != 0 || rename(temp_path, path) != 0 ) {
+                unlink(temp_path);
+                result = 1;
+            } else {
+                store->shared = store->shared + sectors;
+            }
+        }
+        close(chunk);
+        pthread_mutex_unlock(&store->lock);
+        return(result);
+    }
+
+    unlink(chunk_path);
+    if ( link(path, chunk_path) != 0 ) {
+        result = 1;
+    } else {
+        if ( !StoreFind(store, &key) ) {
+            result = StoreRemember(store, &key);
+        }
+        store->added = store->added + sectors;
+    }
+
+    pthread_mutex_unlock(&store->lock);
+    return(result);
+}
+
+/* Only the hash of the whole file is needed without reflinks */
+store_feed_t*
+StoreFeedOpen (store_t *store)
+{
+    store_feed_t *feed;
+
+    if ((feed = (store_feed_t *)calloc(1, sizeof(store_feed_t))) == NULL) {
+        return(NULL);
+    }
+    feed->whole = !store->reflink;
+    ChecksumInit(&feed->sum, CHECKSUM_XXH64);
+    return(feed);
+}
+
+void
+StoreFeedFree (store_feed_t *feed)
+{
+    if (feed == NULL) {
+        return;
+    }
+    free(feed->chunk);
+    free(feed);
+}
+
+/* Close the chunk running up to sector end. Returns 1 if out of memory */
+static int
+StoreFeedChunk (store_feed_t *feed, uint32_t end)
+{
+    store_chunk_t *chunk;
+
+    if ( end <= feed->start ) {
+        return(0);
+    }
+    if ( feed->chunks % 64 == 0 ) {
+        if ((chunk = (store_chunk_t *)realloc(feed->chunk, (feed->chunks + 64)
+                                              * sizeof(store_chunk_t))) == NULL) {
+            return(1);
+        }
+        feed->chunk = chunk;
+    }
+    feed->chunk[feed->chunks].start   = feed->start;
+    feed->chunk[feed->chunks].sectors = end - feed->start;
+    feed->chunk[feed->chunks].hash    = ChecksumFinal(&feed->sum);
+    feed->chunks++;
+
+    ChecksumInit(&feed->sum, CHECKSUM_XXH64);
+    feed->start = end;
+    return(0);
+}
+
+/* Feed whole sectors of the VOB from position on. A chunk ends where
+   a NAV pack starts another cell */
+void
+StoreFeed (store_feed_t *feed, off_t position, const unsigned char *data,
+           size_t length)
+{
+    /* Loop variable */
+    size_t i;
+
+    uint32_t sector = position / SECTOR_LEN;
+    uint32_t cell;
+    size_t   run = 0;
+
+    if ( feed->unordered ) {
+        return;
+    }
+    if ( position != feed->fed || length % SECTOR_LEN != 0 ) {
+        feed->unordered = 1;
+        return;
+    }
+    feed->fed = feed->fed + length;
+
+    if ( feed->whole ) {
+        ChecksumUpdate(&feed->sum, data, length);
+        return;
+    }
+    for ( i = 0; i < length; i = i + SECTOR_LEN, sector++ ) {
+        if ( StoreNavCell(data + i, &cell)
+             && (!feed->have_cell || cell != feed->cell) ) {
+            ChecksumUpdate(&feed->sum, data + run, i - run);
+            run = i;
+            if ( StoreFeedChunk(feed, sector) != 0 ) {
+                feed->unordered = 1;
+                return;
+            }
+            feed->cell      = cell;
+            feed->have_cell = 1;
+        }
+    }
+    ChecksumUpdate(&feed->sum, data + run, length - run);
+}
+
+/* Feed the whole VOB from the file, for one whose data didn't go
+   through a feed in order */
+static int
+StoreReadBack (store_feed_t *feed, int fd, off_t size)
+{
+    unsigned char *buffer;
+    ssize_t        got;
+
+    if ((buffer = (unsigned char *)malloc(STORE_READ_SECTORS * SECTOR_LEN)) == NULL) {
+        return(1);
+    }
+#ifdef __linux__
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    while ( feed->fed < size && !feed->unordered ) {
+        if ((got = pread(fd, buffer, STORE_READ_SECTORS * SECTOR_LEN, feed->fed)) <= 0) {
+            feed->unordered = 1;
+        } else {
+            StoreFeed(feed, feed->fed, buffer, got);
+        }
+    }
+    free(buffer);
+    return(feed->unordered);
+}
+
+/* Share what the store already has of a finished VOB, from the chunks
+   its feed found. Without a feed, or with one that missed some of the
+   data, the VOB is read back and hashed here. Returns 1 if any of it
+   couldn't go in the store, the backup itself is never touched then */
+int
+StoreFile (store_t *store, const char *path, store_feed_t *feed)
+{
+    /* Loop variable */
+    uint32_t i;
+
+    store_feed_t *own = NULL;
+    struct stat   fileinfo;
+    uint32_t      sectors;
+    int           fd;
+    int           result = 0;
+
+    /* Sharing blocks needs the backup open for writing */
+    if ((fd = open(path, O_RDWR)) == -1) {
+        return(1);
+    }
+    if ( fstat(fd, &fileinfo) != 0 || fileinfo.st_size % SECTOR_LEN != 0 ) {
+        close(fd);
+        return(1);
+    }
+    if ( fileinfo.st_size == 0 ) {
+        close(fd);
+        return(0);
+    }
+    sectors = fileinfo.st_size / SECTOR_LEN;
+
+    if ( feed == NULL || feed->unordered || feed->fed != fileinfo.st_size ) {
+        if ((own = StoreFeedOpen(store)) == NULL
+            || StoreReadBack(own, fd, fileinfo.st_size) != 0) {
+            StoreFeedFree(own);
+            close(fd);
+            return(1);
+        }
+        feed = own;
+    }
+
+    if ( feed->whole ) {
+        result = StoreWholeFile(store, fd, path, sectors, ChecksumFinal(&feed->sum));
+    } else {
+        /* The last chunk runs to the end of the file */
+        result = StoreFeedChunk(feed, sectors);
+        for ( i = 0; i < feed->chunks && result == 0; i++ ) {
+            result = StoreChunk(store, fd, feed->chunk[i].start, feed->chunk[i].sectors,
+                                feed->chunk[i].hash);
+        }
+    }
+
+    StoreFeedFree(own);
+    close(fd);
+    return(result);
+}
+
+void
+StoreReport (store_t *store)
+{
+    fprintf(stderr, "Store: %lld MB shared with earlier backups, %lld MB added\n",
+            store->shared * SECTOR_LEN / (1024 * 1024),
+            store->added * SECTOR_LEN / (1024 * 1024));
+}
+
+void
+StoreClose (store_t *store)
+{
+    if (store == NULL) {
+        return;
+    }
+    if (store->index != NULL && fclose(store->index) != 0) {
+        fprintf(stderr, "Error writing the store index in %s\n", store->dir);
+    }
+    pthread_mutex_destroy(&store->lock);
+    free(store->key);
+    free(store);
+}
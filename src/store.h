@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef STORE_H
+#define STORE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "checksum.h"
+
+/* The store every backup under -o shares */
+#define STORE_NAME      "dvdbackup.store"
+#define STORE_INDEX     "index"
+
+/* Chunks share whole filesystem blocks. A chunk that starts halfway
+   through a block only matches chunks that do the same, its phase */
+#define STORE_BLOCK_LEN 4096
+
+/* Without reflinks whole VOB files are hard linked, their phase is this */
+#define STORE_WHOLE_FILE 2
+
+/* A chunk of VOB data, known by the hash of its contents, its length
+   and its phase. A hash of 0 marks an empty slot of the index */
+
+typedef struct {
+    uint64_t hash;
+    uint32_t sectors;
+    uint32_t phase;
+} store_key_t;
+
+typedef struct {
+    pthread_mutex_t  lock;
+    char             dir[PATH_MAX];
+    FILE            *index;
+    store_key_t     *key;
+    uint32_t         keys;
+    uint32_t         used;
+    int              reflink;
+
+    /* Sectors found in the store and added to it by this run */
+    long long        shared;
+    long long        added;
+} store_t;
+
+/* Sectors start to start + sectors - 1 of a VOB, one chunk */
+
+typedef struct {
+    uint32_t start;
+    uint32_t sectors;
+    uint64_t hash;
+} store_chunk_t;
+
+/* The chunks of one VOB, hashed as its data goes out. The data has to
+   come in file order, a VOB that didn't is read back by StoreFile */
+
+typedef struct {
+    int            whole;
+    off_t          fed;
+    int            unordered;
+    checksum_t     sum;
+    uint32_t       start;
+    uint32_t       cell;
+    int            have_cell;
+    store_chunk_t *chunk;
+    uint32_t       chunks;
+} store_feed_t;
+
+store_t *StoreOpen(const char *targetdir);
+store_feed_t *StoreFeedOpen(store_t *store);
+void StoreFeed(store_feed_t *feed, off_t position, const unsigned char *data,
+               size_t length);
+void StoreFeedFree(store_feed_t *feed);
+int StoreFile(store_t *store, const char *path, store_feed_t *feed);
+void StoreReport(store_t *store);
+void StoreClose(store_t *store);
+
+#endif